@@ -2352,6 +2352,13 @@ function test_mon_osd_pool_set()
       ceph osd pool get $TEST_POOL_GETSET $size | expect_false grep '.'
   done
 
+  ceph osd pool get $TEST_POOL_GETSET alloc_unit_hint | expect_false grep '.'
+  expect_false ceph osd pool set $TEST_POOL_GETSET alloc_unit_hint 100
+  ceph osd pool set $TEST_POOL_GETSET alloc_unit_hint 64K
+  ceph osd pool get $TEST_POOL_GETSET alloc_unit_hint | grep '65536'
+  ceph osd pool set $TEST_POOL_GETSET alloc_unit_hint 0
+  ceph osd pool get $TEST_POOL_GETSET alloc_unit_hint | expect_false grep '.'
+
   ceph osd pool set $TEST_POOL_GETSET nodelete 1
   expect_false ceph osd pool delete $TEST_POOL_GETSET $TEST_POOL_GETSET --yes-i-really-really-mean-it
   ceph osd pool set $TEST_POOL_GETSET nodelete 0
@@ -498,6 +498,17 @@ int KernelDevice::_aio_start()
       }
       return r;
     }
+    if (cct->_conf.get_val<bool>("bdev_ioring") &&
+	ioring_queue_t::supported()) {
+      sync_ring = std::make_unique<ioring_sync_t>(
+	cct->_conf.get_val<Option::size_t>("bdev_ioring_sync_buffer_size"));
+      r = sync_ring->init(fd_directs);
+      if (r < 0) {
+	derr << __func__ << " io_uring setup for sync writes failed: "
+	     << cpp_strerror(r) << ", using pwritev" << dendl;
+	sync_ring.reset();
+      }
+    }
     aio_thread.create("bstore_aio");
   }
   return 0;
@@ -511,6 +522,11 @@ void KernelDevice::_aio_stop()
     aio_thread.join();
     aio_stop = false;
     io_queue->shutdown();
+    if (sync_ring) {
+      sync_ring->shutdown();
+      // a write after this must not use the ring's released fds
+      sync_ring.reset();
+    }
   }
 }
 
@@ -858,6 +874,20 @@ int KernelDevice::_sync_write(uint64_t off, bufferlist &bl, bool buffered, int w
     ++injecting_crash;
     return 0;
   }
+  if (sync_ring && !buffered) {
+    // reap the completion on this thread, no pinning for small writes
+    int r = sync_ring->write(choose_fd(false, write_hint), bl, off);
+    if (r == 0) {
+      io_since_flush.store(true);
+      return 0;
+    }
+    if (r != -EBUSY) {
+      derr << __func__ << " io_uring write error: " << cpp_strerror(r) << dendl;
+      return r;
+    }
+    // ring is busy with another writer, don't queue behind it
+  }
+
   vector<iovec> iov;
   bl.prepare_iov(&iov);
 
@@ -24,6 +24,7 @@
 
 #include "aio/aio.h"
 #include "BlockDevice.h"
+#include "io_uring.h"
 
 #define RW_IO_MAX (INT_MAX & CEPH_PAGE_MASK)
 
@@ -47,6 +48,7 @@ private:
   ceph::mutex flush_mutex = ceph::make_mutex("KernelDevice::flush_mutex");
 
   std::unique_ptr<io_queue_t> io_queue;
+  std::unique_ptr<ioring_sync_t> sync_ring; ///< for _sync_write, if io_uring
   aio_callback_t discard_callback;
   void *discard_callback_priv;
   bool aio_stop;
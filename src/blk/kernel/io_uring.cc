@@ -7,6 +7,9 @@
 
 #include "liburing.h"
 #include <sys/epoll.h>
+#include <mutex>
+
+#include "include/page.h"
 
 using std::list;
 using std::make_unique;
@@ -220,6 +223,126 @@ bool ioring_queue_t::supported()
   return true;
 }
 
+struct ioring_sync_data {
+  struct io_uring io_uring;
+  std::mutex lock;
+  std::map<int, int> fixed_fds_map;
+  void *buf = nullptr;
+  bool buf_registered = false;
+};
+
+ioring_sync_t::ioring_sync_t(unsigned buf_size_) :
+  d(make_unique<ioring_sync_data>()),
+  buf_size(buf_size_)
+{
+}
+
+ioring_sync_t::~ioring_sync_t()
+{
+}
+
+int ioring_sync_t::init(std::vector<int> &fds)
+{
+  // one request in flight at a time
+  int ret = io_uring_queue_init(2, &d->io_uring, 0);
+  if (ret < 0)
+    return ret;
+
+  ret = io_uring_register_files(&d->io_uring, &fds[0], fds.size());
+  if (ret < 0) {
+    io_uring_queue_exit(&d->io_uring);
+    return ret;
+  }
+  int fixed_fd = 0;
+  for (int real_fd : fds) {
+    d->fixed_fds_map[real_fd] = fixed_fd++;
+  }
+
+  if (buf_size &&
+      posix_memalign(&d->buf, CEPH_PAGE_SIZE, buf_size) == 0) {
+    struct iovec iov = { d->buf, buf_size };
+    // registered buffers count against RLIMIT_MEMLOCK; go without if refused
+    d->buf_registered =
+      io_uring_register_buffers(&d->io_uring, &iov, 1) == 0;
+  }
+  return 0;
+}
+
+void ioring_sync_t::shutdown()
+{
+  d->fixed_fds_map.clear();
+  io_uring_queue_exit(&d->io_uring);
+  free(d->buf);
+  d->buf = nullptr;
+  d->buf_registered = false;
+}
+
+int ioring_sync_t::write(int fd, ceph::buffer::list &bl, uint64_t off)
+{
+  std::unique_lock l(d->lock, std::try_to_lock);
+  if (!l.owns_lock())
+    return -EBUSY;
+
+  auto it = d->fixed_fds_map.find(fd);
+  if (it == d->fixed_fds_map.end())
+    return -EBADF;
+  int fixed_fd = it->second;
+
+  uint64_t len = bl.length();
+  std::vector<iovec> iov;
+  bool fixed_buf = d->buf_registered && len <= buf_size;
+  if (fixed_buf) {
+    bl.begin().copy(len, static_cast<char*>(d->buf));
+  } else {
+    bl.prepare_iov(&iov);
+  }
+
+  uint64_t done = 0;
+  size_t idx = 0;
+  while (done < len) {
+    struct io_uring_sqe *sqe = io_uring_get_sqe(&d->io_uring);
+    ceph_assert(sqe);
+    if (fixed_buf) {
+      io_uring_prep_write_fixed(sqe, fixed_fd,
+				static_cast<char*>(d->buf) + done,
+				len - done, off + done, 0);
+    } else {
+      io_uring_prep_writev(sqe, fixed_fd, &iov[idx], iov.size() - idx,
+			   off + done);
+    }
+    io_uring_sqe_set_flags(sqe, IOSQE_FIXED_FILE);
+
+    int r = io_uring_submit_and_wait(&d->io_uring, 1);
+    if (r < 0)
+      return r;
+    struct io_uring_cqe *cqe;
+    r = io_uring_wait_cqe(&d->io_uring, &cqe);
+    if (r < 0)
+      return r;
+    int res = cqe->res;
+    io_uring_cqe_seen(&d->io_uring, cqe);
+    if (res < 0)
+      return res;
+    if (res == 0)
+      return -EIO;
+
+    done += res;
+    if (!fixed_buf && done < len) {
+      // skip fully processed IOVs and trim a partially processed one
+      size_t skip = res;
+      while (idx < iov.size() && skip >= iov[idx].iov_len) {
+	skip -= iov[idx++].iov_len;
+      }
+      if (skip) {
+	ceph_assert(idx < iov.size());
+	iov[idx].iov_base = static_cast<char*>(iov[idx].iov_base) + skip;
+	iov[idx].iov_len -= skip;
+      }
+    }
+  }
+  return 0;
+}
+
 #else // #if defined(HAVE_LIBURING)
 
 struct ioring_data {};
@@ -261,4 +384,31 @@ bool ioring_queue_t::supported()
   return false;
 }
 
+struct ioring_sync_data {};
+
+ioring_sync_t::ioring_sync_t(unsigned buf_size_)
+{
+  ceph_assert(0);
+}
+
+ioring_sync_t::~ioring_sync_t()
+{
+  ceph_assert(0);
+}
+
+int ioring_sync_t::init(std::vector<int> &fds)
+{
+  ceph_assert(0);
+}
+
+void ioring_sync_t::shutdown()
+{
+  ceph_assert(0);
+}
+
+int ioring_sync_t::write(int fd, ceph::buffer::list &bl, uint64_t off)
+{
+  ceph_assert(0);
+}
+
 #endif // #if defined(HAVE_LIBURING)
@@ -31,3 +31,23 @@ struct ioring_queue_t final : public io_queue_t {
                    void *priv, int *retries) final;
   int get_next_completed(int timeout_ms, aio_t **paio, int max) final;
 };
+
+struct ioring_sync_data;
+
+/// A private ring for synchronous writes: the submitting thread reaps its
+/// own completion instead of waiting for the aio thread to wake it.  Small
+/// writes are copied into a registered buffer so the kernel doesn't have to
+/// pin user pages for every O_DIRECT request.
+struct ioring_sync_t {
+  std::unique_ptr<ioring_sync_data> d;
+  unsigned buf_size = 0;
+
+  explicit ioring_sync_t(unsigned buf_size_);
+  ~ioring_sync_t();
+
+  int init(std::vector<int> &fds);
+  void shutdown();
+
+  /// write all of bl at off; -EBUSY if another thread is using the ring
+  int write(int fd, ceph::buffer::list &bl, uint64_t off);
+};
@@ -7,6 +7,7 @@
 #include "include/buffer.h"
 #include "include/byteorder.h"
 #include "include/ceph_assert.h"
+#include "include/crc32c.h"
 
 #include "xxHash/xxhash.h"
 
@@ -90,6 +91,19 @@ public:
       ) {
       return p.crc32c(len, init_value);
     }
+
+    static void calc_many(
+      state_t state,
+      init_value_t init_value,
+      size_t len,
+      const char * const *data,
+      size_t n,
+      init_value_t *out
+      ) {
+      ceph_crc32c_multi(init_value,
+			reinterpret_cast<unsigned char const * const *>(data),
+			len, n, out);
+    }
   };
 
   struct crc32c_16 {
@@ -111,6 +125,22 @@ public:
       ) {
       return p.crc32c(len, init_value) & 0xffff;
     }
+
+    static void calc_many(
+      state_t state,
+      init_value_t init_value,
+      size_t len,
+      const char * const *data,
+      size_t n,
+      init_value_t *out
+      ) {
+      ceph_crc32c_multi(init_value,
+			reinterpret_cast<unsigned char const * const *>(data),
+			len, n, out);
+      for (size_t i = 0; i < n; ++i) {
+	out[i] = out[i] & 0xffff;
+      }
+    }
   };
 
   struct crc32c_8 {
@@ -132,6 +162,22 @@ public:
       ) {
       return p.crc32c(len, init_value) & 0xff;
     }
+
+    static void calc_many(
+      state_t state,
+      init_value_t init_value,
+      size_t len,
+      const char * const *data,
+      size_t n,
+      init_value_t *out
+      ) {
+      ceph_crc32c_multi(init_value,
+			reinterpret_cast<unsigned char const * const *>(data),
+			len, n, out);
+      for (size_t i = 0; i < n; ++i) {
+	out[i] = out[i] & 0xff;
+      }
+    }
   };
 
   struct xxhash32 {
@@ -161,6 +207,19 @@ public:
       }
       return XXH32_digest(state);
     }
+
+    static void calc_many(
+      state_t state,
+      init_value_t init_value,
+      size_t len,
+      const char * const *data,
+      size_t n,
+      init_value_t *out
+      ) {
+      for (size_t i = 0; i < n; ++i) {
+	out[i] = XXH32(data[i], len, init_value);
+      }
+    }
   };
 
   struct xxhash64 {
@@ -190,8 +249,88 @@ public:
       }
       return XXH64_digest(state);
     }
+
+    static void calc_many(
+      state_t state,
+      init_value_t init_value,
+      size_t len,
+      const char * const *data,
+      size_t n,
+      init_value_t *out
+      ) {
+      for (size_t i = 0; i < n; ++i) {
+	out[i] = XXH64(data[i], len, init_value);
+      }
+    }
   };
 
+  /// call f(i, csum) for each of the first `blocks` csum blocks of bl,
+  /// in order, until f returns false.  Blocks lying within a single buffer
+  /// segment are handed to Alg::calc_many in batches so that independent
+  /// checksums can be computed together; a block that straddles segments
+  /// is computed on its own.  Returns false if f stopped the walk.
+  template<class Alg, class F>
+  static bool for_each_block(
+    typename Alg::state_t state,
+    typename Alg::init_value_t init_value,
+    size_t csum_block_size,
+    size_t blocks,
+    const ceph::buffer::list &bl,
+    F&& f) {
+    static constexpr size_t max_batch = 16;
+    const char *batch[max_batch];
+    typename Alg::init_value_t values[max_batch];
+    size_t batch_start = 0;
+    size_t n = 0;
+    auto flush = [&]() {
+      if (n == 0) {
+	return true;
+      }
+      Alg::calc_many(state, init_value, csum_block_size, batch, n, values);
+      size_t count = n;
+      n = 0;
+      for (size_t k = 0; k < count; ++k) {
+	if (!f(batch_start + k, values[k])) {
+	  return false;
+	}
+      }
+      return true;
+    };
+
+    size_t i = 0;
+    size_t seg_start = 0;
+    for (auto& bp : bl.buffers()) {
+      if (i == blocks) {
+	break;
+      }
+      size_t seg_end = seg_start + bp.length();
+      while (i < blocks && (i + 1) * csum_block_size <= seg_end) {
+	size_t pos = i * csum_block_size;
+	if (pos < seg_start) {
+	  // block began in an earlier segment
+	  if (!flush()) {
+	    return false;
+	  }
+	  auto p = bl.begin(pos);
+	  if (!f(i, Alg::calc(state, init_value, csum_block_size, p))) {
+	    return false;
+	  }
+	} else {
+	  if (n == 0) {
+	    batch_start = i;
+	  }
+	  batch[n++] = bp.c_str() + (pos - seg_start);
+	  if (n == max_batch && !flush()) {
+	    return false;
+	  }
+	}
+	++i;
+      }
+      seg_start = seg_end;
+    }
+    return flush();
+  }
+
   template<class Alg>
   static int calculate(
     size_t csum_block_size,
@@ -213,7 +352,6 @@ public:
       ceph::buffer::ptr* csum_data) {
     ceph_assert(length % csum_block_size == 0);
     size_t blocks = length / csum_block_size;
-    ceph::buffer::list::const_iterator p = bl.begin();
     ceph_assert(bl.length() >= length);
 
     typename Alg::state_t state;
@@ -225,10 +363,12 @@ public:
     typename Alg::value_t *pv =
       reinterpret_cast<typename Alg::value_t*>(csum_data->c_str());
     pv += offset / csum_block_size;
-    while (blocks--) {
-      *pv = Alg::calc(state, init_value, csum_block_size, p);
-      ++pv;
-    }
+    for_each_block<Alg>(
+      state, init_value, csum_block_size, blocks, bl,
+      [pv](size_t i, typename Alg::init_value_t v) {
+	pv[i] = v;
+	return true;
+      });
     Alg::fini(&state);
     return 0;
   }
@@ -243,7 +383,6 @@ public:
     uint64_t *bad_csum=0
     ) {
     ceph_assert(length % csum_block_size == 0);
-    ceph::buffer::list::const_iterator p = bl.begin();
     ceph_assert(bl.length() >= length);
 
     typename Alg::state_t state;
@@ -252,22 +391,21 @@ public:
     const typename Alg::value_t *pv =
       reinterpret_cast<const typename Alg::value_t*>(csum_data.c_str());
     pv += offset / csum_block_size;
-    size_t pos = offset;
-    while (length > 0) {
-      typename Alg::init_value_t v = Alg::calc(state, -1, csum_block_size, p);
-      if (*pv != v) {
-	if (bad_csum) {
-	  *bad_csum = v;
+    int bad_pos = -1;
+    for_each_block<Alg>(
+      state, -1, csum_block_size, length / csum_block_size, bl,
+      [&](size_t i, typename Alg::init_value_t v) {
+	if (pv[i] != v) {
+	  if (bad_csum) {
+	    *bad_csum = v;
+	  }
+	  bad_pos = offset + i * csum_block_size;
+	  return false;
 	}
-	Alg::fini(&state);
-	return pos;
-      }
-      ++pv;
-      pos += csum_block_size;
-      length -= csum_block_size;
-    }
+	return true;
+      });
     Alg::fini(&state);
-    return -1;  // no errors
+    return bad_pos;  // -1 if no errors
   }
 };
 
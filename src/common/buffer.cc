@@ -81,6 +81,84 @@ static ceph::spinlock debug_lock;
     return buffer_missed_crc;
   }
 
+  /*
+   * Per-thread caches of the fixed size blocks bufferlists churn through
+   * the most: ptr_nodes and the default sized raw_combined append
+   * buffers.  A block freed by another thread than the one that allocated
+   * it simply goes to the freeing thread's cache.  Set CEPH_BUFFER_NO_POOL
+   * to rule the caches out when hunting memory errors.
+   */
+#ifdef __SANITIZE_ADDRESS__
+  static const bool buffer_pool_enabled = false;
+#else
+  static const bool buffer_pool_enabled = !get_env_bool("CEPH_BUFFER_NO_POOL");
+#endif
+
+  namespace {
+  template <typename Block, size_t Max>
+  class block_cache {
+    struct block_t {
+      block_t* next;
+    };
+    // trivially destructible, so it can still be checked after the
+    // reaper below ran at thread exit
+    struct state_t {
+      block_t* head = nullptr;
+      size_t count = 0;
+      enum { UNUSED, ACTIVE, DEAD } stage = UNUSED;
+    };
+    static thread_local state_t state;
+    struct reaper_t {
+      void (*free_fn)(void*);
+      ~reaper_t() {
+	while (state.head) {
+	  auto b = state.head;
+	  state.head = b->next;
+	  free_fn(b);
+	}
+	state.count = 0;
+	state.stage = state_t::DEAD;
+      }
+    };
+  public:
+    static void* get() {
+      auto b = state.head;
+      if (b) {
+	state.head = b->next;
+	--state.count;
+      }
+      return b;
+    }
+    /// true if p was cached, otherwise it is left to the caller to free
+    static bool put(void* p, void (*free_fn)(void*)) {
+      if (unlikely(state.stage != state_t::ACTIVE)) {
+	if (state.stage == state_t::DEAD || !buffer_pool_enabled) {
+	  return false;
+	}
+	static thread_local reaper_t reaper{free_fn};
+	(void)reaper;
+	state.stage = state_t::ACTIVE;
+      }
+      if (state.count >= Max) {
+	return false;
+      }
+      auto b = static_cast<block_t*>(p);
+      b->next = state.head;
+      state.head = b;
+      ++state.count;
+      return true;
+    }
+  };
+  template <typename Block, size_t Max>
+  thread_local typename block_cache<Block, Max>::state_t
+  block_cache<Block, Max>::state;
+
+  // ptr_nodes are small, keep enough for a few messages' worth of segments
+  using ptr_node_cache = block_cache<buffer::ptr_node, 256>;
+  // 4 KiB each
+  using raw_combined_cache = block_cache<buffer::raw_combined, 32>;
+  }
+
   /*
    * raw_combined is always placed within a single allocation along
    * with the data buffer.  the data goes at the beginning, and
@@ -109,14 +187,22 @@ static ceph::spinlock debug_lock;
 				  alignof(buffer::raw_combined));
       size_t datalen = round_up_to(len, alignof(buffer::raw_combined));
 
+      char *ptr = nullptr;
+      const bool poolable = is_poolable(rawlen + datalen, align);
+      if (poolable) {
+	ptr = static_cast<char*>(raw_combined_cache::get());
+	// whatever we allocate may end up in the cache
+	align = POOL_ALIGN;
+      }
+      if (!ptr) {
 #ifdef DARWIN
-      char *ptr = (char *) valloc(rawlen + datalen);
+	ptr = (char *) valloc(rawlen + datalen);
 #else
-      char *ptr = 0;
-      int r = ::posix_memalign((void**)(void*)&ptr, align, rawlen + datalen);
-      if (r)
-	throw bad_alloc();
+	int r = ::posix_memalign((void**)(void*)&ptr, align, rawlen + datalen);
+	if (r)
+	  throw bad_alloc();
 #endif /* DARWIN */
+      }
       if (!ptr)
 	throw bad_alloc();
 
@@ -128,7 +214,24 @@ static ceph::spinlock debug_lock;
 
     static void operator delete(void *ptr) {
       raw_combined *raw = (raw_combined *)ptr;
-      aligned_free((void *)raw->data);
+      size_t total = (char *)raw - raw->data +
+	round_up_to(sizeof(buffer::raw_combined), alignof(buffer::raw_combined));
+      if (!is_poolable(total, raw->alignment) ||
+	  !raw_combined_cache::put(raw->data,
+				   [](void* b) { aligned_free(b); })) {
+	aligned_free((void *)raw->data);
+      }
+    }
+
+  private:
+    // the default append buffer, see CEPH_BUFFER_APPEND_SIZE
+    static constexpr unsigned POOL_ALIGN = 64;
+    static bool is_poolable(size_t total, unsigned align) {
+#ifdef DARWIN
+      return false;
+#else
+      return total == CEPH_BUFFER_ALLOC_UNIT && align <= POOL_ALIGN;
+#endif
     }
   };
 
@@ -2270,6 +2373,24 @@ buffer::ptr_node* buffer::ptr_node::cloner::operator()(
   return new ptr_node(clone_this);
 }
 
+void* buffer::ptr_node::operator new(size_t size)
+{
+  void* p = nullptr;
+  if (likely(size == sizeof(ptr_node))) {
+    p = ptr_node_cache::get();
+  }
+  return p ? p : ::operator new(size);
+}
+
+void buffer::ptr_node::operator delete(void* p)
+{
+  // the blocks all come from the global operator new, so a node created
+  // by code built against an older buffer.h can go to the cache as well
+  if (!ptr_node_cache::put(p, [](void* b) { ::operator delete(b); })) {
+    ::operator delete(p);
+  }
+}
+
 std::ostream& buffer::operator<<(std::ostream& out, const buffer::raw &r) {
   return out << "buffer::raw("
              << (void*)r.get_data() << " len " << r.get_len()
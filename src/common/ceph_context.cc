@@ -546,6 +546,14 @@ int CephContext::_do_command(
   else if (command == "perf histogram schema") {
     _perf_counters_collection->dump_formatted_histograms(f, true);
   }
+  else if (command == "perf latency histogram dump") {
+    std::string logger;
+    std::string counter;
+    cmd_getval(cmdmap, "logger", logger);
+    cmd_getval(cmdmap, "counter", counter);
+    _perf_counters_collection->dump_formatted_latency_histograms(f, logger,
+                                                                 counter);
+  }
   else if (command == "perf reset") {
     std::string var;
     std::string section(command);
@@ -733,6 +741,7 @@ CephContext::CephContext(uint32_t module_type_,
   _admin_socket->register_command("2", _admin_hook, "");
   _admin_socket->register_command("perf schema", _admin_hook, "dump perfcounters schema");
   _admin_socket->register_command("perf histogram schema", _admin_hook, "dump perf histogram schema");
+  _admin_socket->register_command("perf latency histogram dump name=logger,type=CephString,req=false name=counter,type=CephString,req=false", _admin_hook, "dump latency distributions of time averages");
   _admin_socket->register_command("perf reset name=var,type=CephString", _admin_hook, "perf reset <name>: perf reset all or one perfcounter name");
   _admin_socket->register_command("config show", _admin_hook, "dump current config settings");
   _admin_socket->register_command("config help name=var,type=CephString,req=false", _admin_hook, "get config setting schema and descriptions");
@@ -0,0 +1,83 @@
+#include "acconfig.h"
+#include "common/crc32c_intel_multi.h"
+
+#ifdef __x86_64__
+
+#include <string.h>
+#include <nmmintrin.h>
+
+/*
+ * crc32c of several independent buffers of the same length using the
+ * SSE 4.2 crc32 instruction. The instruction has a latency of 3 cycles
+ * but can be issued every cycle, so processing three buffers at once
+ * keeps the unit busy instead of waiting on the previous result, without
+ * the need to combine partial crcs as the single buffer version does.
+ */
+
+__attribute__((target("sse4.2")))
+static inline uint32_t crc32c_tail(uint32_t crc, unsigned char const *p,
+				   unsigned len)
+{
+	while (len--)
+		crc = _mm_crc32_u8(crc, *p++);
+	return crc;
+}
+
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_one(uint32_t crc, unsigned char const *p, unsigned len)
+{
+	uint64_t c = crc;
+	uint64_t v;
+
+	for (; len >= 8; len -= 8, p += 8) {
+		memcpy(&v, p, 8);
+		c = _mm_crc32_u64(c, v);
+	}
+	return crc32c_tail((uint32_t)c, p, len);
+}
+
+__attribute__((target("sse4.2")))
+void ceph_crc32c_intel_multi(uint32_t crc,
+			     unsigned char const * const *buffers,
+			     unsigned len, unsigned count,
+			     uint32_t *out)
+{
+	unsigned i = 0;
+
+	for (; i + 3 <= count; i += 3) {
+		unsigned char const *p0 = buffers[i];
+		unsigned char const *p1 = buffers[i + 1];
+		unsigned char const *p2 = buffers[i + 2];
+		uint64_t c0 = crc, c1 = crc, c2 = crc;
+		uint64_t v0, v1, v2;
+		unsigned left = len;
+
+		for (; left >= 8; left -= 8, p0 += 8, p1 += 8, p2 += 8) {
+			memcpy(&v0, p0, 8);
+			memcpy(&v1, p1, 8);
+			memcpy(&v2, p2, 8);
+			c0 = _mm_crc32_u64(c0, v0);
+			c1 = _mm_crc32_u64(c1, v1);
+			c2 = _mm_crc32_u64(c2, v2);
+		}
+		out[i] = crc32c_tail((uint32_t)c0, p0, left);
+		out[i + 1] = crc32c_tail((uint32_t)c1, p1, left);
+		out[i + 2] = crc32c_tail((uint32_t)c2, p2, left);
+	}
+	for (; i < count; ++i)
+		out[i] = crc32c_one(crc, buffers[i], len);
+}
+
+int ceph_crc32c_intel_multi_exists(void)
+{
+	return 1;
+}
+
+#else
+
+int ceph_crc32c_intel_multi_exists(void)
+{
+	return 0;
+}
+
+#endif
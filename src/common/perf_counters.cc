@@ -13,6 +13,8 @@
  *
  */
 
+#include <thread>
+
 #include "common/perf_counters.h"
 #include "common/dout.h"
 #include "common/valgrind.h"
@@ -144,6 +146,30 @@ void PerfCountersCollectionImpl::dump_formatted_generic(
   f->close_section();
 }
 
+/**
+ * Serialize the latency distributions of the time averages that have
+ * one.  These are kept apart from the histogram dump, whose consumers
+ * expect every entry to be a 2D histogram.
+ *
+ * @param logger name of subsystem logger, may be empty
+ * @param counter name of counter within subsystem, may be empty
+ */
+void PerfCountersCollectionImpl::dump_formatted_latency_histograms(
+    Formatter *f,
+    const std::string &logger,
+    const std::string &counter) const
+{
+  f->open_object_section("perfcounter_collection");
+
+  for (perf_counters_set_t::iterator l = m_loggers.begin();
+       l != m_loggers.end(); ++l) {
+    if (logger.empty() || (*l)->get_name() == logger) {
+      (*l)->dump_formatted_latency_histograms(f, counter);
+    }
+  }
+  f->close_section();
+}
+
 void PerfCountersCollectionImpl::with_counters(std::function<void(
       const PerfCountersCollectionImpl::CounterMap &)> fn) const
 {
@@ -152,6 +178,37 @@ void PerfCountersCollectionImpl::with_counters(std::function<void(
 
 // ---------------------------
 
+// keep the slots of different shards on different cache lines
+static constexpr size_t PERF_SHARD_ALIGN = 128;
+static constexpr unsigned PERF_MAX_SHARDS = 64;
+
+unsigned PerfCounters::num_shards()
+{
+  static const unsigned n = [] {
+    unsigned cpus = std::max(1u, std::thread::hardware_concurrency());
+    unsigned n = 1;
+    while (n < cpus && n < PERF_MAX_SHARDS) {
+      n <<= 1;
+    }
+    return n;
+  }();
+  return n;
+}
+
+unsigned PerfCounters::shard_index()
+{
+  // hand out shards round robin, so that as long as there are no more
+  // threads than shards, no two of them share one
+  static std::atomic<unsigned> next_thread = { 0 };
+  static thread_local unsigned me = next_thread++;
+  return me & (num_shards() - 1);
+}
+
+void PerfCounters::shards_deleter::operator()(perf_counter_shard_d *p) const
+{
+  ::operator delete(p, std::align_val_t(PERF_SHARD_ALIGN));
+}
+
 PerfCounters::~PerfCounters()
 {
 }
@@ -168,7 +225,14 @@ void PerfCounters::inc(int idx, uint64_t amt)
   perf_counter_data_any_d& data(m_data[idx - m_lower_bound - 1]);
   if (!(data.type & PERFCOUNTER_U64))
     return;
-  if (data.type & PERFCOUNTER_LONGRUNAVG) {
+  if (data.shards) {
+    auto& shard = data.my_shard();
+    if (data.type & PERFCOUNTER_LONGRUNAVG) {
+      shard.add_avg(amt);
+    } else {
+      shard.add(amt);
+    }
+  } else if (data.type & PERFCOUNTER_LONGRUNAVG) {
     data.avgcount++;
     data.u64 += amt;
     data.avgcount2++;
@@ -190,7 +254,11 @@ void PerfCounters::dec(int idx, uint64_t amt)
   ceph_assert(!(data.type & PERFCOUNTER_LONGRUNAVG));
   if (!(data.type & PERFCOUNTER_U64))
     return;
-  data.u64 -= amt;
+  if (data.shards) {
+    data.my_shard().u64 -= amt;
+  } else {
+    data.u64 -= amt;
+  }
 }
 
 void PerfCounters::set(int idx, uint64_t amt)
@@ -208,6 +276,11 @@ void PerfCounters::set(int idx, uint64_t amt)
 
   ANNOTATE_BENIGN_RACE_SIZED(&data.u64, sizeof(data.u64),
                              "perf counter atomic");
+  if (data.shards) {
+    // the slots are added on top of u64 when reading, offset them (this
+    // may lose updates racing with us)
+    amt -= data.read_u64() - data.u64;
+  }
   if (data.type & PERFCOUNTER_LONGRUNAVG) {
     data.avgcount++;
     data.u64 = amt;
@@ -229,7 +302,7 @@ uint64_t PerfCounters::get(int idx) const
   const perf_counter_data_any_d& data(m_data[idx - m_lower_bound - 1]);
   if (!(data.type & PERFCOUNTER_U64))
     return 0;
-  return data.u64;
+  return data.read_u64();
 }
 
 void PerfCounters::tinc(int idx, utime_t amt)
@@ -244,13 +317,23 @@ void PerfCounters::tinc(int idx, utime_t amt)
   perf_counter_data_any_d& data(m_data[idx - m_lower_bound - 1]);
   if (!(data.type & PERFCOUNTER_TIME))
     return;
-  if (data.type & PERFCOUNTER_LONGRUNAVG) {
+  if (data.shards) {
+    auto& shard = data.my_shard();
+    if (data.type & PERFCOUNTER_LONGRUNAVG) {
+      shard.add_avg(amt.to_nsec());
+    } else {
+      shard.add(amt.to_nsec());
+    }
+  } else if (data.type & PERFCOUNTER_LONGRUNAVG) {
     data.avgcount++;
     data.u64 += amt.to_nsec();
     data.avgcount2++;
   } else {
     data.u64 += amt.to_nsec();
   }
+  if (data.hdr) {
+    data.hdr->inc(shard_index(), amt.to_nsec());
+  }
 }
 
 void PerfCounters::tinc(int idx, ceph::timespan amt)
@@ -265,13 +348,23 @@ void PerfCounters::tinc(int idx, ceph::timespan amt)
   perf_counter_data_any_d& data(m_data[idx - m_lower_bound - 1]);
   if (!(data.type & PERFCOUNTER_TIME))
     return;
-  if (data.type & PERFCOUNTER_LONGRUNAVG) {
+  if (data.shards) {
+    auto& shard = data.my_shard();
+    if (data.type & PERFCOUNTER_LONGRUNAVG) {
+      shard.add_avg(amt.count());
+    } else {
+      shard.add(amt.count());
+    }
+  } else if (data.type & PERFCOUNTER_LONGRUNAVG) {
     data.avgcount++;
     data.u64 += amt.count();
     data.avgcount2++;
   } else {
     data.u64 += amt.count();
   }
+  if (data.hdr) {
+    data.hdr->inc(shard_index(), amt.count());
+  }
 }
 
 void PerfCounters::tset(int idx, utime_t amt)
@@ -303,7 +396,7 @@ utime_t PerfCounters::tget(int idx) const
   const perf_counter_data_any_d& data(m_data[idx - m_lower_bound - 1]);
   if (!(data.type & PERFCOUNTER_TIME))
     return utime_t();
-  uint64_t v = data.u64;
+  uint64_t v = data.read_u64();
   return utime_t(v / 1000000000ull, v % 1000000000ull);
 }
 
@@ -353,6 +446,21 @@ void PerfCounters::reset()
   }
 }
 
+void PerfCounters::dump_formatted_latency_histograms(
+    Formatter *f, const std::string &counter) const
+{
+  f->open_object_section(m_name.c_str());
+  for (const auto& d : m_data) {
+    if (!d.hdr || (!counter.empty() && counter != d.name)) {
+      continue;
+    }
+    f->open_object_section(d.name);
+    d.hdr->dump_formatted(f);
+    f->close_section();
+  }
+  f->close_section();
+}
+
 void PerfCounters::dump_formatted_generic(Formatter *f, bool schema,
     bool histograms, const std::string &counter) const
 {
@@ -451,7 +559,7 @@ void PerfCounters::dump_formatted_generic(Formatter *f, bool schema,
         d->histogram->dump_formatted(f);
         f->close_section();
       } else {
-	uint64_t v = d->u64;
+	uint64_t v = d->read_u64();
 	if (d->type & PERFCOUNTER_U64) {
 	  f->dump_unsigned(d->name, v);
 	} else if (d->type & PERFCOUNTER_TIME) {
@@ -536,6 +644,12 @@ void PerfCountersBuilder::add_time_avg(
 {
   add_impl(idx, name, description, nick, prio,
 	   PERFCOUNTER_TIME | PERFCOUNTER_LONGRUNAVG);
+  if (latency_histogram_bits) {
+    m_perf_counters->m_data[idx - m_perf_counters->m_lower_bound - 1].hdr =
+      std::make_unique<PerfLatencyHistogram>(latency_histogram_bits,
+					     PerfCounters::num_shards(),
+					     latency_histogram_window);
+  }
 }
 
 void PerfCountersBuilder::add_u64_counter_histogram(
@@ -582,6 +696,76 @@ PerfCounters *PerfCountersBuilder::create_perf_counters()
     ceph_assert(d->type & (PERFCOUNTER_U64 | PERFCOUNTER_TIME));
   }
 
+  // the percentile gauges go after the indexed counters.  Reserve first:
+  // growing m_data copies its elements, histograms included
+  auto& vec = m_perf_counters->m_data;
+  const size_t indexed = vec.size();
+  size_t with_hdr = 0;
+  for (auto& d : vec) {
+    if (d.hdr) {
+      ++with_hdr;
+    }
+  }
+  static const std::pair<const char*, double> percentiles[] = {
+    {"p50", 0.5}, {"p99", 0.99}, {"p999", 0.999}
+  };
+  vec.reserve(indexed + with_hdr * std::size(percentiles));
+  for (size_t i = 0; i < indexed; ++i) {
+    if (!vec[i].hdr) {
+      continue;
+    }
+    for (auto& [suffix, q] : percentiles) {
+      auto& strings = m_perf_counters->m_derived_strings;
+      PerfCounters::perf_counter_data_any_d& p = vec.emplace_back();
+      const PerfCounters::perf_counter_data_any_d& src = vec[i];
+      p.name = strings.emplace_back(
+	std::string(src.name) + "_" + suffix).c_str();
+      p.description = strings.emplace_back(
+	std::string(suffix) + " of " +
+	(src.description ? src.description : src.name)).c_str();
+      p.prio = src.prio;
+      p.type = PERFCOUNTER_TIME;
+      p.unit = src.unit;
+      p.quantile_of = src.hdr.get();
+      p.quantile = q;
+    }
+  }
+
+  if (sharded) {
+    // one slot per counter and average in each shard, so that a thread
+    // only ever touches the cache lines of its own shard
+    auto shardable = [](const PerfCounters::perf_counter_data_any_d& d) {
+      return (d.type & (PERFCOUNTER_COUNTER | PERFCOUNTER_LONGRUNAVG)) &&
+	!(d.type & PERFCOUNTER_HISTOGRAM);
+    };
+    size_t nslots = 0;
+    for (auto& d : m_perf_counters->m_data) {
+      if (shardable(d)) {
+	++nslots;
+      }
+    }
+    constexpr size_t slot_size = sizeof(PerfCounters::perf_counter_shard_d);
+    while ((nslots * slot_size) % PERF_SHARD_ALIGN) {
+      ++nslots;
+    }
+    const size_t total = nslots * PerfCounters::num_shards();
+    if (total) {
+      auto p = static_cast<PerfCounters::perf_counter_shard_d*>(
+	::operator new(total * slot_size, std::align_val_t(PERF_SHARD_ALIGN)));
+      for (size_t i = 0; i < total; ++i) {
+	new (p + i) PerfCounters::perf_counter_shard_d;
+      }
+      m_perf_counters->m_shards.reset(p);
+      size_t slot = 0;
+      for (auto& d : m_perf_counters->m_data) {
+	if (shardable(d)) {
+	  d.shards = p + slot++;
+	  d.shard_stride = nslots;
+	}
+      }
+    }
+  }
+
   PerfCounters *ret = m_perf_counters;
   m_perf_counters = NULL;
   return ret;
@@ -17,6 +17,7 @@
 #ifndef CEPH_COMMON_PERF_COUNTERS_H
 #define CEPH_COMMON_PERF_COUNTERS_H
 
+#include <list>
 #include <string>
 #include <vector>
 #include <memory>
@@ -113,6 +114,22 @@ public:
     prio_default = prio_;
   }
 
+  /// time averages added from now on also keep a PerfLatencyHistogram of
+  /// the given precision (0 to stop), and get p50/p99/p999 gauges over
+  /// the given window
+  void set_latency_histogram(unsigned precision_bits,
+			     ceph::timespan window = std::chrono::minutes(1))
+  {
+    latency_histogram_bits = precision_bits;
+    latency_histogram_window = window;
+  }
+
+  /// spread updates of counters and averages over per-thread slots
+  void set_sharded(bool sharded_ = true)
+  {
+    sharded = sharded_;
+  }
+
   PerfCounters* create_perf_counters();
 private:
   PerfCountersBuilder(const PerfCountersBuilder &rhs);
@@ -124,6 +141,9 @@ private:
   PerfCounters *m_perf_counters;
 
   int prio_default = 0;
+  unsigned latency_histogram_bits = 0;
+  ceph::timespan latency_histogram_window;
+  bool sharded = false;
 };
 
 /*
@@ -150,10 +170,45 @@ private:
  * For the time average, it returns the current value and
  * the "avgcount" member when read off. avgcount is incremented when you call
  * tinc. Calling tset on an average is an error and will assert out.
+ *
+ * Time averages can also track their distribution in a PerfLatencyHistogram
+ * (see PerfCountersBuilder::set_latency_histogram).  The percentiles of
+ * its recent window are published as extra time gauges named
+ * <counter>_p50, _p99 and _p999, which are not addressable by index, and
+ * the whole distribution shows up in dump_formatted_latency_histograms().
+ *
+ * Counters and averages updated from many threads at once can be sharded
+ * (see PerfCountersBuilder::set_sharded).  Each thread then updates its own
+ * slot, the slots of one shard share cache lines with each other only, and
+ * reads add the slots up.  Gauges and histograms are never sharded.
  */
 class PerfCounters
 {
 public:
+  /** A per-thread slot of a sharded perf_counter_data_any_d. */
+  struct perf_counter_shard_d {
+    std::atomic<uint64_t> u64 = { 0 };
+    std::atomic<uint64_t> avgcount = { 0 };
+    std::atomic<uint64_t> avgcount2 = { 0 };
+
+    void add(uint64_t v) {
+      u64 += v;
+    }
+    void add_avg(uint64_t v) {
+      avgcount++;
+      u64 += v;
+      avgcount2++;
+    }
+    std::pair<uint64_t,uint64_t> read_avg() const {
+      uint64_t sum, count;
+      do {
+	count = avgcount2;
+	sum = u64;
+      } while (avgcount != count);
+      return { sum, count };
+    }
+  };
+
   /** Represents a PerfCounters data element. */
   struct perf_counter_data_any_d {
     perf_counter_data_any_d()
@@ -169,7 +224,7 @@ public:
         nick(other.nick),
 	 type(other.type),
 	 unit(other.unit),
-	 u64(other.u64.load()) {
+	 u64(other.read_u64()) {
       auto a = other.read_avg();
       u64 = a.first;
       avgcount = a.second;
@@ -177,6 +232,9 @@ public:
       if (other.histogram) {
         histogram.reset(new PerfHistogram<>(*other.histogram));
       }
+      if (other.hdr) {
+        hdr.reset(new PerfLatencyHistogram(*other.hdr));
+      }
     }
 
     const char *name;
@@ -189,6 +247,17 @@ public:
     std::atomic<uint64_t> avgcount = { 0 };
     std::atomic<uint64_t> avgcount2 = { 0 };
     std::unique_ptr<PerfHistogram<>> histogram;
+    // distribution of a time average
+    std::unique_ptr<PerfLatencyHistogram> hdr;
+    // for a percentile gauge, the histogram and quantile it reads
+    PerfLatencyHistogram *quantile_of = nullptr;
+    double quantile = 0;
+
+    // if sharded, this counter's slot in the first shard; the slot of
+    // shard i is shards[i * shard_stride].  u64 and avgcount then only
+    // hold what set() put there, the slots are added on top.
+    perf_counter_shard_d *shards = nullptr;
+    uint32_t shard_stride = 0;
 
     void reset()
     {
@@ -196,25 +265,61 @@ public:
 	    u64 = 0;
 	    avgcount = 0;
 	    avgcount2 = 0;
+	    for (unsigned i = 0; shards && i < num_shards(); ++i) {
+	      auto& s = shards[i * shard_stride];
+	      s.u64 = 0;
+	      s.avgcount = 0;
+	      s.avgcount2 = 0;
+	    }
       }
       if (histogram) {
         histogram->reset();
       }
+      if (hdr) {
+        hdr->reset();
+      }
+    }
+
+    /// the slot the calling thread updates
+    perf_counter_shard_d& my_shard() {
+      return shards[shard_index() * shard_stride];
+    }
+
+    uint64_t read_u64() const {
+      if (quantile_of) {
+	return quantile_of->get_window_quantile(quantile);
+      }
+      uint64_t v = u64;
+      for (unsigned i = 0; shards && i < num_shards(); ++i) {
+	v += shards[i * shard_stride].u64;
+      }
+      return v;
     }
 
     // read <sum, count> safely by making sure the post- and pre-count
     // are identical; in other words the whole loop needs to be run
-    // without any intervening calls to inc, set, or tinc.
+    // without any intervening calls to inc, set, or tinc.  With sharding
+    // this holds per slot, the sum over the slots is not a snapshot.
     std::pair<uint64_t,uint64_t> read_avg() const {
       uint64_t sum, count;
       do {
 	count = avgcount2;
 	sum = u64;
       } while (avgcount != count);
+      for (unsigned i = 0; shards && i < num_shards(); ++i) {
+	auto a = shards[i * shard_stride].read_avg();
+	sum += a.first;
+	count += a.second;
+      }
       return { sum, count };
     }
   };
 
+  /// number of slots of a sharded counter, a power of two
+  static unsigned num_shards();
+  /// the shard the calling thread updates, < num_shards()
+  static unsigned shard_index();
+
   template <typename T>
   struct avg_tracker {
     std::pair<uint64_t, T> last;
@@ -254,6 +359,8 @@ public:
                                  const std::string &counter = "") const {
     dump_formatted_generic(f, schema, true, counter);
   }
+  void dump_formatted_latency_histograms(ceph::Formatter *f,
+                                         const std::string &counter = "") const;
   std::pair<uint64_t, uint64_t> get_tavg_ns(int idx) const;
 
   const std::string& get_name() const;
@@ -297,6 +404,15 @@ private:
 
   perf_counter_data_vec_t m_data;
 
+  /// slots of the sharded counters, see PerfCountersBuilder::set_sharded
+  struct shards_deleter {
+    void operator()(perf_counter_shard_d *p) const;
+  };
+  std::unique_ptr<perf_counter_shard_d[], shards_deleter> m_shards;
+
+  /// names and descriptions of the percentile gauges
+  std::list<std::string> m_derived_strings;
+
   friend class PerfCountersBuilder;
   friend class PerfCountersCollectionImpl;
 };
@@ -335,6 +451,10 @@ public:
     dump_formatted_generic(f, schema, true, logger, counter);
   }
 
+  void dump_formatted_latency_histograms(ceph::Formatter *f,
+                                         const std::string &logger = "",
+                                         const std::string &counter = "") const;
+
   // A reference to a perf_counter_data_any_d, with an accompanying
   // pointer to the enclosing PerfCounters, in order that the consumer
   // can see the prio_adjust
@@ -47,6 +47,13 @@ void PerfCountersCollection::dump_formatted_histograms(ceph::Formatter *f, bool
   std::lock_guard lck(m_lock);
   perf_impl.dump_formatted_histograms(f,schema,logger,counter);
 }
+void PerfCountersCollection::dump_formatted_latency_histograms(ceph::Formatter *f,
+                                 const std::string &logger,
+                                 const std::string &counter)
+{
+  std::lock_guard lck(m_lock);
+  perf_impl.dump_formatted_latency_histograms(f,logger,counter);
+}
 void PerfCountersCollection::with_counters(std::function<void(const PerfCountersCollectionImpl::CounterMap &)> fn) const
 {
   std::lock_guard lck(m_lock);
@@ -26,6 +26,9 @@ public:
   void dump_formatted_histograms(ceph::Formatter *f, bool schema,
                                  const std::string &logger = "",
                                  const std::string &counter = "");
+  void dump_formatted_latency_histograms(ceph::Formatter *f,
+                                         const std::string &logger = "",
+                                         const std::string &counter = "");
 
   void with_counters(std::function<void(const PerfCountersCollectionImpl::CounterMap &)>) const;
 
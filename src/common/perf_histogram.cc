@@ -14,8 +14,11 @@
 
 #include "common/perf_histogram.h"
 
+#include <cmath>
 #include <limits>
 
+#include "include/encoding.h"
+
 void PerfHistogramCommon::dump_formatted_axis(
     ceph::Formatter *f, const PerfHistogramCommon::axis_config_d &ac) {
   f->open_object_section("axis");
@@ -119,3 +122,250 @@ PerfHistogramCommon::get_axis_bucket_ranges(
   ret.back().second = std::numeric_limits<int64_t>::max();
   return ret;
 }
+
+PerfHdrHistogram::PerfHdrHistogram(unsigned precision_bits,
+				   unsigned max_value_bits)
+  : m_precision_bits(precision_bits),
+    m_max_value_bits(max_value_bits)
+{
+  ceph_assertf(precision_bits <= MAX_PRECISION_BITS, "precision too high");
+  ceph_assertf(max_value_bits > precision_bits + 1 && max_value_bits <= 64,
+	       "invalid maximum value");
+  m_buckets = bucket_count(precision_bits, max_value_bits);
+  m_counts.reset(new std::atomic<uint64_t>[m_buckets] {});
+}
+
+PerfHdrHistogram::PerfHdrHistogram(const PerfHdrHistogram &other)
+  : m_precision_bits(other.m_precision_bits),
+    m_max_value_bits(other.m_max_value_bits),
+    m_buckets(other.m_buckets),
+    m_counts(new std::atomic<uint64_t>[other.m_buckets] {})
+{
+  for (size_t i = 0; i < m_buckets; ++i) {
+    m_counts[i] = other.m_counts[i].load();
+  }
+}
+
+size_t PerfHdrHistogram::bucket_count(unsigned precision_bits,
+				      unsigned max_value_bits)
+{
+  // the linear buckets below 2^(p+1), then 2^p for each further power of two
+  return size_t(max_value_bits - precision_bits + 1) << precision_bits;
+}
+
+size_t PerfHdrHistogram::get_bucket(uint64_t value) const
+{
+  if (m_max_value_bits < 64) {
+    value = std::min(value, (uint64_t(1) << m_max_value_bits) - 1);
+  }
+  if (value < (uint64_t(2) << m_precision_bits)) {
+    return value;
+  }
+  const unsigned msb = 63 - __builtin_clzll(value);
+  const unsigned shift = msb - m_precision_bits;
+  return (size_t(shift) << m_precision_bits) + (value >> shift);
+}
+
+std::pair<uint64_t, uint64_t> PerfHdrHistogram::get_bucket_range(
+  size_t bucket) const
+{
+  if (bucket < (size_t(2) << m_precision_bits)) {
+    return {bucket, bucket};
+  }
+  const unsigned shift = (bucket >> m_precision_bits) - 1;
+  const uint64_t mantissa = bucket - (size_t(shift) << m_precision_bits);
+  const uint64_t min = mantissa << shift;
+  return {min, min + (uint64_t(1) << shift) - 1};
+}
+
+void PerfHdrHistogram::reset()
+{
+  for (size_t i = 0; i < m_buckets; ++i) {
+    m_counts[i] = 0;
+  }
+}
+
+void PerfHdrHistogram::merge(const PerfHdrHistogram &other)
+{
+  ceph_assertf(other.m_precision_bits == m_precision_bits &&
+	       other.m_max_value_bits == m_max_value_bits,
+	       "can only merge histograms with the same configuration");
+  for (size_t i = 0; i < m_buckets; ++i) {
+    m_counts[i] += other.m_counts[i].load();
+  }
+}
+
+void PerfHdrHistogram::subtract(const PerfHdrHistogram &other)
+{
+  ceph_assertf(other.m_precision_bits == m_precision_bits &&
+	       other.m_max_value_bits == m_max_value_bits,
+	       "can only subtract histograms with the same configuration");
+  for (size_t i = 0; i < m_buckets; ++i) {
+    // other may predate a reset
+    uint64_t count = m_counts[i], sub = other.m_counts[i];
+    m_counts[i] = count > sub ? count - sub : 0;
+  }
+}
+
+uint64_t PerfHdrHistogram::get_total() const
+{
+  uint64_t total = 0;
+  for (size_t i = 0; i < m_buckets; ++i) {
+    total += m_counts[i];
+  }
+  return total;
+}
+
+uint64_t PerfHdrHistogram::get_quantile(double q) const
+{
+  // the counts may move while we look at them, take a copy
+  std::vector<uint64_t> counts(m_buckets);
+  uint64_t total = 0;
+  for (size_t i = 0; i < m_buckets; ++i) {
+    counts[i] = m_counts[i];
+    total += counts[i];
+  }
+  if (total == 0) {
+    return 0;
+  }
+  q = std::clamp(q, 0.0, 1.0);
+  const uint64_t rank = std::max<uint64_t>(1, std::ceil(q * total));
+  uint64_t seen = 0;
+  for (size_t i = 0; i < m_buckets; ++i) {
+    seen += counts[i];
+    if (seen >= rank) {
+      auto [min, max] = get_bucket_range(i);
+      return min + (max - min) / 2;
+    }
+  }
+  ceph_abort();
+}
+
+void PerfHdrHistogram::dump_formatted(ceph::Formatter *f) const
+{
+  f->dump_unsigned("precision_bits", m_precision_bits);
+  f->dump_unsigned("max_value_bits", m_max_value_bits);
+  f->dump_unsigned("count", get_total());
+  f->dump_unsigned("p50", get_quantile(0.5));
+  f->dump_unsigned("p99", get_quantile(0.99));
+  f->dump_unsigned("p999", get_quantile(0.999));
+  // only the buckets in use, so that this stays readable
+  f->open_array_section("buckets");
+  for (size_t i = 0; i < m_buckets; ++i) {
+    uint64_t count = m_counts[i];
+    if (!count) {
+      continue;
+    }
+    auto [min, max] = get_bucket_range(i);
+    f->open_object_section("bucket");
+    f->dump_unsigned("min", min);
+    f->dump_unsigned("max", max);
+    f->dump_unsigned("count", count);
+    f->close_section();
+  }
+  f->close_section();
+}
+
+void PerfHdrHistogram::encode(ceph::buffer::list &bl) const
+{
+  ENCODE_START(1, 1, bl);
+  encode(m_precision_bits, bl);
+  encode(m_max_value_bits, bl);
+  // sparse: <bucket, count> pairs of the buckets in use
+  std::vector<std::pair<uint32_t, uint64_t>> used;
+  for (size_t i = 0; i < m_buckets; ++i) {
+    if (uint64_t count = m_counts[i]; count) {
+      used.emplace_back(i, count);
+    }
+  }
+  encode(used, bl);
+  ENCODE_FINISH(bl);
+}
+
+void PerfHdrHistogram::decode(ceph::buffer::list::const_iterator &p)
+{
+  DECODE_START(1, p);
+  unsigned precision_bits, max_value_bits;
+  decode(precision_bits, p);
+  decode(max_value_bits, p);
+  if (precision_bits > MAX_PRECISION_BITS ||
+      max_value_bits <= precision_bits + 1 || max_value_bits > 64) {
+    throw ceph::buffer::malformed_input("invalid PerfHdrHistogram config");
+  }
+  std::vector<std::pair<uint32_t, uint64_t>> used;
+  decode(used, p);
+  m_precision_bits = precision_bits;
+  m_max_value_bits = max_value_bits;
+  m_buckets = bucket_count(precision_bits, max_value_bits);
+  m_counts.reset(new std::atomic<uint64_t>[m_buckets] {});
+  for (auto& [bucket, count] : used) {
+    if (bucket >= m_buckets) {
+      throw ceph::buffer::malformed_input("PerfHdrHistogram bucket out of range");
+    }
+    m_counts[bucket] = count;
+  }
+  DECODE_FINISH(p);
+}
+
+PerfLatencyHistogram::PerfLatencyHistogram(unsigned precision_bits,
+					   unsigned shards,
+					   ceph::timespan window)
+  : m_window(window),
+    m_prev_start(precision_bits),
+    m_cur_start(precision_bits),
+    m_cur_started(ceph::coarse_mono_clock::now())
+{
+  unsigned n = 1;
+  while (n < shards && n < MAX_SHARDS) {
+    n <<= 1;
+  }
+  m_shards.reserve(n);
+  for (unsigned i = 0; i < n; ++i) {
+    m_shards.emplace_back(precision_bits);
+  }
+}
+
+PerfLatencyHistogram::PerfLatencyHistogram(const PerfLatencyHistogram &other)
+  : m_shards(other.m_shards),
+    m_window(other.m_window),
+    m_prev_start(other.m_prev_start),
+    m_cur_start(other.m_cur_start),
+    m_cur_started(other.m_cur_started)
+{
+}
+
+void PerfLatencyHistogram::reset()
+{
+  for (auto& h : m_shards) {
+    h.reset();
+  }
+  std::lock_guard l(m_lock);
+  m_prev_start.reset();
+  m_cur_start.reset();
+  m_cur_started = ceph::coarse_mono_clock::now();
+}
+
+PerfHdrHistogram PerfLatencyHistogram::get_merged() const
+{
+  PerfHdrHistogram merged(m_shards.front());
+  for (size_t i = 1; i < m_shards.size(); ++i) {
+    merged.merge(m_shards[i]);
+  }
+  return merged;
+}
+
+uint64_t PerfLatencyHistogram::get_window_quantile(double q)
+{
+  PerfHdrHistogram window = get_merged();
+  std::lock_guard l(m_lock);
+  auto now = ceph::coarse_mono_clock::now();
+  if (now - m_cur_started >= m_window) {
+    m_prev_start.reset();
+    m_prev_start.merge(m_cur_start);
+    m_cur_start.reset();
+    m_cur_start.merge(window);
+    m_cur_started = now;
+  }
+  window.subtract(m_prev_start);
+  return window.get_quantile(q);
+}
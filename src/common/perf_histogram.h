@@ -18,8 +18,12 @@
 #include <array>
 #include <atomic>
 #include <memory>
+#include <mutex>
+#include <vector>
 
+#include "common/ceph_time.h"
 #include "common/Formatter.h"
+#include "include/buffer.h"
 #include "include/int_types.h"
 #include "include/ceph_assert.h"
 
@@ -224,4 +228,101 @@ protected:
   }
 };
 
+/// PerfHdrHistogram is a one dimensional histogram of non-negative values
+/// (typically latencies in ns) with a bounded relative error, in the spirit
+/// of HdrHistogram.  Values below 2^(precision_bits + 1) get a bucket each,
+/// above that every power of two is split into 2^precision_bits buckets,
+/// so a bucket is never wider than 2^-precision_bits of the values it
+/// holds.  Values larger than the configured maximum are counted in the
+/// last bucket.
+///
+/// Histograms with the same configuration can be merged, e.g. to get the
+/// latency distribution of a whole pool of daemons.
+class PerfHdrHistogram {
+public:
+  static constexpr unsigned MAX_PRECISION_BITS = 10;
+  /// ~18 minutes when counting ns
+  static constexpr unsigned DEFAULT_MAX_VALUE_BITS = 40;
+
+  PerfHdrHistogram(unsigned precision_bits,
+		   unsigned max_value_bits = DEFAULT_MAX_VALUE_BITS);
+  PerfHdrHistogram(const PerfHdrHistogram &other);
+
+  void inc(uint64_t value) {
+    m_counts[get_bucket(value)]++;
+  }
+  void reset();
+  /// add the counts of other, which must have the same configuration
+  void merge(const PerfHdrHistogram &other);
+  /// remove the counts of other, an earlier copy of this histogram
+  void subtract(const PerfHdrHistogram &other);
+
+  unsigned get_precision_bits() const {
+    return m_precision_bits;
+  }
+  uint64_t get_total() const;
+  /// a value representative of the q (0 <= q <= 1) quantile, 0 if empty
+  uint64_t get_quantile(double q) const;
+
+  void dump_formatted(ceph::Formatter *f) const;
+  void encode(ceph::buffer::list &bl) const;
+  void decode(ceph::buffer::list::const_iterator &p);
+
+protected:
+  unsigned m_precision_bits;
+  unsigned m_max_value_bits;
+  size_t m_buckets;
+  std::unique_ptr<std::atomic<uint64_t>[]> m_counts;
+
+  static size_t bucket_count(unsigned precision_bits, unsigned max_value_bits);
+  size_t get_bucket(uint64_t value) const;
+  /// inclusive range of values counted in a bucket
+  std::pair<uint64_t, uint64_t> get_bucket_range(size_t bucket) const;
+};
+
+/// PerfLatencyHistogram is the PerfHdrHistogram of a time average.
+///
+/// Threads count into one of several histograms, picked by the shard
+/// index of the caller, so that concurrent updates do not all bounce the
+/// same cache lines; readers add them up.
+///
+/// The full distribution covers everything since the last reset, while
+/// get_window_quantile() only looks at the values of the last one to two
+/// windows (longer if it is called less often than once per window), so
+/// that percentile gauges follow the current latency instead of settling
+/// on the lifetime distribution.
+class PerfLatencyHistogram {
+public:
+  /// more shards cost memory and make reads slower for little gain
+  static constexpr unsigned MAX_SHARDS = 8;
+
+  PerfLatencyHistogram(unsigned precision_bits, unsigned shards,
+		       ceph::timespan window);
+  PerfLatencyHistogram(const PerfLatencyHistogram &other);
+
+  void inc(unsigned shard, uint64_t value) {
+    m_shards[shard & (m_shards.size() - 1)].inc(value);
+  }
+  void reset();
+
+  /// all values since creation or the last reset
+  PerfHdrHistogram get_merged() const;
+  /// the q (0 <= q <= 1) quantile of the values of the recent window(s)
+  uint64_t get_window_quantile(double q);
+
+  void dump_formatted(ceph::Formatter *f) const {
+    get_merged().dump_formatted(f);
+  }
+
+private:
+  std::vector<PerfHdrHistogram> m_shards;
+  const ceph::timespan m_window;
+
+  std::mutex m_lock;
+  // merged counts when the previous and the current window started
+  PerfHdrHistogram m_prev_start;
+  PerfHdrHistogram m_cur_start;
+  ceph::coarse_mono_time m_cur_started;
+};
+
 #endif
@@ -389,6 +389,10 @@ struct error_code;
 
     static ptr_node* copy_hypercombined(const ptr_node& copy_this);
 
+    // served from a per-thread cache
+    static void* operator new(size_t size);
+    static void operator delete(void* p);
+
   private:
     friend list;
 
@@ -127,6 +127,9 @@
 /* AsyncMessenger RDMA conditional compilation */
 #cmakedefine HAVE_RDMA
 
+/* AsyncMessenger io_uring conditional compilation */
+#cmakedefine HAVE_ASYNC_URING
+
 /* ibverbs experimental conditional compilation */
 #cmakedefine HAVE_IBV_EXP
 
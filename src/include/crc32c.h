@@ -17,6 +17,19 @@ extern ceph_crc32c_func_t ceph_crc32c_func;
 
 extern ceph_crc32c_func_t ceph_choose_crc32(void);
 
+typedef void (*ceph_crc32c_multi_func_t)(uint32_t crc,
+					 unsigned char const * const *data,
+					 unsigned length, unsigned count,
+					 uint32_t *out);
+
+/*
+ * static global with the chosen implementation for computing the crc32c
+ * of several equally sized buffers at once.
+ */
+extern ceph_crc32c_multi_func_t ceph_crc32c_multi_func;
+
+extern ceph_crc32c_multi_func_t ceph_choose_crc32_multi(void);
+
 /**
  * calculate crc32c for data that is entirely 0 (ZERO)
  *
@@ -50,6 +63,27 @@ static inline uint32_t ceph_crc32c(uint32_t crc, unsigned char const *data, unsi
   return ceph_crc32c_func(crc, data, length);
 }
 
+/**
+ * calculate crc32c of several buffers of the same length
+ *
+ * Each buffer is checksummed independently, starting from the same
+ * initial value; this is equivalent to calling ceph_crc32c() on every
+ * buffer but lets the implementation overlap the computations.
+ *
+ * @param crc initial value for every buffer
+ * @param data array of count pointers to the buffers (must not be NULL)
+ * @param length length of each buffer
+ * @param count number of buffers
+ * @param out array of count results
+ */
+static inline void ceph_crc32c_multi(uint32_t crc,
+				     unsigned char const * const *data,
+				     unsigned length, unsigned count,
+				     uint32_t *out)
+{
+  ceph_crc32c_multi_func(crc, data, length, count, out);
+}
+
 #ifdef __cplusplus
 }
 #endif
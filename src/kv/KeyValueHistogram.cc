@@ -1,7 +1,10 @@
 // -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
 // vim: ts=8 sw=2 smarttab
 
+#include <algorithm>
+#include <vector>
 #include "include/stringify.h"
+#include "common/pretty_binary.h"
 #include "KeyValueHistogram.h"
 using std::map;
 using std::string;
@@ -76,3 +79,116 @@ void KeyValueHistogram::dump(Formatter* f)
   }
   f->close_section();
 }
+
+size_t KeyValueHeatMap::record(op_t op, std::string_view prefix,
+                               std::string_view key, size_t bytes)
+{
+  std::string_view range = key.substr(0, key_bytes);
+  std::lock_guard l(lock);
+  if (ceph::coarse_mono_clock::now() - last_decay >= half_life) {
+    _decay();
+  }
+  auto p = prefixes.find(prefix);
+  if (p == prefixes.end()) {
+    p = prefixes.emplace(prefix, prefix_stat_t()).first;
+  }
+  auto& ranges = p->second.ranges;
+  auto r = ranges.find(range);
+  if (r == ranges.end()) {
+    uint64_t error = 0;
+    if (ranges.size() >= max_ranges) {
+      // replace the coldest range, assume the new one got its accesses
+      auto coldest = std::min_element(
+        ranges.begin(), ranges.end(),
+        [](auto& a, auto& b) { return a.second.heat() < b.second.heat(); });
+      error = coldest->second.heat();
+      ranges.erase(coldest);
+      --num_ranges;
+    }
+    r = ranges.emplace(range, range_stat_t()).first;
+    r->second.error = error;
+    ++num_ranges;
+  }
+  p->second.ops[op]++;
+  p->second.bytes[op] += bytes;
+  r->second.ops[op]++;
+  r->second.bytes[op] += bytes;
+  return num_ranges;
+}
+
+void KeyValueHeatMap::_decay()
+{
+  last_decay = ceph::coarse_mono_clock::now();
+  for (auto& [prefix, stat] : prefixes) {
+    stat.halve();
+    for (auto r = stat.ranges.begin(); r != stat.ranges.end(); ) {
+      r->second.halve();
+      r->second.error /= 2;
+      if (r->second.heat() == 0) {
+        r = stat.ranges.erase(r);
+        --num_ranges;
+      } else {
+        ++r;
+      }
+    }
+  }
+}
+
+void KeyValueHeatMap::reset()
+{
+  std::lock_guard l(lock);
+  prefixes.clear();
+  num_ranges = 0;
+  last_decay = ceph::coarse_mono_clock::now();
+}
+
+void KeyValueHeatMap::dump(Formatter *f, std::string_view prefix,
+                           size_t top) const
+{
+  auto dump_counters = [f, this](const counters_t& c) {
+    f->dump_unsigned("sampled_reads", c.ops[READ]);
+    f->dump_unsigned("sampled_writes", c.ops[WRITE]);
+    f->dump_unsigned("est_reads", c.ops[READ] * sample_every);
+    f->dump_unsigned("est_writes", c.ops[WRITE] * sample_every);
+    f->dump_unsigned("est_read_bytes", c.bytes[READ] * sample_every);
+    f->dump_unsigned("est_write_bytes", c.bytes[WRITE] * sample_every);
+  };
+
+  std::lock_guard l(lock);
+  f->open_object_section("heat_map");
+  f->dump_unsigned("sample_every", sample_every);
+  f->dump_unsigned("key_bytes", key_bytes);
+  f->dump_float("half_life", std::chrono::duration<double>(half_life).count());
+  f->open_array_section("prefixes");
+  for (auto& [name, stat] : prefixes) {
+    if (!prefix.empty() && prefix != name) {
+      continue;
+    }
+    f->open_object_section("prefix");
+    f->dump_string("prefix", name);
+    dump_counters(stat);
+    std::vector<const decltype(stat.ranges)::value_type*> sorted;
+    sorted.reserve(stat.ranges.size());
+    for (auto& r : stat.ranges) {
+      sorted.push_back(&r);
+    }
+    std::sort(sorted.begin(), sorted.end(), [](auto a, auto b) {
+      return a->second.heat() > b->second.heat();
+    });
+    if (top && sorted.size() > top) {
+      sorted.resize(top);
+    }
+    f->open_array_section("ranges");
+    for (auto r : sorted) {
+      f->open_object_section("range");
+      f->dump_string("range", pretty_binary_string(r->first));
+      dump_counters(r->second);
+      f->dump_unsigned("error", r->second.error);
+      f->close_section();
+    }
+    f->close_section();
+    f->close_section();
+  }
+  f->close_section();
+  f->close_section();
+}
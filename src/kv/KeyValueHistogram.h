@@ -5,7 +5,12 @@
 
 #include <map>
 #include <string>
+#include <string_view>
+#include <thread>
+#include "common/ceph_mutex.h"
+#include "common/ceph_time.h"
 #include "common/Formatter.h"
+#include "include/ceph_assert.h"
 
 /**
  *
@@ -35,4 +40,83 @@ struct KeyValueHistogram {
   void dump(ceph::Formatter* f);
 };
 
+/**
+ *
+ * Sampled, online heat map of a key space
+ *
+ * Counts reads and writes per prefix and per key range, a range being all
+ * the keys sharing their first key_bytes bytes (e.g. the omap of one
+ * object).  Only one access in sample_every is recorded, and only the
+ * max_ranges hottest ranges of each prefix are tracked: a new range takes
+ * over the coldest one along with its count (space-saving), which is kept
+ * as the error bound of the new range.  Counts are halved every half_life
+ * so the map follows the workload.
+ *
+ */
+class KeyValueHeatMap {
+public:
+  enum op_t {
+    READ = 0,
+    WRITE = 1,
+  };
+
+  KeyValueHeatMap(uint64_t sample_every, size_t key_bytes, size_t max_ranges,
+                  ceph::timespan half_life)
+    : sample_every(sample_every), key_bytes(key_bytes),
+      max_ranges(max_ranges), half_life(half_life),
+      last_decay(ceph::coarse_mono_clock::now()) {
+    ceph_assert(sample_every > 0);
+    ceph_assert(max_ranges > 0);
+  }
+
+  /// true if the caller should record this access
+  bool sample() const {
+    // start each thread at a different phase
+    static thread_local uint64_t tick =
+      std::hash<std::thread::id>{}(std::this_thread::get_id());
+    return ++tick % sample_every == 0;
+  }
+  /// record a sampled access, return the number of tracked ranges
+  size_t record(op_t op, std::string_view prefix, std::string_view key,
+                size_t bytes);
+  /// dump the top ranges of one or all prefixes, hottest first
+  void dump(ceph::Formatter *f, std::string_view prefix = {},
+            size_t top = 0) const;
+  void reset();
+
+private:
+  struct counters_t {
+    uint64_t ops[2] = {0, 0};
+    uint64_t bytes[2] = {0, 0};
+    void halve() {
+      for (int i = 0; i < 2; i++) {
+        ops[i] /= 2;
+        bytes[i] /= 2;
+      }
+    }
+  };
+  struct range_stat_t : counters_t {
+    uint64_t error = 0;
+    uint64_t heat() const {
+      return ops[READ] + ops[WRITE] + error;
+    }
+  };
+  struct prefix_stat_t : counters_t {
+    std::map<std::string, range_stat_t, std::less<>> ranges;
+  };
+
+  const uint64_t sample_every;
+  const size_t key_bytes;
+  const size_t max_ranges;
+  const ceph::timespan half_life;
+
+  mutable ceph::mutex lock =
+    ceph::make_mutex("KeyValueHeatMap::lock");
+  std::map<std::string, prefix_stat_t, std::less<>> prefixes;
+  size_t num_ranges = 0;
+  ceph::coarse_mono_time last_decay;
+
+  void _decay();
+};
+
 #endif
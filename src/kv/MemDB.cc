@@ -66,10 +66,36 @@ static string make_key(const string &prefix, const string &value)
   return out;
 }
 
-void MemDB::_encode(mdb_iter_t iter, bufferlist &bl)
+MemDB::ReadGuard::ReadGuard(MemDB *db)
+{
+  static std::atomic<unsigned> next_shard = 0;
+  thread_local unsigned shard = next_shard++ % READER_SHARDS;
+  auto &readers = db->m_readers[shard];
+  while (true) {
+    uint64_t epoch = db->m_epoch.load();
+    count = &readers.count[epoch & 1];
+    count->fetch_add(1);
+    if (db->m_epoch.load() == epoch) {
+      break;
+    }
+    // the writer moved on in between, the count we bumped may already
+    // have been checked
+    count->fetch_sub(1);
+  }
+}
+
+MemDB::MemDB(CephContext *c, const std::string &path, void *p) :
+  m_total_bytes(0), m_allocated_bytes(0),
+  m_head(new Node(std::string(), MAX_HEIGHT)),
+  m_cct(c), logger(NULL), m_priv(p), m_db_path(path),
+  m_persist(c->_conf.get_val<bool>("memdb_persist"))
 {
-  encode(iter->first, bl);
-  encode(iter->second, bl);
+}
+
+void MemDB::_encode(const string &key, const bufferptr &data, bufferlist &bl)
+{
+  encode(key, bl);
+  encode(data, bl);
 }
 
 std::string MemDB::_get_data_fn()
@@ -80,7 +106,9 @@ std::string MemDB::_get_data_fn()
 
 void MemDB::_save()
 {
-  std::lock_guard<std::mutex> l(m_lock);
+  if (!m_persist) {
+    return;
+  }
   dout(10) << __func__ << " Saving MemDB to file: "<< _get_data_fn().c_str() << dendl;
   int mode = 0644;
   int fd = TEMP_FAILURE_RETRY(::open(_get_data_fn().c_str(),
@@ -92,11 +120,17 @@ void MemDB::_save()
     return;
   }
   bufferlist bl;
-  mdb_iter_t iter = m_map.begin();
-  while (iter != m_map.end()) {
-    dout(10) << __func__ << " Key:"<< iter->first << dendl;
-    _encode(iter, bl);
-    ++iter;
+  {
+    ReadGuard g(this);
+    uint64_t seq = m_visible_seq.load(std::memory_order_acquire);
+    const Version *v;
+    for (Node *n = _next_visible(m_head->next[0].load(std::memory_order_acquire),
+                                 seq, &v);
+         n != nullptr;
+         n = _next_visible(n->next[0].load(std::memory_order_acquire), seq, &v)) {
+      dout(10) << __func__ << " Key:"<< n->key << dendl;
+      _encode(n->key, v->data, bl);
+    }
   }
   bl.write_fd(fd);
 
@@ -105,7 +139,9 @@ void MemDB::_save()
 
 int MemDB::_load()
 {
-  std::lock_guard<std::mutex> l(m_lock);
+  if (!m_persist) {
+    return 0;
+  }
   dout(10) << __func__ << " Reading MemDB from file: "<< _get_data_fn().c_str() << dendl;
   /*
    * Open file and read it in single shot.
@@ -128,6 +164,9 @@ int MemDB::_load()
     return -err;
   }
 
+  std::lock_guard<std::mutex> l(m_write_lock);
+  m_write_seq = m_visible_seq.load(std::memory_order_relaxed) + 1;
+  m_prune_horizon = m_write_seq - 1;
   ssize_t file_size = st.st_size;
   ssize_t bytes_done = 0;
   while (bytes_done < file_size) {
@@ -138,9 +177,10 @@ int MemDB::_load()
     bytes_done += ceph::decode_file(fd, datap);
 
     dout(10) << __func__ << " Key:"<< key << dendl;
-    m_map[key] = datap;
     m_total_bytes += datap.length();
+    _push_version(key, false, std::move(datap));
   }
+  m_visible_seq.store(m_write_seq, std::memory_order_release);
   VOID_TEMP_FAILURE_RETRY(::close(fd));
   return 0;
 }
@@ -209,12 +249,21 @@ MemDB::~MemDB()
 {
   close();
   dout(10) << __func__ << " Destroying MemDB instance: "<< dendl;
+  // nobody can be reading anymore
+  _free(m_retired_old);
+  _free(m_retired_cur);
+  Node *n = m_head;
+  while (n != nullptr) {
+    Node *next = n->next[0].load(std::memory_order_relaxed);
+    _free_node(n);
+    n = next;
+  }
 }
 
 void MemDB::close()
 {
   /*
-   * Save whatever in memory btree.
+   * Save whatever in memory skip list.
    */
   _save();
   if (logger)
@@ -228,18 +277,27 @@ int MemDB::submit_transaction(KeyValueDB::Transaction t)
   MDBTransactionImpl* mt =  static_cast<MDBTransactionImpl*>(t.get());
 
   dtrace << __func__ << " " << mt->get_ops().size() << dendl;
-  for(auto& op : mt->get_ops()) {
-    if(op.first == MDBTransactionImpl::WRITE) {
-      ms_op_t set_op = op.second;
-      _setkey(set_op);
-    } else if (op.first == MDBTransactionImpl::MERGE) {
-      ms_op_t merge_op = op.second;
-      _merge(merge_op);
-    } else {
-      ms_op_t rm_op = op.second;
-      ceph_assert(op.first == MDBTransactionImpl::DELETE);
-      _rmkey(rm_op);
+  {
+    std::lock_guard<std::mutex> l(m_write_lock);
+    m_write_seq = m_visible_seq.load(std::memory_order_relaxed) + 1;
+    m_prune_horizon = _snapshot_horizon();
+    for(auto& op : mt->get_ops()) {
+      if(op.first == MDBTransactionImpl::WRITE) {
+        ms_op_t set_op = op.second;
+        _setkey(set_op);
+      } else if (op.first == MDBTransactionImpl::MERGE) {
+        ms_op_t merge_op = op.second;
+        _merge(merge_op);
+      } else {
+        ms_op_t rm_op = op.second;
+        ceph_assert(op.first == MDBTransactionImpl::DELETE);
+        _rmkey(rm_op);
+      }
     }
+    // the whole transaction becomes visible at once
+    m_visible_seq.store(m_write_seq, std::memory_order_release);
+    _unlink_dead();
+    _reclaim();
   }
 
   utime_t lat = ceph_clock_now() - start;
@@ -310,44 +368,41 @@ void MemDB::MDBTransactionImpl::merge(
   return;
 }
 
+/*
+ * The _setkey/_rmkey/_merge helpers run with m_write_lock held and write
+ * at m_write_seq.
+ */
 int MemDB::_setkey(ms_op_t &op)
 {
-  std::lock_guard<std::mutex> l(m_lock);
   std::string key = make_key(op.first.first, op.first.second);
   bufferlist bl = op.second;
 
   m_total_bytes += bl.length();
 
-  bufferlist bl_old;
-  if (_get(op.first.first, op.first.second, &bl_old)) {
+  if (const Version *old = _current(key); old != nullptr) {
     /*
-     * delete and free existing key.
+     * the existing value is freed once nobody can see it anymore.
      */
-    ceph_assert(m_total_bytes >= bl_old.length());
-    m_total_bytes -= bl_old.length();
-    m_map.erase(key);
+    ceph_assert(m_total_bytes >= old->data.length());
+    m_total_bytes -= old->data.length();
   }
 
-  m_map[key] = bufferptr((char *) bl.c_str(), bl.length());
-  iterator_seq_no++;
+  _push_version(key, false, bufferptr((char *) bl.c_str(), bl.length()));
   return 0;
 }
 
 int MemDB::_rmkey(ms_op_t &op)
 {
-  std::lock_guard<std::mutex> l(m_lock);
   std::string key = make_key(op.first.first, op.first.second);
 
-  bufferlist bl_old;
-  if (_get(op.first.first, op.first.second, &bl_old)) {
-    ceph_assert(m_total_bytes >= bl_old.length());
-    m_total_bytes -= bl_old.length();
+  const Version *old = _current(key);
+  if (old == nullptr) {
+    return 0;
   }
-  iterator_seq_no++;
-  /*
-   * Erase will call the destructor for bufferptr.
-   */
-  return m_map.erase(key);
+  ceph_assert(m_total_bytes >= old->data.length());
+  m_total_bytes -= old->data.length();
+  _push_version(key, true, bufferptr());
+  return 1;
 }
 
 std::shared_ptr<KeyValueDB::MergeOperator> MemDB::_find_merge_op(const std::string &prefix)
@@ -365,7 +420,6 @@ std::shared_ptr<KeyValueDB::MergeOperator> MemDB::_find_merge_op(const std::stri
 
 int MemDB::_merge(ms_op_t &op)
 {
-  std::lock_guard<std::mutex> l(m_lock);
   std::string prefix = op.first.first;
   std::string key = make_key(op.first.first, op.first.second);
   bufferlist bl = op.second;
@@ -380,53 +434,352 @@ int MemDB::_merge(ms_op_t &op)
   /*
    * call the merge operator with value and non value
    */
-  bufferlist bl_old;
-  if (_get(op.first.first, op.first.second, &bl_old) == false) {
-    std::string new_val;
+  const Version *old = _current(key);
+  std::string new_val;
+  if (old == nullptr) {
     /*
      * Merge non existent.
      */
     mop->merge_nonexistent(bl.c_str(), bl.length(), &new_val);
-    m_map[key] = bufferptr(new_val.c_str(), new_val.length());
   } else {
     /*
      * Merge existing.
      */
-    std::string new_val;
-    mop->merge(bl_old.c_str(), bl_old.length(), bl.c_str(), bl.length(), &new_val);
-    m_map[key] = bufferptr(new_val.c_str(), new_val.length());
-    bytes_adjusted -= bl_old.length();
-    bl_old.clear();
+    mop->merge(old->data.c_str(), old->data.length(), bl.c_str(), bl.length(), &new_val);
+    bytes_adjusted -= old->data.length();
   }
+  _push_version(key, false, bufferptr(new_val.c_str(), new_val.length()));
 
   ceph_assert((int64_t)m_total_bytes + bytes_adjusted >= 0);
   m_total_bytes += bytes_adjusted;
-  iterator_seq_no++;
   return 0;
 }
 
+int MemDB::_random_height()
+{
+  // branching factor of 4, as leveldb's memtable
+  int height = 1;
+  while (height < MAX_HEIGHT && (m_rand() & 3) == 0) {
+    height++;
+  }
+  return height;
+}
+
 /*
- * Caller take btree lock.
+ * Latest value of key, including what the current transaction wrote.
  */
-bool MemDB::_get(const string &prefix, const string &k, bufferlist *out)
+const MemDB::Version* MemDB::_current(const string &key)
 {
-  string key = make_key(prefix, k);
+  Node *n = _find_ge(key, nullptr);
+  if (n == nullptr || n->key != key) {
+    return nullptr;
+  }
+  const Version *v = n->head.load(std::memory_order_relaxed);
+  return v->deleted ? nullptr : v;
+}
+
+void MemDB::_push_version(const string &key, bool deleted, bufferptr &&data)
+{
+  Node *prev[MAX_HEIGHT];
+  Node *n = _find_ge(key, prev);
+  Version *v = new Version(m_write_seq, deleted, std::move(data));
+  if (n == nullptr || n->key != key) {
+    ceph_assert(!deleted);
+    int height = _random_height();
+    if (height > m_max_height.load(std::memory_order_relaxed)) {
+      // readers seeing the new height before the node is linked just
+      // go down from the head
+      m_max_height.store(height, std::memory_order_relaxed);
+    }
+    n = new Node(key, height);
+    n->head.store(v, std::memory_order_relaxed);
+    for (int i = 0; i < height; i++) {
+      n->next[i].store(prev[i]->next[i].load(std::memory_order_relaxed),
+                       std::memory_order_relaxed);
+      prev[i]->next[i].store(n, std::memory_order_release);
+    }
+    return;
+  }
 
-  mdb_iter_t iter = m_map.find(key);
-  if (iter == m_map.end()) {
-    return false;
+  Version *head = n->head.load(std::memory_order_relaxed);
+  if (head->seq == m_write_seq) {
+    // written earlier in this transaction, nobody can see that version
+    v->older.store(head->older.load(std::memory_order_relaxed),
+                   std::memory_order_relaxed);
+    n->head.store(v, std::memory_order_release);
+    m_retired_cur.versions.push_back(head);
+  } else {
+    v->older.store(head, std::memory_order_relaxed);
+    n->head.store(v, std::memory_order_release);
+    _prune(v);
   }
+  if (deleted) {
+    m_dead_nodes.emplace_back(n, m_write_seq);
+  }
+}
 
-  out->push_back((m_map[key].clone()));
-  return true;
+/*
+ * Drop the versions older than the one visible at m_prune_horizon, no
+ * snapshot can see them.
+ */
+void MemDB::_prune(Version *v)
+{
+  while (v != nullptr && v->seq > m_prune_horizon) {
+    v = v->older.load(std::memory_order_relaxed);
+  }
+  if (v == nullptr) {
+    return;
+  }
+  Version *cut = v->older.load(std::memory_order_relaxed);
+  v->older.store(nullptr, std::memory_order_release);
+  while (cut != nullptr) {
+    m_retired_cur.versions.push_back(cut);
+    cut = cut->older.load(std::memory_order_relaxed);
+  }
+}
+
+/*
+ * Unlink nodes whose key got deleted before every snapshot.
+ */
+void MemDB::_unlink_dead()
+{
+  uint64_t horizon = _snapshot_horizon();
+  while (!m_dead_nodes.empty() && m_dead_nodes.front().second <= horizon) {
+    auto [n, seq] = m_dead_nodes.front();
+    m_dead_nodes.pop_front();
+    const Version *head = n->head.load(std::memory_order_relaxed);
+    if (!head->deleted || head->seq != seq) {
+      // written again since
+      continue;
+    }
+    Node *prev[MAX_HEIGHT];
+    if (_find_ge(n->key, prev) != n) {
+      // deleted twice in one transaction, already unlinked
+      continue;
+    }
+    for (int i = 0; i < n->height; i++) {
+      if (prev[i]->next[i].load(std::memory_order_relaxed) == n) {
+        prev[i]->next[i].store(n->next[i].load(std::memory_order_relaxed),
+                               std::memory_order_release);
+      }
+    }
+    m_retired_cur.nodes.push_back(n);
+  }
+}
+
+int64_t MemDB::_active_readers(uint64_t epoch) const
+{
+  int64_t active = 0;
+  for (auto &r : m_readers) {
+    active += r.count[epoch & 1].load();
+  }
+  return active;
+}
+
+/*
+ * Garbage in m_retired_old was retired before the current epoch started
+ * and can go once the readers of the previous epoch are gone; the epoch
+ * only moves on once the readers two epochs back are gone.
+ */
+void MemDB::_reclaim()
+{
+  for (int pass = 0; pass < 2; ++pass) {
+    uint64_t epoch = m_epoch.load();
+    if (_active_readers(epoch + 1) != 0) {
+      return;
+    }
+    _free(m_retired_old);
+    if (m_retired_cur.empty()) {
+      return;
+    }
+    m_epoch.store(epoch + 1);
+    std::swap(m_retired_old, m_retired_cur);
+  }
+}
+
+void MemDB::_free(Retired &r)
+{
+  for (auto v : r.versions) {
+    delete v;
+  }
+  r.versions.clear();
+  for (auto n : r.nodes) {
+    _free_node(n);
+  }
+  r.nodes.clear();
+}
+
+void MemDB::_free_node(Node *n)
+{
+  Version *v = n->head.load(std::memory_order_relaxed);
+  while (v != nullptr) {
+    Version *older = v->older.load(std::memory_order_relaxed);
+    delete v;
+    v = older;
+  }
+  delete n;
+}
+
+uint64_t MemDB::_pin_snapshot()
+{
+  std::lock_guard<std::mutex> l(m_snap_lock);
+  uint64_t seq = m_visible_seq.load(std::memory_order_acquire);
+  m_snapshots.insert(seq);
+  return seq;
+}
+
+void MemDB::_unpin_snapshot(uint64_t seq)
+{
+  std::lock_guard<std::mutex> l(m_snap_lock);
+  auto p = m_snapshots.find(seq);
+  ceph_assert(p != m_snapshots.end());
+  m_snapshots.erase(p);
+}
+
+/*
+ * Oldest sequence number a reader may still read at.
+ */
+uint64_t MemDB::_snapshot_horizon()
+{
+  uint64_t horizon = m_visible_seq.load(std::memory_order_relaxed);
+  std::lock_guard<std::mutex> l(m_snap_lock);
+  if (!m_snapshots.empty()) {
+    horizon = std::min(horizon, *m_snapshots.begin());
+  }
+  return horizon;
 }
 
-bool MemDB::_get_locked(const string &prefix, const string &k, bufferlist *out)
+/*
+ * First node with a key >= key; with prev set, also fill in the last
+ * node before it on every level.
+ */
+MemDB::Node* MemDB::_find_ge(const string &key, Node **prev) const
 {
-  std::lock_guard<std::mutex> l(m_lock);
-  return _get(prefix, k, out);
+  Node *x = m_head;
+  int level = m_max_height.load(std::memory_order_relaxed) - 1;
+  if (prev) {
+    for (int i = level + 1; i < MAX_HEIGHT; i++) {
+      prev[i] = m_head;
+    }
+  }
+  while (true) {
+    Node *next = x->next[level].load(std::memory_order_acquire);
+    if (next != nullptr && next->key < key) {
+      x = next;
+    } else {
+      if (prev) {
+        prev[level] = x;
+      }
+      if (level == 0) {
+        return next;
+      }
+      --level;
+    }
+  }
 }
 
+/*
+ * Last node with a key < key, m_head if there is none.
+ */
+MemDB::Node* MemDB::_find_lt(const string &key) const
+{
+  Node *x = m_head;
+  int level = m_max_height.load(std::memory_order_relaxed) - 1;
+  while (true) {
+    Node *next = x->next[level].load(std::memory_order_acquire);
+    if (next != nullptr && next->key < key) {
+      x = next;
+    } else if (level == 0) {
+      return x;
+    } else {
+      --level;
+    }
+  }
+}
+
+MemDB::Node* MemDB::_find_last() const
+{
+  Node *x = m_head;
+  int level = m_max_height.load(std::memory_order_relaxed) - 1;
+  while (true) {
+    Node *next = x->next[level].load(std::memory_order_acquire);
+    if (next != nullptr) {
+      x = next;
+    } else if (level == 0) {
+      return x;
+    } else {
+      --level;
+    }
+  }
+}
+
+const MemDB::Version* MemDB::_visible(const Node *n, uint64_t seq)
+{
+  const Version *v = n->head.load(std::memory_order_acquire);
+  while (v != nullptr && v->seq > seq) {
+    v = v->older.load(std::memory_order_acquire);
+  }
+  return (v != nullptr && !v->deleted) ? v : nullptr;
+}
+
+/*
+ * First node from n on with a value at seq.
+ */
+MemDB::Node* MemDB::_next_visible(Node *n, uint64_t seq, const Version **v) const
+{
+  while (n != nullptr) {
+    *v = _visible(n, seq);
+    if (*v != nullptr) {
+      return n;
+    }
+    n = n->next[0].load(std::memory_order_acquire);
+  }
+  return nullptr;
+}
+
+/*
+ * Last node before key with a value at seq.
+ */
+MemDB::Node* MemDB::_prev_visible(const string &key, uint64_t seq,
+                                  const Version **v) const
+{
+  Node *n = _find_lt(key);
+  while (n != m_head) {
+    *v = _visible(n, seq);
+    if (*v != nullptr) {
+      return n;
+    }
+    n = _find_lt(n->key);
+  }
+  return nullptr;
+}
+
+bool MemDB::_get(const string &prefix, const string &k, bufferlist *out)
+{
+  string key = make_key(prefix, k);
+
+  ReadGuard g(this);
+  Node *n = _find_ge(key, nullptr);
+  if (n == nullptr || n->key != key) {
+    return false;
+  }
+  // Unlike an iterator, a point lookup does not pin its sequence number, so
+  // a transaction committed meanwhile may prune the version visible at it.
+  // The newest committed version is just as good an answer, read that one
+  // instead; the version visible at the current m_visible_seq is never
+  // pruned.
+  uint64_t seq = m_visible_seq.load(std::memory_order_acquire);
+  const Version *v;
+  while ((v = _visible(n, seq)) == nullptr) {
+    uint64_t cur = m_visible_seq.load(std::memory_order_acquire);
+    if (cur == seq) {
+      return false;
+    }
+    seq = cur;
+  }
+  out->push_back(bufferptr(v->data.c_str(), v->data.length()));
+  return true;
+}
 
 int MemDB::get(const string &prefix, const std::string& key,
                  bufferlist *out)
@@ -434,7 +787,7 @@ int MemDB::get(const string &prefix, const std::string& key,
   utime_t start = ceph_clock_now();
   int ret;
 
-  if (_get_locked(prefix, key, out)) {
+  if (_get(prefix, key, out)) {
     ret = 0;
   } else {
     ret = -ENOENT;
@@ -454,7 +807,7 @@ int MemDB::get(const string &prefix, const std::set<string> &keys,
 
   for (const auto& i : keys) {
     bufferlist bl;
-    if (_get_locked(prefix, i, &bl))
+    if (_get(prefix, i, &bl))
       out->insert(make_pair(i, bl));
   }
 
@@ -465,11 +818,17 @@ int MemDB::get(const string &prefix, const std::set<string> &keys,
   return 0;
 }
 
-void MemDB::MDBWholeSpaceIteratorImpl::fill_current()
+/*
+ * The iterator reads at m_snap_seq.  The node it is positioned on stays
+ * linked as long as the snapshot is pinned, so it is safe to keep between
+ * calls; everything else is only touched under a ReadGuard.
+ */
+void MemDB::MDBWholeSpaceIteratorImpl::fill_current(Node *n, const Version *v)
 {
+  m_node = n;
   bufferlist bl;
-  bl.push_back(m_iter->second.clone());
-  m_key_value = std::make_pair(m_iter->first, bl);
+  bl.push_back(bufferptr(v->data.c_str(), v->data.length()));
+  m_key_value = std::make_pair(n->key, bl);
 }
 
 bool MemDB::MDBWholeSpaceIteratorImpl::valid()
@@ -480,44 +839,10 @@ bool MemDB::MDBWholeSpaceIteratorImpl::valid()
   return true;
 }
 
-bool MemDB::MDBWholeSpaceIteratorImpl::iterator_validate() {
-
-  if (this_seq_no != *global_seq_no) {
-    auto key = m_key_value.first;
-    ceph_assert(!key.empty());
-
-    bool restart_iter = false;
-    if (!m_using_btree) {
-      /*
-       * Map is modified and marker key does not exists, 
-       * restart the iterator from next key.
-       */
-      if (m_map_p->find(key) == m_map_p->end()) {
-        restart_iter = true;
-      }
-    } else {
-      restart_iter = true;
-    }
-
-    if (restart_iter) {
-      m_iter = m_map_p->lower_bound(key);
-      if (m_iter == m_map_p->end()) {
-        return false;
-      }
-    }
-
-    /*
-     * This iter is valid now.
-     */
-    this_seq_no = *global_seq_no;
-  }
-
-  return true;
-}
-
 void
 MemDB::MDBWholeSpaceIteratorImpl::free_last()
 {
+  m_node = nullptr;
   m_key_value.first.clear();
   m_key_value.second.clear();
 }
@@ -553,15 +878,16 @@ bufferlist MemDB::MDBWholeSpaceIteratorImpl::value()
 
 int MemDB::MDBWholeSpaceIteratorImpl::next()
 {
-  std::lock_guard<std::mutex> l(*m_map_lock_p);
-  if (!iterator_validate()) {
-    free_last();
+  if (m_node == nullptr) {
     return -1;
   }
+  ReadGuard g(m_db);
+  const Version *v;
+  Node *n = m_db->_next_visible(m_node->next[0].load(std::memory_order_acquire),
+                                m_snap_seq, &v);
   free_last();
-  ++m_iter;
-  if (m_iter != m_map_p->end()) {
-    fill_current();
+  if (n != nullptr) {
+    fill_current(n, v);
     return 0;
   } else {
     return -1;
@@ -570,15 +896,15 @@ int MemDB::MDBWholeSpaceIteratorImpl::next()
 
 int MemDB::MDBWholeSpaceIteratorImpl:: prev()
 {
-  std::lock_guard<std::mutex> l(*m_map_lock_p);
-  if (!iterator_validate()) {
-    free_last();
+  if (m_node == nullptr) {
     return -1;
   }
+  ReadGuard g(m_db);
+  const Version *v;
+  Node *n = m_db->_prev_visible(m_key_value.first, m_snap_seq, &v);
   free_last();
-  if (m_iter != m_map_p->begin()) {
-    --m_iter;
-    fill_current();
+  if (n != nullptr) {
+    fill_current(n, v);
     return 0;
   } else {
     return -1;
@@ -586,58 +912,83 @@ int MemDB::MDBWholeSpaceIteratorImpl:: prev()
 }
 
 /*
- * First key >= to given key, if key is null then first key in btree.
+ * First key >= to given key, if key is null then first key in skip list.
  */
 int MemDB::MDBWholeSpaceIteratorImpl::seek_to_first(const std::string &k)
 {
-  std::lock_guard<std::mutex> l(*m_map_lock_p);
+  ReadGuard g(m_db);
   free_last();
+  Node *n;
   if (k.empty()) {
-    m_iter = m_map_p->begin();
+    n = m_db->m_head->next[0].load(std::memory_order_acquire);
   } else {
-    m_iter = m_map_p->lower_bound(k);
+    n = m_db->_find_ge(k, nullptr);
   }
-  
-  if (m_iter == m_map_p->end()) {
+
+  const Version *v;
+  n = m_db->_next_visible(n, m_snap_seq, &v);
+  if (n == nullptr) {
     return -1;
   }
-  fill_current();
+  fill_current(n, v);
   return 0;
 }
 
+/*
+ * Last key of the given prefix, if prefix is null then last key in skip
+ * list.
+ */
 int MemDB::MDBWholeSpaceIteratorImpl::seek_to_last(const std::string &k)
 {
-  std::lock_guard<std::mutex> l(*m_map_lock_p);
+  ReadGuard g(m_db);
   free_last();
+  const Version *v = nullptr;
+  Node *n;
   if (k.empty()) {
-    m_iter = m_map_p->end();
-    --m_iter;
+    n = m_db->_find_last();
+    if (n != m_db->m_head) {
+      v = _visible(n, m_snap_seq);
+      if (v == nullptr) {
+        n = m_db->_prev_visible(n->key, m_snap_seq, &v);
+      }
+    } else {
+      n = nullptr;
+    }
   } else {
-    m_iter = m_map_p->lower_bound(k);
+    string limit = k;
+    limit.push_back(KEY_DELIM + 1);
+    n = m_db->_prev_visible(limit, m_snap_seq, &v);
   }
 
-  if (m_iter == m_map_p->end()) {
+  if (n == nullptr) {
     return -1;
   }
-  fill_current();
+  fill_current(n, v);
   return 0;
 }
 
 MemDB::MDBWholeSpaceIteratorImpl::~MDBWholeSpaceIteratorImpl()
 {
   free_last();
+  m_db->_unpin_snapshot(m_snap_seq);
 }
 
 int MemDB::MDBWholeSpaceIteratorImpl::upper_bound(const std::string &prefix,
     const std::string &after) {
 
-  std::lock_guard<std::mutex> l(*m_map_lock_p);
+  ReadGuard g(m_db);
 
   dtrace << "upper_bound " << prefix.c_str() << after.c_str() << dendl;
+  free_last();
   string k = make_key(prefix, after);
-  m_iter = m_map_p->upper_bound(k);
-  if (m_iter != m_map_p->end()) {
-    fill_current();
+  Node *n = m_db->_find_ge(k, nullptr);
+  if (n != nullptr && n->key == k) {
+    n = n->next[0].load(std::memory_order_acquire);
+  }
+  const Version *v;
+  n = m_db->_next_visible(n, m_snap_seq, &v);
+  if (n != nullptr) {
+    fill_current(n, v);
     return 0;
   }
   return -1;
@@ -645,12 +996,14 @@ int MemDB::MDBWholeSpaceIteratorImpl::upper_bound(const std::string &prefix,
 
 int MemDB::MDBWholeSpaceIteratorImpl::lower_bound(const std::string &prefix,
     const std::string &to) {
-  std::lock_guard<std::mutex> l(*m_map_lock_p);
+  ReadGuard g(m_db);
   dtrace << "lower_bound " << prefix.c_str() << to.c_str() << dendl;
+  free_last();
   string k = make_key(prefix, to);
-  m_iter = m_map_p->lower_bound(k);
-  if (m_iter != m_map_p->end()) {
-    fill_current();
+  const Version *v;
+  Node *n = m_db->_next_visible(m_db->_find_ge(k, nullptr), m_snap_seq, &v);
+  if (n != nullptr) {
+    fill_current(n, v);
     return 0;
   }
   return -1;
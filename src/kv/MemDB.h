@@ -9,11 +9,16 @@
 #define CEPH_OS_BLUESTORE_MEMDB_H
 
 #include "include/buffer.h"
+#include <atomic>
+#include <deque>
 #include <ostream>
+#include <random>
 #include <set>
 #include <map>
 #include <string>
 #include <memory>
+#include <mutex>
+#include <vector>
 #include <boost/scoped_ptr.hpp>
 #include "include/common_fwd.h"
 #include "include/encoding.h"
@@ -36,40 +41,134 @@ enum {
 class MemDB : public KeyValueDB
 {
   typedef std::pair<std::pair<std::string, std::string>, ceph::bufferlist> ms_op_t;
-  std::mutex m_lock;
-  uint64_t m_total_bytes;
-  uint64_t m_allocated_bytes;
 
-  typedef std::map<std::string, ceph::bufferptr> mdb_map_t;
-  typedef mdb_map_t::iterator mdb_iter_t;
-  bool m_using_btree;
+  /*
+   * Keys are kept in a skip list with a single writer (submit_transaction
+   * serializes on m_write_lock) and lock-free readers.  Each key node holds
+   * a chain of immutable versions, newest first, tagged with the sequence
+   * number of the transaction that wrote them; a transaction only becomes
+   * visible once m_visible_seq is bumped, so readers never see half of it.
+   *
+   * Iterators read at the sequence number they were created at.  Their
+   * snapshot is pinned in m_snapshots so that the versions and nodes they
+   * may still need are not pruned.
+   *
+   * Unlinked versions and nodes are freed once no reader can still be
+   * looking at them: readers announce themselves in m_readers under the
+   * current m_epoch (see ReadGuard), the writer retires garbage under the
+   * current epoch and frees it once the epoch moved on and its readers
+   * have left.
+   */
+  struct Version {
+    const uint64_t seq;
+    const bool deleted;
+    const ceph::bufferptr data;
+    std::atomic<Version*> older{nullptr};
+    Version(uint64_t s, bool d, ceph::bufferptr&& p)
+      : seq(s), deleted(d), data(std::move(p)) {}
+  };
+
+  struct Node {
+    const std::string key;
+    const int height;
+    std::atomic<Version*> head{nullptr};
+    std::unique_ptr<std::atomic<Node*>[]> next;
+    Node(const std::string &k, int h)
+      : key(k), height(h), next(new std::atomic<Node*>[h]) {
+      for (int i = 0; i < h; i++) {
+        next[i].store(nullptr, std::memory_order_relaxed);
+      }
+    }
+  };
+
+  static constexpr int MAX_HEIGHT = 12;
+  static constexpr int READER_SHARDS = 16;
+
+  struct alignas(64) ReaderShard {
+    std::atomic<int64_t> count[2] = {0, 0};
+  };
+
+  class ReadGuard {
+    std::atomic<int64_t> *count;
+  public:
+    explicit ReadGuard(MemDB *db);
+    ~ReadGuard() {
+      count->fetch_sub(1);
+    }
+  };
+
+  struct Retired {
+    std::vector<Version*> versions;
+    std::vector<Node*> nodes;
+    bool empty() const {
+      return versions.empty() && nodes.empty();
+    }
+  };
+
+  std::mutex m_write_lock;
+  std::atomic<uint64_t> m_total_bytes;
+  std::atomic<uint64_t> m_allocated_bytes;
+
+  Node *m_head;
+  std::atomic<int> m_max_height{1};
+  std::minstd_rand m_rand;
 
-  mdb_map_t m_map;
+  std::atomic<uint64_t> m_visible_seq{0};
+  // protected by m_write_lock
+  uint64_t m_write_seq = 0;
+  uint64_t m_prune_horizon = 0;
+  std::deque<std::pair<Node*, uint64_t>> m_dead_nodes;
+  Retired m_retired_cur, m_retired_old;
+
+  std::mutex m_snap_lock;
+  std::multiset<uint64_t> m_snapshots;
+
+  std::atomic<uint64_t> m_epoch{0};
+  ReaderShard m_readers[READER_SHARDS];
 
   CephContext *m_cct;
   PerfCounters *logger;
   void* m_priv;
   std::string m_options;
   std::string m_db_path;
+  bool m_persist;
 
   int transaction_rollback(KeyValueDB::Transaction t);
   int _open(std::ostream &out);
   void close() override;
   bool _get(const std::string &prefix, const std::string &k, ceph::bufferlist *out);
-  bool _get_locked(const std::string &prefix, const std::string &k, ceph::bufferlist *out);
   std::string _get_data_fn();
-  void _encode(mdb_iter_t iter, ceph::bufferlist &bl);
+  void _encode(const std::string &key, const ceph::bufferptr &data,
+               ceph::bufferlist &bl);
   void _save();
   int _load();
-  uint64_t iterator_seq_no;
+
+  // skip list, safe for readers under a ReadGuard
+  Node* _find_ge(const std::string &key, Node **prev) const;
+  Node* _find_lt(const std::string &key) const;
+  Node* _find_last() const;
+  static const Version* _visible(const Node *n, uint64_t seq);
+  Node* _next_visible(Node *n, uint64_t seq, const Version **v) const;
+  Node* _prev_visible(const std::string &key, uint64_t seq,
+                      const Version **v) const;
+
+  // writer side, must hold m_write_lock
+  int _random_height();
+  const Version* _current(const std::string &key);
+  void _push_version(const std::string &key, bool deleted, ceph::bufferptr &&data);
+  void _prune(Version *v);
+  void _unlink_dead();
+  void _reclaim();
+  int64_t _active_readers(uint64_t epoch) const;
+  static void _free(Retired &r);
+  static void _free_node(Node *n);
+
+  uint64_t _pin_snapshot();
+  void _unpin_snapshot(uint64_t seq);
+  uint64_t _snapshot_horizon();
 
 public:
-  MemDB(CephContext *c, const std::string &path, void *p) :
-    m_total_bytes(0), m_allocated_bytes(0), m_using_btree(false),
-    m_cct(c), logger(NULL), m_priv(p), m_db_path(path), iterator_seq_no(1)
-  {
-    //Nothing as of now
-  }
+  MemDB(CephContext *c, const std::string &path, void *p);
 
   ~MemDB() override;
   int set_merge_operator(const std::string& prefix,
@@ -153,26 +252,16 @@ public:
 
   class MDBWholeSpaceIteratorImpl : public KeyValueDB::WholeSpaceIteratorImpl {
 
-      mdb_iter_t m_iter;
+      MemDB *m_db;
+      uint64_t m_snap_seq;
+      Node *m_node = nullptr;
       std::pair<std::string, ceph::bufferlist> m_key_value;
-      mdb_map_t *m_map_p;
-      std::mutex *m_map_lock_p;
-      uint64_t *global_seq_no;
-      uint64_t this_seq_no;
-      bool m_using_btree;
 
   public:
-    MDBWholeSpaceIteratorImpl(mdb_map_t *btree_p, std::mutex *btree_lock_p,
-                              uint64_t *iterator_seq_no, bool using_btree) {
-      m_map_p = btree_p;
-      m_map_lock_p = btree_lock_p;
-      std::lock_guard<std::mutex> l(*m_map_lock_p);
-      global_seq_no = iterator_seq_no;
-      this_seq_no = *iterator_seq_no;
-      m_using_btree = using_btree;
-    }
+    explicit MDBWholeSpaceIteratorImpl(MemDB *db)
+      : m_db(db), m_snap_seq(db->_pin_snapshot()) {}
 
-    void fill_current();
+    void fill_current(Node *n, const Version *v);
     void free_last();
 
 
@@ -185,7 +274,6 @@ public:
     int upper_bound(const std::string &prefix, const std::string &after) override;
     int lower_bound(const std::string &prefix, const std::string &to) override;
     bool valid() override;
-    bool iterator_validate();
 
     int next() override;
     int prev() override;
@@ -199,12 +287,10 @@ public:
   };
 
   uint64_t get_estimated_size(std::map<std::string,uint64_t> &extra) override {
-      std::lock_guard<std::mutex> l(m_lock);
       return m_allocated_bytes;
   };
 
   int get_statfs(struct store_statfs_t *buf) override {
-    std::lock_guard<std::mutex> l(m_lock);
     buf->reset();
     buf->total = m_total_bytes;
     buf->allocated = m_allocated_bytes;
@@ -214,7 +300,7 @@ public:
 
   WholeSpaceIterator get_wholespace_iterator(IteratorOpts opts = 0) override {
     return std::shared_ptr<KeyValueDB::WholeSpaceIteratorImpl>(
-      new MDBWholeSpaceIteratorImpl(&m_map, &m_lock, &iterator_seq_no, m_using_btree));
+      new MDBWholeSpaceIteratorImpl(this));
   }
 };
 
@@ -19,7 +19,10 @@
 #include "rocksdb/filter_policy.h"
 #include "rocksdb/utilities/convenience.h"
 #include "rocksdb/merge_operator.h"
+#include "rocksdb/slice_transform.h"
+#include "rocksdb/version.h"
 
+#include "common/admin_socket.h"
 #include "common/perf_counters.h"
 #include "common/PriorityCache.h"
 #include "include/common_fwd.h"
@@ -459,6 +462,10 @@ std::shared_ptr<rocksdb::Cache> RocksDBStore::create_block_cache(
   auto shard_bits = cct->_conf->rocksdb_cache_shard_bits;
   if (cache_type == "binned_lru") {
     cache = rocksdb_cache::NewBinnedLRUCache(cct, cache_size, shard_bits, false, cache_prio_high);
+  } else if (cache_type == "binned_clock") {
+    cache = rocksdb_cache::NewBinnedClockCache(
+      cct, cache_size, shard_bits, false, cache_prio_high,
+      cct->_conf.get_val<Option::size_t>("rocksdb_cache_binned_clock_entry_charge"));
   } else if (cache_type == "lru") {
     cache = rocksdb::NewLRUCache(cache_size, shard_bits);
   } else if (cache_type == "clock") {
@@ -616,6 +623,24 @@ void RocksDBStore::add_column_family(const std::string& cf_name, uint32_t hash_l
     column.handles.resize(shard_idx + 1);
   column.handles[shard_idx] = handle;
   cf_ids_to_prefix.emplace(handle->GetID(), cf_name);
+  if (db->GetOptions(handle).prefix_extractor) {
+    cf_ids_with_prefix_extractor.insert(handle->GetID());
+  }
+}
+
+// Bounded iterators on columns with a prefix extractor can consult their
+// prefix blooms when the bounds stay within one prefix.  auto_prefix_mode
+// is left alone everywhere else: it buys nothing without an extractor, and
+// RocksDB before 7.0 could miss keys with it.
+void RocksDBStore::set_auto_prefix_mode(rocksdb::ColumnFamilyHandle *cf,
+					rocksdb::ReadOptions &options) const
+{
+#if (ROCKSDB_MAJOR >= 7)
+  if (options.iterate_upper_bound &&
+      cf_ids_with_prefix_extractor.count(cf->GetID())) {
+    options.auto_prefix_mode = true;
+  }
+#endif
 }
 
 bool RocksDBStore::is_column_family(const std::string& prefix) {
@@ -899,6 +924,9 @@ int RocksDBStore::split_column_family_options(const std::string& options,
 // Allowed options are exactly the same as allowed for column families in RocksDB.
 // Ceph addition is "block_cache" option that is translated to block_cache and
 // allows to specialize separate block cache for O column family.
+// Another one is "bloom_bits", bits per key of the column's bloom filter
+// (0 disables it); together with RocksDB's own "prefix_extractor" it lets
+// e.g. omap columns use prefix blooms while the rest keep whole key filters.
 //
 // base_name - name of column without shard suffix: "-"+number
 // options - additional options to apply
@@ -916,6 +944,11 @@ int RocksDBStore::update_column_family_options(const std::string& base_name,
 	    << " options=" << more_options << dendl;
     return r;
   }
+  std::string bloom_bits_opt;
+  if (auto it = options_map.find("bloom_bits"); it != options_map.end()) {
+    bloom_bits_opt = it->second;
+    options_map.erase(it);
+  }
   status = rocksdb::GetColumnFamilyOptionsFromMap(*cf_opt, options_map, cf_opt);
   if (!status.ok()) {
     dout(5) << __func__ << " invalid column family optionsp; column family="
@@ -934,6 +967,52 @@ int RocksDBStore::update_column_family_options(const std::string& base_name,
       return r;
     }
   }
+  if (!bloom_bits_opt.empty()) {
+    r = apply_bloom_options(base_name, bloom_bits_opt, cf_opt);
+    if (r != 0) {
+      return r;
+    }
+  }
+  return 0;
+}
+
+int RocksDBStore::apply_bloom_options(const std::string& column_name,
+				      const std::string& bloom_bits_opt,
+				      rocksdb::ColumnFamilyOptions* cf_opt)
+{
+  std::string error;
+  int bloom_bits = strict_strtol(bloom_bits_opt.c_str(), 10, &error);
+  if (!error.empty() || bloom_bits < 0) {
+    dout(5) << __func__ << " invalid bloom_bits; column=" << column_name
+	    << " bloom_bits=" << bloom_bits_opt << dendl;
+    return -EINVAL;
+  }
+  // cf_bbt_opts only holds columns with a block cache of their own, the
+  // cache autotuner relies on that; others get a private copy of bbt_opts
+  rocksdb::BlockBasedTableOptions column_bbt_opts = bbt_opts;
+  auto it = cf_bbt_opts.find(column_name);
+  if (it != cf_bbt_opts.end()) {
+    column_bbt_opts = it->second;
+  }
+  if (column_bbt_opts.no_block_cache) {
+    dout(5) << __func__ << " bloom_bits require a block cache; column="
+	    << column_name << dendl;
+    return -EINVAL;
+  }
+  if (bloom_bits > 0) {
+    column_bbt_opts.filter_policy.reset(rocksdb::NewBloomFilterPolicy(bloom_bits));
+  } else {
+    column_bbt_opts.filter_policy.reset();
+  }
+  dout(10) << __func__ << " column=" << column_name
+	   << " bloom_bits=" << bloom_bits
+	   << " prefix_extractor="
+	   << (cf_opt->prefix_extractor ? cf_opt->prefix_extractor->Name() : "none")
+	   << dendl;
+  if (it != cf_bbt_opts.end()) {
+    it->second = column_bbt_opts;
+  }
+  cf_opt->table_factory.reset(NewBlockBasedTableFactory(column_bbt_opts));
   return 0;
 }
 
@@ -1107,6 +1186,68 @@ std::ostream& operator<<(std::ostream& out, const RocksDBStore::ColumnFamily& cf
   return out;
 }
 
+class RocksDBStore::SocketHook : public AdminSocketHook {
+  RocksDBStore* store;
+public:
+  static RocksDBStore::SocketHook* create(RocksDBStore* store)
+  {
+    RocksDBStore::SocketHook* hook = nullptr;
+    AdminSocket* admin_socket = store->cct->get_admin_socket();
+    if (admin_socket) {
+      hook = new RocksDBStore::SocketHook(store);
+      int r = admin_socket->register_command("rocksdb heat map "
+                                             "name=key_prefix,type=CephString,req=false "
+                                             "name=top,type=CephInt,req=false",
+                                             hook,
+                                             "Dump the sampled reads and writes per "
+                                             "prefix and the hottest key ranges of "
+                                             "each prefix.");
+      if (r != 0) {
+        // another store of this process owns the commands
+        ldout(store->cct, 1) << __func__ << " cannot register SocketHook" << dendl;
+        delete hook;
+        hook = nullptr;
+      } else {
+        r = admin_socket->register_command("rocksdb heat map reset",
+                                           hook,
+                                           "Forget the sampled accesses.");
+        ceph_assert(r == 0);
+      }
+    }
+    return hook;
+  }
+
+  ~SocketHook() {
+    AdminSocket* admin_socket = store->cct->get_admin_socket();
+    admin_socket->unregister_commands(this);
+  }
+private:
+  SocketHook(RocksDBStore* store) :
+    store(store) {}
+  int call(std::string_view command, const cmdmap_t& cmdmap,
+	   Formatter *f,
+	   std::ostream& errss,
+	   bufferlist& out) override {
+    if (command == "rocksdb heat map") {
+      string prefix;
+      int64_t top = 0;
+      cmd_getval(cmdmap, "key_prefix", prefix);
+      cmd_getval(cmdmap, "top", top);
+      if (top < 0) {
+	errss << "Invalid top:'" << top << "'" << std::endl;
+	return -EINVAL;
+      }
+      store->heat_map->dump(f, prefix, top);
+    } else if (command == "rocksdb heat map reset") {
+      store->heat_map->reset();
+    } else {
+      errss << "Invalid command" << std::endl;
+      return -ENOSYS;
+    }
+    return 0;
+  }
+};
+
 int RocksDBStore::do_open(ostream &out,
 			  bool create_if_missing,
 			  bool open_readonly,
@@ -1243,9 +1384,23 @@ int RocksDBStore::do_open(ostream &out,
   plb.add_time_avg(l_rocksdb_write_delay_time, "rocksdb_write_delay_time", "Rocksdb write delay time");
   plb.add_time_avg(l_rocksdb_write_pre_and_post_process_time, 
       "rocksdb_write_pre_and_post_time", "total time spent on writing a record, excluding write process");
+  plb.add_u64_counter(l_rocksdb_multi_get_keys, "multi_get_keys", "Keys looked up by batched gets");
+  plb.add_u64_counter(l_rocksdb_heat_map_reads, "heat_map_reads", "Reads sampled by the heat map");
+  plb.add_u64_counter(l_rocksdb_heat_map_writes, "heat_map_writes", "Writes sampled by the heat map");
+  plb.add_u64(l_rocksdb_heat_map_ranges, "heat_map_ranges", "Key ranges tracked by the heat map");
   logger = plb.create_perf_counters();
   cct->get_perfcounters_collection()->add(logger);
 
+  if (auto every = cct->_conf.get_val<uint64_t>("rocksdb_heat_map_sample_every");
+      every > 0) {
+    heat_map = std::make_unique<KeyValueHeatMap>(
+      every,
+      cct->_conf.get_val<uint64_t>("rocksdb_heat_map_key_bytes"),
+      cct->_conf.get_val<uint64_t>("rocksdb_heat_map_ranges"),
+      cct->_conf.get_val<std::chrono::seconds>("rocksdb_heat_map_half_life"));
+    asok_hook = SocketHook::create(this);
+  }
+
   if (compact_on_mount) {
     derr << "Compacting rocksdb store..." << dendl;
     compact();
@@ -1288,6 +1443,10 @@ void RocksDBStore::close()
     compact_queue_lock.unlock();
   }
 
+  delete asok_hook;
+  asok_hook = nullptr;
+  heat_map.reset();
+
   if (logger) {
     cct->get_perfcounters_collection()->remove(logger);
     delete logger;
@@ -1301,6 +1460,7 @@ void RocksDBStore::close()
     }
   }
   cf_handles.clear();
+  cf_ids_with_prefix_extractor.clear();
   if (must_close_default_cf) {
     db->DestroyColumnFamilyHandle(default_cf);
     must_close_default_cf = false;
@@ -1637,6 +1797,7 @@ void RocksDBStore::RocksDBTransactionImpl::set(
   const string &k,
   const bufferlist &to_set_bl)
 {
+  db->note_access(KeyValueHeatMap::WRITE, prefix, k, to_set_bl.length());
   auto cf = db->get_cf_handle(prefix, k);
   if (cf) {
     put_bat(bat, cf, k, to_set_bl);
@@ -1651,6 +1812,8 @@ void RocksDBStore::RocksDBTransactionImpl::set(
   const char *k, size_t keylen,
   const bufferlist &to_set_bl)
 {
+  db->note_access(KeyValueHeatMap::WRITE, prefix, std::string_view(k, keylen),
+		  to_set_bl.length());
   auto cf = db->get_cf_handle(prefix, k, keylen);
   if (cf) {
     string key(k, keylen);  // fixme?
@@ -1665,6 +1828,7 @@ void RocksDBStore::RocksDBTransactionImpl::set(
 void RocksDBStore::RocksDBTransactionImpl::rmkey(const string &prefix,
 					         const string &k)
 {
+  db->note_access(KeyValueHeatMap::WRITE, prefix, k, 0);
   auto cf = db->get_cf_handle(prefix, k);
   if (cf) {
     bat.Delete(cf, rocksdb::Slice(k));
@@ -1677,6 +1841,7 @@ void RocksDBStore::RocksDBTransactionImpl::rmkey(const string &prefix,
 					         const char *k,
 						 size_t keylen)
 {
+  db->note_access(KeyValueHeatMap::WRITE, prefix, std::string_view(k, keylen), 0);
   auto cf = db->get_cf_handle(prefix, k, keylen);
   if (cf) {
     bat.Delete(cf, rocksdb::Slice(k, keylen));
@@ -1690,6 +1855,7 @@ void RocksDBStore::RocksDBTransactionImpl::rmkey(const string &prefix,
 void RocksDBStore::RocksDBTransactionImpl::rm_single_key(const string &prefix,
 					                 const string &k)
 {
+  db->note_access(KeyValueHeatMap::WRITE, prefix, k, 0);
   auto cf = db->get_cf_handle(prefix, k);
   if (cf) {
     bat.SingleDelete(cf, k);
@@ -1700,6 +1866,7 @@ void RocksDBStore::RocksDBTransactionImpl::rm_single_key(const string &prefix,
 
 void RocksDBStore::RocksDBTransactionImpl::rmkeys_by_prefix(const string &prefix)
 {
+  db->note_access(KeyValueHeatMap::WRITE, prefix, {}, 0);
   auto p_iter = db->cf_handles.find(prefix);
   if (p_iter == db->cf_handles.end()) {
     uint64_t cnt = db->delete_range_threshold;
@@ -1742,6 +1909,7 @@ void RocksDBStore::RocksDBTransactionImpl::rm_range_keys(const string &prefix,
                                                          const string &start,
                                                          const string &end)
 {
+  db->note_access(KeyValueHeatMap::WRITE, prefix, start, 0);
   auto p_iter = db->cf_handles.find(prefix);
   if (p_iter == db->cf_handles.end()) {
     uint64_t cnt = db->delete_range_threshold;
@@ -1788,6 +1956,7 @@ void RocksDBStore::RocksDBTransactionImpl::merge(
   const string &k,
   const bufferlist &to_set_bl)
 {
+  db->note_access(KeyValueHeatMap::WRITE, prefix, k, to_set_bl.length());
   auto cf = db->get_cf_handle(prefix, k);
   if (cf) {
     // bufferlist::c_str() is non-constant, so we can't call c_str()
@@ -1828,39 +1997,63 @@ int RocksDBStore::get(
     const std::set<string> &keys,
     std::map<string, bufferlist> *out)
 {
-  rocksdb::PinnableSlice value;
+  if (keys.empty()) {
+    return 0;
+  }
   utime_t start = ceph_clock_now();
+  // one MultiGet call reads every key from the same implicit snapshot and
+  // lets rocksdb batch the block lookups (and issue them in parallel when
+  // the env supports it) instead of walking the LSM tree once per key
+  const size_t num_keys = keys.size();
+  std::vector<rocksdb::ColumnFamilyHandle*> cfs(num_keys);
+  std::vector<rocksdb::Slice> key_slices(num_keys);
+  std::vector<rocksdb::PinnableSlice> values(num_keys);
+  std::vector<rocksdb::Status> statuses(num_keys);
+  std::vector<string> combined;
+  bool sorted_input = true;
   if (cf_handles.count(prefix) > 0) {
+    size_t i = 0;
     for (auto& key : keys) {
-      auto cf_handle = get_cf_handle(prefix, key);
-      auto status = db->Get(rocksdb::ReadOptions(),
-			    cf_handle,
-			    rocksdb::Slice(key),
-			    &value);
-      if (status.ok()) {
-	(*out)[key].append(value.data(), value.size());
-      } else if (status.IsIOError()) {
-	ceph_abort_msg(status.getState());
-      }
-      value.Reset();
+      cfs[i] = get_cf_handle(prefix, key);
+      // keys are only sorted within a shard, let rocksdb order them when
+      // they hash to different column families
+      if (cfs[i] != cfs[0]) {
+	sorted_input = false;
+      }
+      key_slices[i] = rocksdb::Slice(key);
+      ++i;
     }
   } else {
+    combined.reserve(num_keys);
+    size_t i = 0;
     for (auto& key : keys) {
-      string k = combine_strings(prefix, key);
-      auto status = db->Get(rocksdb::ReadOptions(),
-			    default_cf,
-			    rocksdb::Slice(k),
-			    &value);
-      if (status.ok()) {
-	(*out)[key].append(value.data(), value.size());
-      } else if (status.IsIOError()) {
-	ceph_abort_msg(status.getState());
-      }
-      value.Reset();
-    }
+      cfs[i] = default_cf;
+      combined.emplace_back(combine_strings(prefix, key));
+      key_slices[i] = rocksdb::Slice(combined.back());
+      ++i;
+    }
+  }
+  db->MultiGet(rocksdb::ReadOptions(),
+	       num_keys,
+	       cfs.data(),
+	       key_slices.data(),
+	       values.data(),
+	       statuses.data(),
+	       sorted_input);
+  size_t i = 0;
+  for (auto& key : keys) {
+    auto& status = statuses[i];
+    note_access(KeyValueHeatMap::READ, prefix, key, values[i].size());
+    if (status.ok()) {
+      (*out)[key].append(values[i].data(), values[i].size());
+    } else if (status.IsIOError()) {
+      ceph_abort_msg(status.getState());
+    }
+    ++i;
   }
   utime_t lat = ceph_clock_now() - start;
   logger->tinc(l_rocksdb_get_latency, lat);
+  logger->inc(l_rocksdb_multi_get_keys, num_keys);
   return 0;
 }
 
@@ -1887,6 +2080,7 @@ int RocksDBStore::get(
 		rocksdb::Slice(k),
 		&value);
   }
+  note_access(KeyValueHeatMap::READ, prefix, key, value.size());
   if (s.ok()) {
     out->append(value.data(), value.size());
   } else if (s.IsNotFound()) {
@@ -1924,6 +2118,8 @@ int RocksDBStore::get(
 		rocksdb::Slice(k),
 		&value);
   }
+  note_access(KeyValueHeatMap::READ, prefix, std::string_view(key, keylen),
+	      value.size());
   if (s.ok()) {
     out->append(value.data(), value.size());
   } else if (s.IsNotFound()) {
@@ -2247,6 +2443,7 @@ public:
           options.iterate_upper_bound = &iterate_upper_bound;
         }
       }
+      db->set_auto_prefix_mode(cf, options);
       dbiter = db->db->NewIterator(options, cf);
   }
   ~CFIteratorImpl() {
@@ -2777,8 +2974,19 @@ private:
     }
   };
 
+  // iters is kept as a heap with the smallest key (or, when all of them
+  // are exhausted, any invalid iterator) at iters[0], so that advancing
+  // the merged iterator costs O(log shards) instead of a linear bubble
+  struct KeyGreater {
+    KeyLess keyless;
+    bool operator()(rocksdb::Iterator* a, rocksdb::Iterator* b) const {
+      return keyless(b, a);
+    }
+  };
+
   const RocksDBStore* db;
   KeyLess keyless;
+  KeyGreater keygreater;
   string prefix;
   const KeyValueDB::IteratorBounds bounds;
   const rocksdb::Slice iterate_lower_bound;
@@ -2789,7 +2997,7 @@ public:
 				  const std::string& prefix,
 				  const std::vector<rocksdb::ColumnFamilyHandle*>& shards,
                   KeyValueDB::IteratorBounds bounds_)
-    : db(db), keyless(db->comparator), prefix(prefix), bounds(std::move(bounds_)),
+    : db(db), keyless(db->comparator), keygreater{keyless}, prefix(prefix), bounds(std::move(bounds_)),
       iterate_lower_bound(make_slice(bounds.lower_bound)),
       iterate_upper_bound(make_slice(bounds.upper_bound))
   {
@@ -2804,7 +3012,9 @@ public:
       }
     }
     for (auto& s : shards) {
-      iters.push_back(db->db->NewIterator(options, s));
+      auto shard_options = options;
+      db->set_auto_prefix_mode(s, shard_options);
+      iters.push_back(db->db->NewIterator(shard_options, s));
     }
   }
   ~ShardMergeIteratorImpl() {
@@ -2819,8 +3029,8 @@ public:
 	return -1;
       }
     }
-    //all iterators seeked, sort
-    std::sort(iters.begin(), iters.end(), keyless);
+    //all iterators seeked, order them
+    std::make_heap(iters.begin(), iters.end(), keygreater);
     return 0;
   }
   int seek_to_last() override {
@@ -2849,7 +3059,7 @@ public:
 	iters[i]->Next();
       }
     }
-    //no need to sort, as at most 1 iterator is valid now
+    //no need to reorder, as at most 1 iterator is valid now
     return 0;
   }
   int upper_bound(const string &after) override {
@@ -2863,7 +3073,7 @@ public:
 	return -1;
       }
     }
-    std::sort(iters.begin(), iters.end(), keyless);
+    std::make_heap(iters.begin(), iters.end(), keygreater);
     return 0;
   }
   int lower_bound(const string &to) override {
@@ -2874,7 +3084,7 @@ public:
 	return -1;
       }
     }
-    std::sort(iters.begin(), iters.end(), keyless);
+    std::make_heap(iters.begin(), iters.end(), keygreater);
     return 0;
   }
   int next() override {
@@ -2883,20 +3093,16 @@ public:
       iters[0]->Next();
       if (iters[0]->status().ok()) {
 	r = 0;
-	//bubble up
-	for (size_t i = 0; i < iters.size() - 1; i++) {
-	  if (keyless(iters[i], iters[i + 1])) {
-	    //matches, fixed
-	    break;
-	  }
-	  std::swap(iters[i], iters[i + 1]);
-	}
+	//pop_heap moves the advanced iterator to the back without
+	//comparing it, push_heap then sifts it to its new place
+	std::pop_heap(iters.begin(), iters.end(), keygreater);
+	std::push_heap(iters.begin(), iters.end(), keygreater);
       }
     }
     return r;
   }
-  // iters are sorted, so
-  // a[0] < b[0] < c[0] < d[0]
+  // iters[0] holds the smallest key, so
+  // a[0] < b[0], a[0] < c[0], a[0] < d[0]
   // a[0] > a[-1], a[0] > b[-1], a[0] > c[-1], a[0] > d[-1]
   // so, prev() will be one of:
   // a[-1], b[-1], c[-1], d[-1]
@@ -2906,7 +3112,7 @@ public:
   // 1. go prev() on each iterator we can
   // 2. select largest key from those iterators
   // 3. go next() on all iterators except (2)
-  // 4. sort
+  // 4. reorder
   int prev() override {
     std::vector<rocksdb::Iterator*> prev_done;
     //1
@@ -2944,14 +3150,10 @@ public:
       }
     }
     //4
-    //insert highest in the beginning, and shift values until we pick highest
-    //untouched rest is sorted - we just prev()/next() them
-    rocksdb::Iterator* hold = highest;
-    for (size_t i = 0; i < iters.size(); i++) {
-      std::swap(hold, iters[i]);
-      if (hold == highest) break;
-    }
-    ceph_assert(hold == highest);
+    //highest is now the smallest key of all, the rest went back to where
+    //they were; prev() is rare, so just rebuild the heap
+    std::make_heap(iters.begin(), iters.end(), keygreater);
+    ceph_assert(iters[0] == highest);
     return 0;
   }
   bool valid() override {
@@ -2977,6 +3179,10 @@ public:
 
 KeyValueDB::Iterator RocksDBStore::get_iterator(const std::string& prefix, IteratorOpts opts, IteratorBounds bounds)
 {
+  // a listing counts as one read of the range it starts in
+  note_access(KeyValueHeatMap::READ, prefix,
+	      bounds.lower_bound ? std::string_view(*bounds.lower_bound)
+				 : std::string_view(), 0);
   auto cf_it = cf_handles.find(prefix);
   if (cf_it != cf_handles.end()) {
     rocksdb::ColumnFamilyHandle* cf = nullptr;
@@ -3369,6 +3575,7 @@ int RocksDBStore::reshard(const std::string& new_sharding, const RocksDBStore::r
 
   auto close_column_handles = make_scope_guard([this] {
     cf_handles.clear();
+    cf_ids_with_prefix_extractor.clear();
     close();
   });
   columns_t to_process_columns;
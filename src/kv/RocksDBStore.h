@@ -6,6 +6,7 @@
 #include "include/types.h"
 #include "include/buffer_fwd.h"
 #include "KeyValueDB.h"
+#include "KeyValueHistogram.h"
 #include <set>
 #include <map>
 #include <string>
@@ -18,6 +19,7 @@
 #include "rocksdb/table.h"
 #include "rocksdb/db.h"
 #include "kv/rocksdb_cache/BinnedLRUCache.h"
+#include "kv/rocksdb_cache/BinnedClockCache.h"
 #include <errno.h>
 #include "common/errno.h"
 #include "common/dout.h"
@@ -42,6 +44,10 @@ enum {
   l_rocksdb_write_memtable_time,
   l_rocksdb_write_delay_time,
   l_rocksdb_write_pre_and_post_process_time,
+  l_rocksdb_multi_get_keys,
+  l_rocksdb_heat_map_reads,
+  l_rocksdb_heat_map_writes,
+  l_rocksdb_heat_map_ranges,
   l_rocksdb_last,
 };
 
@@ -90,6 +96,21 @@ class RocksDBStore : public KeyValueDB {
 
   uint64_t cache_size = 0;
   bool set_cache_flag = false;
+
+  /// sampled access accounting, null unless rocksdb_heat_map_sample_every
+  std::unique_ptr<KeyValueHeatMap> heat_map;
+  class SocketHook;
+  SocketHook* asok_hook = nullptr;
+  void note_access(KeyValueHeatMap::op_t op, const std::string& prefix,
+		   std::string_view key, size_t bytes) {
+    if (heat_map && heat_map->sample()) {
+      logger->set(l_rocksdb_heat_map_ranges,
+		  heat_map->record(op, prefix, key, bytes));
+      logger->inc(op == KeyValueHeatMap::READ ?
+		  l_rocksdb_heat_map_reads : l_rocksdb_heat_map_writes);
+    }
+  }
+
   friend class ShardMergeIteratorImpl;
   friend class CFIteratorImpl;
   friend class WholeMergeIteratorImpl;
@@ -123,10 +144,14 @@ private:
   };
   std::unordered_map<std::string, prefix_shards> cf_handles;
   std::unordered_map<uint32_t, std::string> cf_ids_to_prefix;
+  /// ids of column families configured with a prefix_extractor
+  std::set<uint32_t> cf_ids_with_prefix_extractor;
   std::unordered_map<std::string, rocksdb::BlockBasedTableOptions> cf_bbt_opts;
   
   void add_column_family(const std::string& cf_name, uint32_t hash_l, uint32_t hash_h,
 			 size_t shard_idx, rocksdb::ColumnFamilyHandle *handle);
+  void set_auto_prefix_mode(rocksdb::ColumnFamilyHandle *cf,
+			    rocksdb::ReadOptions &options) const;
   bool is_column_family(const std::string& prefix);
   std::string_view get_key_hash_view(const prefix_shards& shards, const char* key, const size_t keylen);
   rocksdb::ColumnFamilyHandle *get_key_cf(const prefix_shards& shards, const char* key, const size_t keylen);
@@ -168,6 +193,9 @@ private:
   int apply_block_cache_options(const std::string& column_name,
 				const std::string& block_cache_opt,
 				rocksdb::ColumnFamilyOptions* cf_opt);
+  int apply_bloom_options(const std::string& column_name,
+			  const std::string& bloom_bits_opt,
+			  rocksdb::ColumnFamilyOptions* cf_opt);
   int update_column_family_options(const std::string& base_name,
 				   const std::string& more_options,
 				   rocksdb::ColumnFamilyOptions* cf_opt);
@@ -0,0 +1,787 @@
+// Copyright (c) 2018-Present Red Hat Inc.  All rights reserved.
+//
+// Copyright (c) 2011-2018, Facebook, Inc.  All rights reserved.
+// This source code is licensed under both the GPLv2 and Apache 2.0 License
+//
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef __STDC_FORMAT_MACROS
+#define __STDC_FORMAT_MACROS
+#endif
+
+#include "BinnedClockCache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+#define dout_context cct
+#define dout_subsys ceph_subsys_rocksdb
+#undef dout_prefix
+#define dout_prefix *_dout << "rocksdb: "
+
+namespace rocksdb_cache {
+
+namespace {
+// share of the table slots that may be occupied before inserts evict by
+// occupancy; keeps probe sequences short
+constexpr double LOAD_FACTOR = 0.7;
+// clock countdowns: a new low priority entry survives one sweep, a hit
+// buys it another one; high priority entries start and stay at the top
+constexpr uint8_t CLOCK_LOW_INSERT = 1;
+constexpr uint8_t CLOCK_LOW_HIT = 2;
+constexpr uint8_t CLOCK_HIGH = 3;
+constexpr size_t MIN_TABLE_SIZE = 256;
+}
+
+using H = BinnedClockHandle;
+
+BinnedClockCacheShard::BinnedClockCacheShard(CephContext *c, size_t capacity,
+                                             bool strict_capacity_limit,
+                                             double high_pri_pool_ratio,
+                                             size_t table_size,
+                                             PerfCounters *logger,
+                                             std::atomic<bool> *table_full_logged)
+    : cct(c),
+      logger(logger),
+      table_full_logged(table_full_logged),
+      table_(new BinnedClockHandle[table_size]),
+      table_mask_(table_size - 1),
+      occupancy_limit_(std::max<size_t>(1, table_size * LOAD_FACTOR)),
+      capacity_(0),
+      strict_capacity_limit_(strict_capacity_limit),
+      high_pri_pool_ratio_(high_pri_pool_ratio),
+      high_pri_pool_capacity_(0) {
+  ceph_assert((table_size & table_mask_) == 0);
+  for (auto& bin : age_bins) {
+    bin.store(0, std::memory_order_relaxed);
+  }
+  SetCapacity(capacity);
+}
+
+BinnedClockCacheShard::~BinnedClockCacheShard() {
+  for (size_t i = 0; i <= table_mask_; i++) {
+    BinnedClockHandle* h = &table_[i];
+    // invisible entries still referenced at this point are leaked handles,
+    // leave them alone like the LRU cache does
+    if (H::state_of(h->meta.load(std::memory_order_acquire)) == H::STATE_VISIBLE) {
+      Dispose(Freed{h->deleter, h->key_data, h->key_length, h->value});
+    }
+  }
+  delete[] table_;
+}
+
+BinnedClockHandle* BinnedClockCacheShard::FindVisible(const rocksdb::Slice& key,
+                                                      uint32_t hash) {
+  size_t idx = hash & table_mask_;
+  for (size_t probes = 0; probes <= table_mask_; probes++) {
+    BinnedClockHandle* h = &table_[idx];
+    uint64_t meta = h->meta.load(std::memory_order_acquire);
+    if (H::state_of(meta) == H::STATE_VISIBLE &&
+        h->hash.load(std::memory_order_relaxed) == hash &&
+        TryRef(h, key, hash)) {
+      return h;
+    }
+    // no entry went past this slot, so the key can't be further away
+    if (h->displacements.load(std::memory_order_acquire) == 0) {
+      break;
+    }
+    idx = (idx + 1) & table_mask_;
+  }
+  return nullptr;
+}
+
+bool BinnedClockCacheShard::TryRef(BinnedClockHandle* h,
+                                   const rocksdb::Slice& key, uint32_t hash) {
+  // speculative: the slot may have changed since we looked at it, but it
+  // can't be reclaimed while we hold this reference
+  uint64_t old = h->meta.fetch_add(1, std::memory_order_acq_rel);
+  if (H::state_of(old) == H::STATE_VISIBLE &&
+      h->hash.load(std::memory_order_relaxed) == hash &&
+      h->key() == key) {
+    return true;
+  }
+  Unref(h);
+  return false;
+}
+
+bool BinnedClockCacheShard::Unref(BinnedClockHandle* h,
+                                  ceph::autovector<Freed>* freed) {
+  uint64_t old = h->meta.fetch_sub(1, std::memory_order_acq_rel);
+  ceph_assert(H::refs_of(old) > 0);
+  if (H::refs_of(old) == 1 && H::state_of(old) == H::STATE_INVISIBLE) {
+    Freed f;
+    if (TryFreeInvisible(h, &f)) {
+      if (freed) {
+        freed->push_back(f);
+      } else {
+        Dispose(f);
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+void BinnedClockCacheShard::MakeInvisible(BinnedClockHandle* h) {
+  uint64_t meta = h->meta.load(std::memory_order_acquire);
+  while (H::state_of(meta) == H::STATE_VISIBLE &&
+         !h->meta.compare_exchange_weak(meta,
+                                        H::with_state(meta, H::STATE_INVISIBLE),
+                                        std::memory_order_acq_rel)) {
+  }
+}
+
+bool BinnedClockCacheShard::TryFreeInvisible(BinnedClockHandle* h, Freed* freed) {
+  // whoever sees the entry invisible and unreferenced first gets to free it
+  uint64_t expected = H::STATE_INVISIBLE << H::STATE_SHIFT;
+  if (!h->meta.compare_exchange_strong(expected,
+                                       H::STATE_CONSTRUCTION << H::STATE_SHIFT,
+                                       std::memory_order_acq_rel)) {
+    return false;
+  }
+  *freed = Remove(h);
+  return true;
+}
+
+BinnedClockCacheShard::Freed BinnedClockCacheShard::Remove(BinnedClockHandle* h) {
+  usage_.fetch_sub(h->charge, std::memory_order_relaxed);
+  if (h->high_pri) {
+    high_pri_pool_usage_.fetch_sub(h->charge, std::memory_order_relaxed);
+  } else {
+    bin_add(h->epoch.load(std::memory_order_relaxed), -(int64_t)h->charge);
+  }
+  Freed f{h->deleter, h->key_data, h->key_length, h->value};
+  h->deleter = nullptr;
+  h->key_data = nullptr;
+  h->value = nullptr;
+
+  // unlink from the probe sequence of its key
+  size_t idx = h - table_;
+  for (size_t i = h->hash.load(std::memory_order_relaxed) & table_mask_;
+       i != idx;
+       i = (i + 1) & table_mask_) {
+    table_[i].displacements.fetch_sub(1, std::memory_order_release);
+  }
+  // CONSTRUCTION -> EMPTY, keeping transient references of lookups
+  h->meta.fetch_and(~H::STATE_MASK, std::memory_order_release);
+  occupancy_.fetch_sub(1, std::memory_order_relaxed);
+  return f;
+}
+
+void BinnedClockCacheShard::Dispose(const Freed& f) {
+  if (f.deleter) {
+    (*f.deleter)(rocksdb::Slice(f.key_data, f.key_length), f.value);
+  }
+  delete[] f.key_data;
+}
+
+void BinnedClockCacheShard::bin_add(uint32_t epoch, int64_t bytes) {
+  uint32_t cur = epoch_.load(std::memory_order_acquire);
+  if (cur - epoch >= MAX_AGE_BINS) {
+    // its bin has been recycled, the bytes aren't accounted anymore
+    return;
+  }
+  age_bins[epoch & (MAX_AGE_BINS - 1)].fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void BinnedClockCacheShard::touch(BinnedClockHandle* h) {
+  uint8_t target = h->high_pri ? CLOCK_HIGH : CLOCK_LOW_HIT;
+  if (h->clock.load(std::memory_order_relaxed) < target) {
+    h->clock.store(target, std::memory_order_relaxed);
+  }
+  if (!h->high_pri) {
+    uint32_t cur = epoch_.load(std::memory_order_relaxed);
+    uint32_t old = h->epoch.load(std::memory_order_relaxed);
+    if (old != cur &&
+        h->epoch.compare_exchange_strong(old, cur, std::memory_order_relaxed)) {
+      bin_add(old, -(int64_t)h->charge);
+      bin_add(cur, h->charge);
+    }
+  }
+}
+
+void BinnedClockCacheShard::Evict(size_t charge, ceph::autovector<Freed>* freed) {
+  const size_t capacity = capacity_.load(std::memory_order_relaxed);
+  // stop once a whole turn of the hand found nothing to age or evict,
+  // i.e. everything left is pinned
+  size_t idle = 0;
+  while ((usage_.load(std::memory_order_relaxed) + charge > capacity ||
+          occupancy_.load(std::memory_order_relaxed) >= occupancy_limit_) &&
+         idle <= table_mask_) {
+    BinnedClockHandle* h = &table_[clock_hand_++ & table_mask_];
+    uint64_t meta = h->meta.load(std::memory_order_acquire);
+    if (H::state_of(meta) != H::STATE_VISIBLE || H::refs_of(meta) != 0) {
+      ++idle;
+      continue;
+    }
+    uint8_t clock = h->clock.load(std::memory_order_relaxed);
+    if (clock > 0) {
+      // high priority entries only age once they exceed their share
+      if (h->high_pri &&
+          high_pri_pool_usage_.load(std::memory_order_relaxed) <= high_pri_pool_capacity_) {
+        ++idle;
+        continue;
+      }
+      h->clock.store(clock - 1, std::memory_order_relaxed);
+      idle = 0;
+      continue;
+    }
+    if (h->meta.compare_exchange_strong(meta,
+                                        H::with_state(meta, H::STATE_CONSTRUCTION),
+                                        std::memory_order_acq_rel)) {
+      bool by_occupancy = usage_.load(std::memory_order_relaxed) + charge <= capacity;
+      freed->push_back(Remove(h));
+      if (by_occupancy) {
+        logger->inc(l_binned_clock_occupancy_evictions);
+        TableFull();
+      }
+      idle = 0;
+    } else {
+      ++idle;
+    }
+  }
+}
+
+void BinnedClockCacheShard::TableFull() {
+  if (!table_full_logged->exchange(true, std::memory_order_relaxed)) {
+    ldout(cct, 1) << "BinnedClockCache: table of " << table_mask_ + 1
+                  << " slots per shard is full with "
+                  << usage_.load(std::memory_order_relaxed) << " of "
+                  << capacity_.load(std::memory_order_relaxed)
+                  << " bytes in use, evicting by occupancy; entries are"
+                  << " smaller than rocksdb_cache_binned_clock_entry_charge"
+                  << " or the cache grew past the table" << dendl;
+  }
+}
+
+void BinnedClockCacheShard::EraseUnRefEntries() {
+  ceph::autovector<Freed> freed;
+  {
+    std::lock_guard<std::mutex> l(mutex_);
+    for (size_t i = 0; i <= table_mask_; i++) {
+      BinnedClockHandle* h = &table_[i];
+      uint64_t meta = h->meta.load(std::memory_order_acquire);
+      if (H::state_of(meta) == H::STATE_VISIBLE && H::refs_of(meta) == 0 &&
+          h->meta.compare_exchange_strong(meta,
+                                          H::with_state(meta, H::STATE_CONSTRUCTION),
+                                          std::memory_order_acq_rel)) {
+        freed.push_back(Remove(h));
+      }
+    }
+  }
+  for (auto& f : freed) {
+    Dispose(f);
+  }
+}
+
+void BinnedClockCacheShard::ApplyToAllCacheEntries(
+  const std::function<void(const rocksdb::Slice& key,
+                           void* value,
+                           size_t charge,
+                           DeleterFn)>& callback,
+  bool thread_safe)
+{
+  // a reference pins the entry, there is no need for the mutex
+  for (size_t i = 0; i <= table_mask_; i++) {
+    BinnedClockHandle* h = &table_[i];
+    if (H::state_of(h->meta.load(std::memory_order_acquire)) != H::STATE_VISIBLE) {
+      continue;
+    }
+    uint64_t old = h->meta.fetch_add(1, std::memory_order_acq_rel);
+    if (H::state_of(old) == H::STATE_VISIBLE) {
+      callback(h->key(), h->value, h->charge, h->deleter);
+    }
+    Unref(h);
+  }
+}
+
+size_t BinnedClockCacheShard::TEST_GetOccupancy() const {
+  return occupancy_.load(std::memory_order_relaxed);
+}
+
+double BinnedClockCacheShard::GetHighPriPoolRatio() const {
+  std::lock_guard<std::mutex> l(mutex_);
+  return high_pri_pool_ratio_;
+}
+
+size_t BinnedClockCacheShard::GetHighPriPoolUsage() const {
+  return high_pri_pool_usage_.load(std::memory_order_relaxed);
+}
+
+uint64_t BinnedClockCacheShard::sum_bins(uint32_t start, uint32_t end) const {
+  uint32_t cur = epoch_.load(std::memory_order_acquire);
+  end = std::min(end, bin_count_.load(std::memory_order_relaxed));
+  uint64_t bytes = 0;
+  for (auto i = start; i < end; i++) {
+    // counters can transiently go negative while an entry moves bins
+    int64_t b = age_bins[(cur - i) & (MAX_AGE_BINS - 1)].load(std::memory_order_relaxed);
+    if (b > 0) {
+      bytes += b;
+    }
+  }
+  return bytes;
+}
+
+void BinnedClockCacheShard::SetCapacity(size_t capacity) {
+  ceph::autovector<Freed> freed;
+  {
+    std::lock_guard<std::mutex> l(mutex_);
+    capacity_.store(capacity, std::memory_order_relaxed);
+    high_pri_pool_capacity_ = capacity * high_pri_pool_ratio_;
+    Evict(0, &freed);
+  }
+  // we free the entries here outside of mutex for
+  // performance reasons
+  for (auto& f : freed) {
+    Dispose(f);
+  }
+}
+
+void BinnedClockCacheShard::SetStrictCapacityLimit(bool strict_capacity_limit) {
+  strict_capacity_limit_.store(strict_capacity_limit, std::memory_order_relaxed);
+}
+
+rocksdb::Cache::Handle* BinnedClockCacheShard::Lookup(const rocksdb::Slice& key, uint32_t hash) {
+  BinnedClockHandle* h = FindVisible(key, hash);
+  if (h != nullptr) {
+    touch(h);
+  }
+  return reinterpret_cast<rocksdb::Cache::Handle*>(h);
+}
+
+bool BinnedClockCacheShard::Ref(rocksdb::Cache::Handle* handle) {
+  BinnedClockHandle* h = reinterpret_cast<BinnedClockHandle*>(handle);
+  // the caller already holds a reference, so the slot can't go away
+  h->meta.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+void BinnedClockCacheShard::SetHighPriPoolRatio(double high_pri_pool_ratio) {
+  std::lock_guard<std::mutex> l(mutex_);
+  high_pri_pool_ratio_ = high_pri_pool_ratio;
+  high_pri_pool_capacity_ = capacity_.load(std::memory_order_relaxed) * high_pri_pool_ratio_;
+}
+
+bool BinnedClockCacheShard::Release(rocksdb::Cache::Handle* handle, bool force_erase) {
+  if (handle == nullptr) {
+    return false;
+  }
+  BinnedClockHandle* h = reinterpret_cast<BinnedClockHandle*>(handle);
+  if (force_erase ||
+      usage_.load(std::memory_order_relaxed) > capacity_.load(std::memory_order_relaxed)) {
+    // as the LRU cache does, drop the entry if we hold the last reference
+    // rather than leave the cache over its capacity
+    uint64_t meta = h->meta.load(std::memory_order_acquire);
+    while (H::state_of(meta) == H::STATE_VISIBLE && H::refs_of(meta) == 1 &&
+           !h->meta.compare_exchange_weak(meta,
+                                          H::with_state(meta, H::STATE_INVISIBLE),
+                                          std::memory_order_acq_rel)) {
+    }
+  }
+  return Unref(h);
+}
+
+rocksdb::Status BinnedClockCacheShard::Insert(const rocksdb::Slice& key, uint32_t hash, void* value,
+                                              size_t charge,
+                                              DeleterFn deleter,
+                                              rocksdb::Cache::Handle** handle,
+                                              rocksdb::Cache::Priority priority) {
+  rocksdb::Status s;
+  ceph::autovector<Freed> freed;
+  bool inserted = false;
+  char* key_data = new char[key.size()];
+  std::copy_n(key.data(), key.size(), key_data);
+
+  {
+    std::lock_guard<std::mutex> l(mutex_);
+    // Free the space following the clock until enough space
+    // is freed or everything left is pinned
+    Evict(charge, &freed);
+
+    bool table_full = occupancy_.load(std::memory_order_relaxed) >= occupancy_limit_;
+    bool over_capacity = usage_.load(std::memory_order_relaxed) + charge >
+      capacity_.load(std::memory_order_relaxed);
+    if (table_full) {
+      logger->inc(l_binned_clock_table_full_inserts);
+      TableFull();
+    }
+    if (table_full ||
+        (over_capacity &&
+         (strict_capacity_limit_.load(std::memory_order_relaxed) || handle == nullptr))) {
+      if (handle != nullptr) {
+        *handle = nullptr;
+        s = rocksdb::Status::Incomplete("Insert failed due to CLOCK cache being full.");
+      }
+      // otherwise, don't insert the entry but still return ok, as if the
+      // entry inserted into cache and get evicted immediately.
+    } else {
+      // an existing entry with that key is replaced
+      if (BinnedClockHandle* old = FindVisible(key, hash); old != nullptr) {
+        MakeInvisible(old);
+        Unref(old, &freed);
+      }
+
+      BinnedClockHandle* h = nullptr;
+      size_t idx = hash & table_mask_;
+      for (size_t probes = 0; probes <= table_mask_ && h == nullptr; probes++) {
+        BinnedClockHandle* candidate = &table_[idx];
+        uint64_t meta = candidate->meta.load(std::memory_order_acquire);
+        while (H::state_of(meta) == H::STATE_EMPTY) {
+          if (candidate->meta.compare_exchange_weak(meta,
+                                                    H::with_state(meta, H::STATE_CONSTRUCTION),
+                                                    std::memory_order_acq_rel)) {
+            h = candidate;
+            break;
+          }
+        }
+        if (h == nullptr) {
+          // let lookups for this key go on past the occupied slot
+          candidate->displacements.fetch_add(1, std::memory_order_release);
+          idx = (idx + 1) & table_mask_;
+        }
+      }
+      // only we claim slots and occupancy is below the limit
+      ceph_assert(h != nullptr);
+      occupancy_.fetch_add(1, std::memory_order_relaxed);
+
+      h->hash.store(hash, std::memory_order_relaxed);
+      h->key_data = key_data;
+      h->key_length = key.size();
+      h->value = value;
+      h->deleter = deleter;
+      h->charge = charge;
+      h->high_pri = priority == rocksdb::Cache::Priority::HIGH;
+      h->clock.store(h->high_pri ? CLOCK_HIGH : CLOCK_LOW_INSERT,
+                     std::memory_order_relaxed);
+      h->epoch.store(epoch_.load(std::memory_order_relaxed),
+                     std::memory_order_relaxed);
+      usage_.fetch_add(charge, std::memory_order_relaxed);
+      if (h->high_pri) {
+        high_pri_pool_usage_.fetch_add(charge, std::memory_order_relaxed);
+      } else {
+        bin_add(h->epoch.load(std::memory_order_relaxed), charge);
+      }
+
+      // publish, with one reference for the returned handle
+      uint64_t meta = h->meta.load(std::memory_order_relaxed);
+      while (!h->meta.compare_exchange_weak(
+               meta,
+               H::with_state(meta, H::STATE_VISIBLE) + (handle != nullptr ? 1 : 0),
+               std::memory_order_release)) {
+      }
+      if (handle != nullptr) {
+        *handle = reinterpret_cast<rocksdb::Cache::Handle*>(h);
+      }
+      inserted = true;
+    }
+  }
+
+  // we free the entries here outside of mutex for
+  // performance reasons
+  for (auto& f : freed) {
+    Dispose(f);
+  }
+  if (!inserted) {
+    delete[] key_data;
+    if (handle == nullptr && deleter) {
+      (*deleter)(key, value);
+    }
+  }
+  return s;
+}
+
+void BinnedClockCacheShard::Erase(const rocksdb::Slice& key, uint32_t hash) {
+  BinnedClockHandle* h = FindVisible(key, hash);
+  if (h != nullptr) {
+    MakeInvisible(h);
+    Unref(h);
+  }
+}
+
+size_t BinnedClockCacheShard::GetUsage() const {
+  return usage_.load(std::memory_order_relaxed);
+}
+
+size_t BinnedClockCacheShard::GetPinnedUsage() const {
+  // not on any hot path, walk the table
+  auto self = const_cast<BinnedClockCacheShard*>(this);
+  size_t pinned = 0;
+  for (size_t i = 0; i <= table_mask_; i++) {
+    BinnedClockHandle* h = &table_[i];
+    uint64_t meta = h->meta.load(std::memory_order_acquire);
+    if (H::state_of(meta) < H::STATE_VISIBLE || H::refs_of(meta) == 0) {
+      continue;
+    }
+    uint64_t old = h->meta.fetch_add(1, std::memory_order_acq_rel);
+    if (H::state_of(old) >= H::STATE_VISIBLE && H::refs_of(old) > 0) {
+      pinned += h->charge;
+    }
+    self->Unref(h);
+  }
+  return pinned;
+}
+
+void BinnedClockCacheShard::shift_bins() {
+  std::lock_guard<std::mutex> l(mutex_);
+  uint32_t next = epoch_.load(std::memory_order_relaxed) + 1;
+  // recycle the oldest bin of the ring for the new epoch
+  age_bins[next & (MAX_AGE_BINS - 1)].store(0, std::memory_order_relaxed);
+  epoch_.store(next, std::memory_order_release);
+}
+
+uint32_t BinnedClockCacheShard::get_bin_count() const {
+  return bin_count_.load(std::memory_order_relaxed);
+}
+
+void BinnedClockCacheShard::set_bin_count(uint32_t count) {
+  if (count > MAX_AGE_BINS) {
+    ldout(cct, 1) << __func__ << " clamping bin count " << count
+                  << " to " << MAX_AGE_BINS << dendl;
+    count = MAX_AGE_BINS;
+  }
+  bin_count_.store(count, std::memory_order_relaxed);
+}
+
+std::string BinnedClockCacheShard::GetPrintableOptions() const {
+  const int kBufferSize = 200;
+  char buffer[kBufferSize];
+  {
+    std::lock_guard<std::mutex> l(mutex_);
+    snprintf(buffer, kBufferSize,
+             "    high_pri_pool_ratio: %.3lf\n    table_size: %zu\n",
+             high_pri_pool_ratio_, table_mask_ + 1);
+  }
+  return std::string(buffer);
+}
+
+DeleterFn BinnedClockCacheShard::GetDeleter(rocksdb::Cache::Handle* h) const
+{
+  auto* handle = reinterpret_cast<BinnedClockHandle*>(h);
+  return handle->deleter;
+}
+
+BinnedClockCache::BinnedClockCache(CephContext *c,
+                                   size_t capacity,
+                                   int num_shard_bits,
+                                   bool strict_capacity_limit,
+                                   double high_pri_pool_ratio,
+                                   size_t estimated_entry_charge)
+    : ShardedCache(capacity, num_shard_bits, strict_capacity_limit), cct(c) {
+  num_shards_ = 1 << num_shard_bits;
+  int rc = posix_memalign((void**) &shards_,
+                          CACHE_LINE_SIZE,
+                          sizeof(BinnedClockCacheShard) * num_shards_);
+  if (rc != 0) {
+    throw std::bad_alloc();
+  }
+  PerfCountersBuilder b(cct, "rocksdb_binned_clock_cache",
+                        l_binned_clock_first, l_binned_clock_last);
+  b.add_u64(l_binned_clock_table_slots, "table_slots",
+            "Slots in the hash tables of all shards");
+  b.add_u64_counter(l_binned_clock_occupancy_evictions, "occupancy_evictions",
+                    "Entries evicted because the table was full, not the cache");
+  b.add_u64_counter(l_binned_clock_table_full_inserts, "table_full_inserts",
+                    "Inserts that found the table full");
+  logger = b.create_perf_counters();
+  cct->get_perfcounters_collection()->add(logger);
+
+  size_t per_shard = (capacity + (num_shards_ - 1)) / num_shards_;
+  // the table can't grow, leave room for the autotuner doubling the cache
+  size_t slots = 2 * per_shard / std::max<size_t>(estimated_entry_charge, 1) /
+    LOAD_FACTOR;
+  size_t table_size = MIN_TABLE_SIZE;
+  while (table_size < slots) {
+    table_size <<= 1;
+  }
+  ldout(cct, 10) << __func__ << " " << num_shards_ << " shards of "
+                 << table_size << " slots" << dendl;
+  logger->set(l_binned_clock_table_slots, table_size * num_shards_);
+  for (int i = 0; i < num_shards_; i++) {
+    new (&shards_[i])
+        BinnedClockCacheShard(c, per_shard, strict_capacity_limit,
+                              high_pri_pool_ratio, table_size,
+                              logger, &table_full_logged);
+  }
+}
+
+BinnedClockCache::~BinnedClockCache() {
+  for (int i = 0; i < num_shards_; i++) {
+    shards_[i].~BinnedClockCacheShard();
+  }
+  aligned_free(shards_);
+  cct->get_perfcounters_collection()->remove(logger);
+  delete logger;
+}
+
+CacheShard* BinnedClockCache::GetShard(int shard) {
+  return reinterpret_cast<CacheShard*>(&shards_[shard]);
+}
+
+const CacheShard* BinnedClockCache::GetShard(int shard) const {
+  return reinterpret_cast<CacheShard*>(&shards_[shard]);
+}
+
+void* BinnedClockCache::Value(Handle* handle) {
+  return reinterpret_cast<const BinnedClockHandle*>(handle)->value;
+}
+
+size_t BinnedClockCache::GetCharge(Handle* handle) const {
+  return reinterpret_cast<const BinnedClockHandle*>(handle)->charge;
+}
+
+uint32_t BinnedClockCache::GetHash(Handle* handle) const {
+  return reinterpret_cast<const BinnedClockHandle*>(handle)->hash.load(
+    std::memory_order_relaxed);
+}
+
+void BinnedClockCache::DisownData() {
+// Do not drop data if compile with ASAN to suppress leak warning.
+#ifndef __SANITIZE_ADDRESS__
+  shards_ = nullptr;
+#endif  // !__SANITIZE_ADDRESS__
+}
+
+#if (ROCKSDB_MAJOR >= 6 && ROCKSDB_MINOR >= 22)
+DeleterFn BinnedClockCache::GetDeleter(Handle* handle) const
+{
+  return reinterpret_cast<const BinnedClockHandle*>(handle)->deleter;
+}
+#endif
+
+void BinnedClockCache::SetHighPriPoolRatio(double high_pri_pool_ratio) {
+  for (int i = 0; i < num_shards_; i++) {
+    shards_[i].SetHighPriPoolRatio(high_pri_pool_ratio);
+  }
+}
+
+double BinnedClockCache::GetHighPriPoolRatio() const {
+  double result = 0.0;
+  if (num_shards_ > 0) {
+    result = shards_[0].GetHighPriPoolRatio();
+  }
+  return result;
+}
+
+size_t BinnedClockCache::GetHighPriPoolUsage() const {
+  // We will not lock the cache when getting the usage from shards.
+  size_t usage = 0;
+  for (int s = 0; s < num_shards_; s++) {
+    usage += shards_[s].GetHighPriPoolUsage();
+  }
+  return usage;
+}
+
+// PriCache
+
+int64_t BinnedClockCache::request_cache_bytes(PriorityCache::Priority pri, uint64_t total_cache) const
+{
+  int64_t assigned = get_cache_bytes(pri);
+  int64_t request = 0;
+
+  switch(pri) {
+  // PRI0 is for rocksdb's high priority items (indexes/filters)
+  case PriorityCache::Priority::PRI0:
+    {
+      // Because we want the high pri cache to grow independently of the low
+      // pri cache, request a chunky allocation independent of the other
+      // priorities.
+      request = PriorityCache::get_chunk(GetHighPriPoolUsage(), total_cache);
+      break;
+    }
+  case PriorityCache::Priority::LAST:
+    {
+      auto max = get_bin_count();
+      request = GetUsage();
+      request -= GetHighPriPoolUsage();
+      request -= sum_bins(0, max);
+      break;
+    }
+  default:
+    {
+      ceph_assert(pri > 0 && pri < PriorityCache::Priority::LAST);
+      auto prev_pri = static_cast<PriorityCache::Priority>(pri - 1);
+      uint64_t start = get_bins(prev_pri);
+      uint64_t end = get_bins(pri);
+      request = sum_bins(start, end);
+      break;
+    }
+  }
+  request = (request > assigned) ? request - assigned : 0;
+  ldout(cct, 10) << __func__ << " Priority: " << static_cast<uint32_t>(pri)
+                 << " Request: " << request << dendl;
+  return request;
+}
+
+int64_t BinnedClockCache::commit_cache_size(uint64_t total_bytes)
+{
+  size_t old_bytes = GetCapacity();
+  int64_t new_bytes = PriorityCache::get_chunk(
+      get_cache_bytes(), total_bytes);
+  ldout(cct, 10) << __func__ << " old: " << old_bytes
+                 << " new: " << new_bytes << dendl;
+  SetCapacity((size_t) new_bytes);
+
+  double ratio = 0;
+  if (new_bytes > 0) {
+    int64_t pri0_bytes = get_cache_bytes(PriorityCache::Priority::PRI0);
+    ratio = (double) pri0_bytes / new_bytes;
+  }
+  ldout(cct, 5) << __func__ << " High Pri Pool Ratio set to " << ratio << dendl;
+  SetHighPriPoolRatio(ratio);
+  return new_bytes;
+}
+
+void BinnedClockCache::shift_bins() {
+  for (int s = 0; s < num_shards_; s++) {
+    shards_[s].shift_bins();
+  }
+}
+
+uint64_t BinnedClockCache::sum_bins(uint32_t start, uint32_t end) const {
+  uint64_t bytes = 0;
+  for (int s = 0; s < num_shards_; s++) {
+    bytes += shards_[s].sum_bins(start, end);
+  }
+  return bytes;
+}
+
+uint32_t BinnedClockCache::get_bin_count() const {
+  uint32_t result = 0;
+  if (num_shards_ > 0) {
+    result = shards_[0].get_bin_count();
+  }
+  return result;
+}
+
+void BinnedClockCache::set_bin_count(uint32_t count) {
+  for (int s = 0; s < num_shards_; s++) {
+    shards_[s].set_bin_count(count);
+  }
+}
+
+std::shared_ptr<rocksdb::Cache> NewBinnedClockCache(
+    CephContext *c,
+    size_t capacity,
+    int num_shard_bits,
+    bool strict_capacity_limit,
+    double high_pri_pool_ratio,
+    size_t estimated_entry_charge) {
+  if (num_shard_bits >= 20) {
+    return nullptr;  // the cache cannot be sharded into too many fine pieces
+  }
+  if (high_pri_pool_ratio < 0.0 || high_pri_pool_ratio > 1.0) {
+    // invalid high_pri_pool_ratio
+    return nullptr;
+  }
+  if (num_shard_bits < 0) {
+    num_shard_bits = GetDefaultCacheShardBits(capacity);
+  }
+  return std::make_shared<BinnedClockCache>(
+      c, capacity, num_shard_bits, strict_capacity_limit, high_pri_pool_ratio,
+      estimated_entry_charge);
+}
+
+}  // namespace rocksdb_cache
@@ -0,0 +1,307 @@
+// Copyright (c) 2018-Present Red Hat Inc.  All rights reserved.
+//
+// Copyright (c) 2011-2018, Facebook, Inc.  All rights reserved.
+// This source code is licensed under both the GPLv2 and Apache 2.0 License
+//
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef ROCKSDB_BINNED_CLOCK_CACHE
+#define ROCKSDB_BINNED_CLOCK_CACHE
+
+#include <atomic>
+#include <string>
+#include <mutex>
+
+#include "ShardedCache.h"
+#include "common/autovector.h"
+#include "common/dout.h"
+#include "common/perf_counters.h"
+#include "include/ceph_assert.h"
+#include "common/ceph_context.h"
+
+enum {
+  l_binned_clock_first = 34700,
+  l_binned_clock_table_slots,
+  l_binned_clock_occupancy_evictions,
+  l_binned_clock_table_full_inserts,
+  l_binned_clock_last,
+};
+
+namespace rocksdb_cache {
+
+// CLOCK cache implementation with a lock-free hit path
+//
+// Every shard keeps its entries in a fixed size, open addressed table of
+// BinnedClockHandle slots (the same idea as RocksDB's HyperClockCache).
+// The state of a slot and its reference count share a single atomic word,
+// so Lookup/Ref/Release only touch the slot they are interested in and
+// never take the shard mutex:
+//
+// - a lookup speculatively takes a reference on a candidate slot and only
+//   then checks that it is visible and holds the key; if not, it drops the
+//   reference again.
+// - a slot's payload is only (re)written while the slot is in the
+//   CONSTRUCTION state, and a slot only leaves VISIBLE or INVISIBLE for
+//   CONSTRUCTION when nobody holds a reference, so holding a reference
+//   keeps the payload stable.
+// - an erased entry becomes INVISIBLE, whoever drops its last reference
+//   frees it.
+//
+// Insert, eviction (the clock sweep) and EraseUnRefEntries still serialize
+// on the shard mutex; they are the miss path.
+//
+// Instead of moving entries in a list, a hit refreshes the entry's clock
+// countdown and, for low priority entries, moves its charge to the current
+// age bin.  Age bins are a ring of byte counters indexed by epoch and
+// shift_bins() starts a new epoch, which keeps the priority-bin accounting
+// PriorityCache relies on.  Counters are only updated with atomics, so an
+// entry touched while the bins shift may be charged to a neighbouring bin.
+//
+// The table does not grow: it is sized from the shard capacity and the
+// estimated entry charge, with headroom for the cache autotuner growing
+// the cache.  When the table is full, inserts evict by occupancy too; this
+// is logged once and counted in the occupancy_evictions and
+// table_full_inserts perf counters, as it means the cache holds less than
+// its capacity.
+
+std::shared_ptr<rocksdb::Cache> NewBinnedClockCache(
+    CephContext *c,
+    size_t capacity,
+    int num_shard_bits = -1,
+    bool strict_capacity_limit = false,
+    double high_pri_pool_ratio = 0.0,
+    size_t estimated_entry_charge = 4096);
+
+struct alignas(CACHE_LINE_SIZE) BinnedClockHandle {
+  // meta: [63:62] state, [31:0] references
+  static constexpr uint64_t REFS_MASK = 0xffffffffull;
+  static constexpr int STATE_SHIFT = 62;
+  static constexpr uint64_t STATE_MASK = 3ull << STATE_SHIFT;
+  enum : uint64_t {
+    STATE_EMPTY = 0,         ///< free slot
+    STATE_CONSTRUCTION = 1,  ///< exclusively owned by a writer
+    STATE_VISIBLE = 2,       ///< in the table, can be looked up
+    STATE_INVISIBLE = 3,     ///< erased or replaced, freed on last release
+  };
+  static uint64_t state_of(uint64_t meta) {
+    return meta >> STATE_SHIFT;
+  }
+  static uint64_t refs_of(uint64_t meta) {
+    return meta & REFS_MASK;
+  }
+  static uint64_t with_state(uint64_t meta, uint64_t state) {
+    return (meta & ~STATE_MASK) | (state << STATE_SHIFT);
+  }
+
+  std::atomic<uint64_t> meta{0};
+  // number of entries whose probe sequence passes over this slot
+  std::atomic<uint32_t> displacements{0};
+  // used as a filter before taking a reference, hence atomic
+  std::atomic<uint32_t> hash{0};
+  // age epoch the charge is accounted to (low priority entries only)
+  std::atomic<uint32_t> epoch{0};
+  // clock countdown, decremented by the sweep and refreshed by hits
+  std::atomic<uint8_t> clock{0};
+  bool high_pri = false;
+
+  void* value = nullptr;
+  DeleterFn deleter = nullptr;
+  size_t charge = 0;
+  char* key_data = nullptr;
+  size_t key_length = 0;
+
+  rocksdb::Slice key() const {
+    return rocksdb::Slice(key_data, key_length);
+  }
+};
+
+// A single shard of sharded cache.
+class alignas(CACHE_LINE_SIZE) BinnedClockCacheShard : public CacheShard {
+ public:
+  BinnedClockCacheShard(CephContext *c, size_t capacity, bool strict_capacity_limit,
+                        double high_pri_pool_ratio, size_t table_size,
+                        PerfCounters *logger,
+                        std::atomic<bool> *table_full_logged);
+  virtual ~BinnedClockCacheShard();
+
+  virtual void SetCapacity(size_t capacity) override;
+  virtual void SetStrictCapacityLimit(bool strict_capacity_limit) override;
+
+  // Set percentage of capacity reserved for high-pri cache entries.
+  void SetHighPriPoolRatio(double high_pri_pool_ratio);
+
+  // Like Cache methods, but with an extra "hash" parameter.
+  virtual rocksdb::Status Insert(const rocksdb::Slice& key, uint32_t hash, void* value,
+                                 size_t charge,
+                                 DeleterFn deleter,
+                                 rocksdb::Cache::Handle** handle,
+                                 rocksdb::Cache::Priority priority) override;
+  virtual rocksdb::Cache::Handle* Lookup(const rocksdb::Slice& key, uint32_t hash) override;
+  virtual bool Ref(rocksdb::Cache::Handle* handle) override;
+  virtual bool Release(rocksdb::Cache::Handle* handle,
+                       bool force_erase = false) override;
+  virtual void Erase(const rocksdb::Slice& key, uint32_t hash) override;
+
+  virtual size_t GetUsage() const override;
+  virtual size_t GetPinnedUsage() const override;
+
+  virtual void ApplyToAllCacheEntries(
+    const std::function<void(const rocksdb::Slice& key,
+                             void* value,
+                             size_t charge,
+                             DeleterFn)>& callback,
+    bool thread_safe) override;
+
+  virtual void EraseUnRefEntries() override;
+
+  virtual std::string GetPrintableOptions() const override;
+
+  virtual DeleterFn GetDeleter(rocksdb::Cache::Handle* handle) const override;
+
+  //  Retrieves number of occupied slots, for unit test purpose only
+  size_t TEST_GetOccupancy() const;
+
+  //  Retrieves high pri pool ratio
+  double GetHighPriPoolRatio() const;
+
+  // Retrieves high pri pool usage
+  size_t GetHighPriPoolUsage() const;
+
+  // Rotate the bins
+  void shift_bins();
+
+  // Get the bin count
+  uint32_t get_bin_count() const;
+
+  // Set the bin count
+  void set_bin_count(uint32_t count);
+
+  // Get the byte counts for a range of age bins
+  uint64_t sum_bins(uint32_t start, uint32_t end) const;
+
+ private:
+  // ring of age bin counters, power of two and larger than any bin count
+  // PriorityCache asks for
+  static constexpr uint32_t MAX_AGE_BINS = 1024;
+
+  // what is left to do once a slot has been emptied; the deleter is run
+  // outside of the mutex
+  struct Freed {
+    DeleterFn deleter;
+    char* key_data;
+    size_t key_length;
+    void* value;
+  };
+
+  CephContext *cct;
+  // owned by the cache
+  PerfCounters *logger;
+  std::atomic<bool> *table_full_logged;
+
+  BinnedClockHandle* FindVisible(const rocksdb::Slice& key, uint32_t hash);
+  // Take a reference on h if it is visible and holds key
+  bool TryRef(BinnedClockHandle* h, const rocksdb::Slice& key, uint32_t hash);
+  // Drop a reference, free the entry if it was the last one of an
+  // invisible entry.  Return true if the entry was freed.  With freed set
+  // the deleter is left to the caller.
+  bool Unref(BinnedClockHandle* h, ceph::autovector<Freed>* freed = nullptr);
+  // Make h, on which the caller holds a reference, invisible
+  void MakeInvisible(BinnedClockHandle* h);
+  bool TryFreeInvisible(BinnedClockHandle* h, Freed* freed);
+  // Account for, unlink and empty a slot owned in CONSTRUCTION state
+  Freed Remove(BinnedClockHandle* h);
+  static void Dispose(const Freed& f);
+
+  // Run the clock until usage_ + charge fits and the table has a free
+  // slot, or nothing more can be evicted.  Must hold mutex_.
+  void Evict(size_t charge, ceph::autovector<Freed>* freed);
+  // Note that the table, not the capacity, limits the cache
+  void TableFull();
+
+  void bin_add(uint32_t epoch, int64_t bytes);
+  void touch(BinnedClockHandle* h);
+
+  // ------------^^^^^^^^^^^^^-----------
+  // Not frequently modified data members
+  // ------------------------------------
+  BinnedClockHandle* table_;
+  size_t table_mask_;
+  size_t occupancy_limit_;
+
+  std::atomic<size_t> capacity_;
+  std::atomic<bool> strict_capacity_limit_;
+  double high_pri_pool_ratio_;
+  size_t high_pri_pool_capacity_;
+  std::atomic<uint32_t> bin_count_{1};
+
+  // ------------------------------------
+  // Frequently modified data members
+  // ------------vvvvvvvvvvvvv-----------
+  alignas(CACHE_LINE_SIZE) std::atomic<size_t> usage_{0};
+  std::atomic<size_t> high_pri_pool_usage_{0};
+  std::atomic<size_t> occupancy_{0};
+  std::atomic<uint32_t> epoch_{0};
+
+  // mutex_ serializes inserts and evictions and protects clock_hand_
+  mutable std::mutex mutex_;
+  size_t clock_hand_ = 0;
+
+  std::atomic<int64_t> age_bins[MAX_AGE_BINS];
+};
+
+class BinnedClockCache : public ShardedCache {
+ public:
+  BinnedClockCache(CephContext *c, size_t capacity, int num_shard_bits,
+                   bool strict_capacity_limit, double high_pri_pool_ratio,
+                   size_t estimated_entry_charge);
+  virtual ~BinnedClockCache();
+  virtual const char* Name() const override { return "BinnedClockCache"; }
+  virtual CacheShard* GetShard(int shard) override;
+  virtual const CacheShard* GetShard(int shard) const override;
+  virtual void* Value(Handle* handle) override;
+  virtual size_t GetCharge(Handle* handle) const override;
+  virtual uint32_t GetHash(Handle* handle) const override;
+  virtual void DisownData() override;
+#if (ROCKSDB_MAJOR >= 6 && ROCKSDB_MINOR >= 22)
+  virtual DeleterFn GetDeleter(Handle* handle) const override;
+#endif
+  // Sets the high pri pool ratio
+  void SetHighPriPoolRatio(double high_pri_pool_ratio);
+  //  Retrieves high pri pool ratio
+  double GetHighPriPoolRatio() const;
+  // Retrieves high pri pool usage
+  size_t GetHighPriPoolUsage() const;
+
+  // PriorityCache
+  virtual int64_t request_cache_bytes(
+      PriorityCache::Priority pri, uint64_t total_cache) const;
+  virtual int64_t commit_cache_size(uint64_t total_cache);
+  virtual int64_t get_committed_size() const {
+    return GetCapacity();
+  }
+  virtual void shift_bins();
+  uint64_t sum_bins(uint32_t start, uint32_t end) const;
+  uint32_t get_bin_count() const;
+  void set_bin_count(uint32_t count);
+
+  virtual std::string get_cache_name() const {
+    return "RocksDB Binned Clock Cache";
+  }
+
+  PerfCounters *get_perf_counters() const {
+    return logger;
+  }
+
+ private:
+  CephContext *cct;
+  PerfCounters *logger = nullptr;
+  std::atomic<bool> table_full_logged{false};
+  BinnedClockCacheShard* shards_;
+  int num_shards_ = 0;
+};
+
+}  // namespace rocksdb_cache
+
+#endif // ROCKSDB_BINNED_CLOCK_CACHE
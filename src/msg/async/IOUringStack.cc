@@ -0,0 +1,882 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <errno.h>
+
+#include <deque>
+
+#include "IOUringStack.h"
+
+#include "include/buffer.h"
+#include "common/errno.h"
+#include "common/dout.h"
+#include "include/compat.h"
+#include "include/sock_compat.h"
+
+#define dout_subsys ceph_subsys_ms
+#undef dout_prefix
+#define dout_prefix *_dout << "IOUringStack "
+
+struct IOUringOp {
+  enum {
+    RECV,
+    SEND,
+    POLL,
+    ACCEPT,
+  };
+  IOUringSocket *s;
+  int type;
+};
+
+// State of a socket shared with the requests in flight on the ring.  Only
+// touched from the owning worker's thread, except for close() which hops
+// over to it.
+class IOUringSocket : public std::enable_shared_from_this<IOUringSocket> {
+  struct rx_chunk {
+    int bid;		   ///< provided buffer id, -1 if copied out
+    const char *data;
+    unsigned len;
+    ceph::buffer::ptr copy;
+  };
+
+  IOUringWorker *worker;
+  int _fd;
+  int notify_fd;
+  unsigned inflight = 0;
+  // close() and shutdown() may come from another thread
+  std::atomic<bool> closed = false;
+  std::atomic<bool> shut = false;
+  int error = 0;
+  bool eof = false;
+
+  IOUringOp recv_op{this, IOUringOp::RECV};
+  IOUringOp send_op{this, IOUringOp::SEND};
+  IOUringOp poll_op{this, IOUringOp::POLL};
+  IOUringOp accept_op{this, IOUringOp::ACCEPT};
+  bool recv_armed = false;
+  bool recv_paused = false;  ///< recv cancelled, rx holds rx_queue_max
+  bool poll_armed = false;
+  bool accept_armed = false;
+  bool sending = false;
+
+  std::deque<rx_chunk> rx;
+  uint64_t rx_bytes = 0;
+
+  ceph::buffer::list tx_inflight;  ///< referenced by the sendmsg in flight
+  ceph::buffer::list tx_queue;
+  std::vector<struct iovec> tx_iov;
+  struct msghdr tx_msg;
+
+  std::deque<int> accepted;
+
+  void notify() {
+    eventfd_write(notify_fd, 1);
+  }
+  void drain_notify() {
+    eventfd_t v;
+    eventfd_read(notify_fd, &v);
+  }
+  void do_close();
+
+ public:
+  IOUringSocket(IOUringWorker *w, int fd)
+    : worker(w), _fd(fd) {
+    notify_fd = eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK);
+  }
+  ~IOUringSocket() {
+    if (_fd >= 0)
+      ::close(_fd);
+    for (auto sd : accepted)
+      ::close(sd);
+    ::close(notify_fd);
+  }
+
+  int fd() const {
+    return _fd;
+  }
+  int get_notify_fd() const {
+    return notify_fd;
+  }
+  bool is_closed() const {
+    return closed;
+  }
+
+  void get_op() {
+    ++inflight;
+  }
+  bool put_op() {
+    ceph_assert(inflight > 0);
+    return --inflight == 0;
+  }
+  /// forget about everything on the ring, it is going away
+  void detach() {
+    inflight = 0;
+    recv_armed = poll_armed = accept_armed = sending = false;
+    rx.clear();
+    rx_bytes = 0;
+    if (!error)
+      error = -ESHUTDOWN;
+    notify();
+  }
+
+  void arm_recv();
+  void pause_recv();
+  void arm_poll();
+  void arm_accept();
+  void submit_send();
+  void handle(IOUringOp *op, struct io_uring_cqe *cqe);
+
+  ssize_t read(char *buf, size_t len);
+  ssize_t send(ceph::buffer::list &bl);
+  bool poll_connect();
+  int pop_accepted();
+  void shutdown() {
+    shut = true;
+    ::shutdown(_fd, SHUT_RDWR);
+  }
+  void close();
+};
+
+void IOUringSocket::arm_recv()
+{
+  if (closed || !worker->is_ready()) {
+    recv_armed = false;
+    return;
+  }
+  auto sqe = worker->get_sqe(&recv_op);
+  io_uring_prep_recv_multishot(sqe, _fd, nullptr, 0, 0);
+  sqe->flags |= IOSQE_BUFFER_SELECT;
+  sqe->buf_group = IOUringWorker::BUF_GROUP;
+  recv_armed = true;
+  recv_paused = false;
+  worker->submit();
+}
+
+// Stop pulling data off the socket while the reader is not keeping up, so
+// that the kernel socket buffer fills and TCP pushes back on the peer.
+// read() re-arms once the queue has drained.
+void IOUringSocket::pause_recv()
+{
+  if (recv_paused)
+    return;
+  recv_paused = true;
+  auto sqe = worker->get_sqe(nullptr);
+  io_uring_prep_cancel(sqe, &recv_op, 0);
+  worker->submit();
+}
+
+void IOUringSocket::arm_poll()
+{
+  auto sqe = worker->get_sqe(&poll_op);
+  io_uring_prep_poll_add(sqe, _fd, POLLOUT);
+  poll_armed = true;
+  worker->submit();
+}
+
+void IOUringSocket::arm_accept()
+{
+  if (closed || !worker->is_ready())
+    return;
+  auto sqe = worker->get_sqe(&accept_op);
+  io_uring_prep_multishot_accept(sqe, _fd, nullptr, nullptr, SOCK_CLOEXEC);
+  accept_armed = true;
+  worker->submit();
+}
+
+void IOUringSocket::submit_send()
+{
+  ceph_assert(!sending);
+  tx_inflight.claim_append(tx_queue);
+  tx_iov.clear();
+  for (auto& p : tx_inflight.buffers()) {
+    if (tx_iov.size() == IOV_MAX)
+      break;
+    tx_iov.push_back({(void*)p.c_str(), p.length()});
+  }
+  // FIPS zeroization audit 20191115: this memset is not security related.
+  memset(&tx_msg, 0, sizeof(tx_msg));
+  tx_msg.msg_iov = tx_iov.data();
+  tx_msg.msg_iovlen = tx_iov.size();
+
+  auto sqe = worker->get_sqe(&send_op);
+  io_uring_prep_sendmsg(sqe, _fd, &tx_msg, MSG_NOSIGNAL);
+  sending = true;
+  worker->submit();
+}
+
+void IOUringSocket::handle(IOUringOp *op, struct io_uring_cqe *cqe)
+{
+  int res = cqe->res;
+  bool more = cqe->flags & IORING_CQE_F_MORE;
+
+  switch (op->type) {
+  case IOUringOp::RECV:
+    if (res > 0) {
+      ceph_assert(cqe->flags & IORING_CQE_F_BUFFER);
+      unsigned bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+      bool was_empty = rx.empty();
+      worker->take_buffer();
+      if (closed) {
+	// nobody is going to read it, do_close() already emptied rx
+	worker->put_buffer(bid);
+	if (!more)
+	  recv_armed = false;
+	break;
+      }
+      rx_bytes += res;
+      if (worker->buffers_low()) {
+	// the buffer ring is shared by every connection of this worker,
+	// don't let one that is not reading (throttled, slow dispatch)
+	// starve the others
+	ceph::buffer::ptr bp(ceph::buffer::create(res));
+	bp.copy_in(0, res, worker->get_buffer(bid));
+	worker->put_buffer(bid);
+	const char *data = bp.c_str();
+	rx.push_back({-1, data, (unsigned)res, std::move(bp)});
+      } else {
+	rx.push_back({(int)bid, worker->get_buffer(bid), (unsigned)res, {}});
+      }
+      if (was_empty)
+	notify();
+      if (more && rx_bytes >= worker->get_rx_queue_max())
+	pause_recv();
+    } else if (res == 0) {
+      eof = true;
+      notify();
+    } else if (res == -ECANCELED && (recv_paused || closed)) {
+      // pause_recv() or do_close()
+    } else if (res != -ENOBUFS) {
+      if (!error)
+	error = res;
+      notify();
+    }
+    if (!more) {
+      recv_armed = false;
+      if (rx_bytes >= worker->get_rx_queue_max()) {
+	recv_paused = true;
+      } else if (!closed && !eof && !error) {
+	if (res == -ENOBUFS && worker->buffers_empty()) {
+	  recv_armed = true;
+	  worker->wait_for_buffers(shared_from_this());
+	} else {
+	  arm_recv();
+	}
+      }
+    }
+    break;
+
+  case IOUringOp::SEND:
+    sending = false;
+    if (res < 0) {
+      if (!error)
+	error = res;
+      tx_inflight.clear();
+      tx_queue.clear();
+      notify();
+    } else {
+      tx_inflight.splice(0, res);
+      if (!closed && (tx_inflight.length() || tx_queue.length()))
+	submit_send();
+    }
+    break;
+
+  case IOUringOp::POLL:
+    poll_armed = false;
+    notify();
+    break;
+
+  case IOUringOp::ACCEPT:
+    if (res >= 0) {
+      if (closed) {
+	::close(res);
+      } else {
+	if (accepted.empty())
+	  notify();
+	accepted.push_back(res);
+      }
+    } else if (res != -ECANCELED) {
+      if (!error)
+	error = res;
+      notify();
+    }
+    // re-armed by the next accept() so that a persistent error (EMFILE)
+    // does not spin on the ring
+    if (!more)
+      accept_armed = false;
+    break;
+
+  default:
+    ceph_abort();
+  }
+}
+
+ssize_t IOUringSocket::read(char *buf, size_t len)
+{
+  if (!worker->is_ready())
+    return error ? error : -ESHUTDOWN;
+
+  size_t copied = 0;
+  while (copied < len && !rx.empty()) {
+    auto& c = rx.front();
+    size_t n = std::min<size_t>(len - copied, c.len);
+    memcpy(buf + copied, c.data, n);
+    copied += n;
+    c.data += n;
+    c.len -= n;
+    if (c.len == 0) {
+      if (c.bid >= 0)
+	worker->put_buffer(c.bid);
+      rx.pop_front();
+    }
+  }
+  rx_bytes -= copied;
+  // (re-)arm once the queue is below the limit again; a paused recv is
+  // re-armed only after its cancellation has completed
+  if (!recv_armed && !eof && !error &&
+      rx_bytes < worker->get_rx_queue_max())
+    arm_recv();
+  if (copied)
+    return copied;
+  if (error)
+    return error;
+  if (eof)
+    return 0;
+  drain_notify();
+  return -EAGAIN;
+}
+
+// The whole list is taken over and queued behind the sendmsg in flight,
+// if any: queued writes are coalesced into the next request.
+ssize_t IOUringSocket::send(ceph::buffer::list &bl)
+{
+  if (error)
+    return error;
+  if (shut)
+    return -EPIPE;
+  if (!worker->is_ready())
+    return -ESHUTDOWN;
+  if (!recv_armed && !eof && rx_bytes < worker->get_rx_queue_max())
+    arm_recv();
+  ssize_t len = bl.length();
+  tx_queue.claim_append(bl);
+  if (!sending)
+    submit_send();
+  return len;
+}
+
+bool IOUringSocket::poll_connect()
+{
+  if (!poll_armed && worker->is_ready()) {
+    arm_poll();
+    return true;
+  }
+  return poll_armed;
+}
+
+int IOUringSocket::pop_accepted()
+{
+  if (accepted.empty()) {
+    if (error) {
+      int r = error;
+      error = 0;
+      return r;
+    }
+    if (!accept_armed && !closed && worker->is_ready())
+      arm_accept();
+    drain_notify();
+    return -EAGAIN;
+  }
+  int sd = accepted.front();
+  accepted.pop_front();
+  return sd;
+}
+
+void IOUringSocket::do_close()
+{
+  if (worker->is_ready() && inflight) {
+    // the cancellation looks the file up by fd, issue it before closing
+    auto sqe = worker->get_sqe(nullptr);
+    io_uring_prep_cancel_fd(sqe, _fd, IORING_ASYNC_CANCEL_ALL);
+    worker->submit(true);
+  }
+  for (auto& c : rx) {
+    if (c.bid >= 0)
+      worker->put_buffer(c.bid);
+  }
+  rx.clear();
+  rx_bytes = 0;
+  tx_queue.clear();
+  for (auto sd : accepted)
+    ::close(sd);
+  accepted.clear();
+  if (_fd >= 0) {
+    ::close(_fd);
+    _fd = -1;
+  }
+}
+
+void IOUringSocket::close()
+{
+  if (closed.exchange(true))
+    return;
+  if (worker->center.in_thread() || !worker->is_ready()) {
+    do_close();
+  } else {
+    worker->center.submit_to(
+      worker->center.get_id(),
+      [s = shared_from_this()]() { s->do_close(); },
+      true);
+  }
+}
+
+class IOUringConnectedSocketImpl final : public ConnectedSocketImpl {
+  ceph::NetHandler &handler;
+  std::shared_ptr<IOUringSocket> s;
+  entity_addr_t sa;
+  bool connected;
+
+ public:
+  IOUringConnectedSocketImpl(ceph::NetHandler &h, const entity_addr_t &sa,
+			     std::shared_ptr<IOUringSocket> s, bool connected)
+    : handler(h), s(std::move(s)), sa(sa), connected(connected) {}
+
+  int is_connected() override {
+    if (connected)
+      return 1;
+
+    int r = handler.reconnect(sa, s->fd());
+    if (r == 0) {
+      connected = true;
+      return 1;
+    } else if (r < 0) {
+      return r;
+    }
+    // wake up the connection once the socket turns writable
+    if (!s->poll_connect())
+      return -ESHUTDOWN;
+    return 0;
+  }
+
+  ssize_t read(char *buf, size_t len) override {
+    return s->read(buf, len);
+  }
+
+  ssize_t send(ceph::buffer::list &bl, bool more) override {
+    return s->send(bl);
+  }
+  void shutdown() override {
+    s->shutdown();
+  }
+  void close() override {
+    s->close();
+  }
+  int fd() const override {
+    return s->get_notify_fd();
+  }
+};
+
+class IOUringServerSocketImpl : public ServerSocketImpl {
+  ceph::NetHandler &handler;
+  std::shared_ptr<IOUringSocket> s;
+
+ public:
+  IOUringServerSocketImpl(ceph::NetHandler &h, std::shared_ptr<IOUringSocket> s,
+			  const entity_addr_t& listen_addr, unsigned slot)
+    : ServerSocketImpl(listen_addr.get_type(), slot),
+      handler(h), s(std::move(s)) {}
+  ~IOUringServerSocketImpl() override {
+    if (s)
+      s->close();
+  }
+  int accept(ConnectedSocket *sock, const SocketOptions &opts, entity_addr_t *out, Worker *w) override;
+  void abort_accept() override {
+    s->close();
+    s.reset();
+  }
+  int fd() const override {
+    return s ? s->get_notify_fd() : -1;
+  }
+};
+
+int IOUringServerSocketImpl::accept(ConnectedSocket *sock, const SocketOptions &opt, entity_addr_t *out, Worker *w) {
+  ceph_assert(sock);
+  int sd = s->pop_accepted();
+  if (sd < 0)
+    return sd;
+
+  int r = handler.set_socket_options(sd, opt.nodelay, opt.rcbuf_size);
+  if (r < 0) {
+    ::close(sd);
+    return -ceph_sock_errno();
+  }
+
+  sockaddr_storage ss;
+  socklen_t slen = sizeof(ss);
+  r = ::getpeername(sd, (sockaddr*)&ss, &slen);
+  if (r < 0) {
+    r = -ceph_sock_errno();
+    ::close(sd);
+    return r;
+  }
+
+  ceph_assert(NULL != out); //out should not be NULL in accept connection
+
+  out->set_type(addr_type);
+  out->set_sockaddr((sockaddr*)&ss);
+  handler.set_priority(sd, opt.priority, out->get_family());
+
+  // the connection lives on w, its recv gets armed on w's ring by the
+  // first read
+  auto cs = std::make_shared<IOUringSocket>(static_cast<IOUringWorker*>(w), sd);
+  *sock = ConnectedSocket(
+    std::make_unique<IOUringConnectedSocketImpl>(handler, *out, std::move(cs), true));
+  return 0;
+}
+
+IOUringWorker::IOUringWorker(CephContext *c, unsigned i)
+  : Worker(c, i), net(c)
+{
+  reap_handler = new C_handle_reap(this);
+}
+
+IOUringWorker::~IOUringWorker()
+{
+  ceph_assert(!ring_ready);
+  delete reap_handler;
+}
+
+void IOUringWorker::initialize()
+{
+  unsigned entries = cct->_conf->ms_async_uring_entries;
+  int r = io_uring_queue_init(entries, &ring, 0);
+  if (r < 0) {
+    lderr(cct) << __func__ << " failed to set up io_uring: "
+	       << cpp_strerror(r) << dendl;
+    ceph_abort();
+  }
+
+  ring_efd = eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK);
+  ceph_assert(ring_efd >= 0);
+  r = io_uring_register_eventfd(&ring, ring_efd);
+  ceph_assert(r == 0);
+
+  rx_queue_max = cct->_conf->ms_async_uring_rx_queue_max;
+  buf_size = cct->_conf->ms_async_uring_buffer_size;
+  buf_count = 1;
+  while (buf_count < cct->_conf->ms_async_uring_buffers)
+    buf_count <<= 1;
+  r = ::posix_memalign((void**)&buf_base, CEPH_PAGE_SIZE,
+		       (size_t)buf_size * buf_count);
+  ceph_assert(r == 0);
+  buf_ring = io_uring_setup_buf_ring(&ring, buf_count, BUF_GROUP, 0, &r);
+  if (!buf_ring) {
+    lderr(cct) << __func__ << " failed to register provided buffers: "
+	       << cpp_strerror(r) << dendl;
+    ceph_abort();
+  }
+  int mask = io_uring_buf_ring_mask(buf_count);
+  for (unsigned bid = 0; bid < buf_count; ++bid)
+    io_uring_buf_ring_add(buf_ring, get_buffer(bid), buf_size, bid, mask, bid);
+  io_uring_buf_ring_advance(buf_ring, buf_count);
+  bufs_out = 0;
+
+  center.create_file_event(ring_efd, EVENT_READABLE, reap_handler);
+  ring_ready = true;
+  ldout(cct, 10) << __func__ << " " << entries << " entries, " << buf_count
+		 << " x " << buf_size << " bytes provided buffers" << dendl;
+}
+
+void IOUringWorker::destroy()
+{
+  if (!ring_ready)
+    return;
+  center.delete_file_event(ring_efd, EVENT_READABLE);
+  ring_ready = false;
+
+  // whatever is still in flight is cancelled by tearing down the ring
+  auto b = std::move(busy);
+  busy.clear();
+  for (auto& [s, ref] : b)
+    ref->detach();
+  b.clear();
+  starved.clear();
+
+  io_uring_free_buf_ring(&ring, buf_ring, buf_count, BUF_GROUP);
+  buf_ring = nullptr;
+  io_uring_queue_exit(&ring);
+  ::free(buf_base);
+  buf_base = nullptr;
+  ::close(ring_efd);
+  ring_efd = -1;
+  unsubmitted = 0;
+}
+
+struct io_uring_sqe *IOUringWorker::get_sqe(IOUringOp *op)
+{
+  ceph_assert(center.in_thread());
+  auto sqe = io_uring_get_sqe(&ring);
+  if (!sqe) {
+    io_uring_submit(&ring);
+    unsubmitted = 0;
+    sqe = io_uring_get_sqe(&ring);
+    ceph_assert(sqe);
+  }
+  io_uring_sqe_set_data(sqe, op);
+  if (op) {
+    IOUringSocket *s = op->s;
+    s->get_op();
+    busy.try_emplace(s, s->shared_from_this());
+  }
+  ++unsubmitted;
+  return sqe;
+}
+
+void IOUringWorker::submit(bool now)
+{
+  if (unsubmitted && (now || !reaping)) {
+    int r = io_uring_submit(&ring);
+    if (r < 0) {
+      lderr(cct) << __func__ << " io_uring_submit failed: "
+		 << cpp_strerror(r) << dendl;
+      ceph_abort();
+    }
+    unsubmitted = 0;
+  }
+}
+
+void IOUringWorker::put_op(IOUringSocket *s)
+{
+  if (s->put_op())
+    busy.erase(s);
+}
+
+void IOUringWorker::put_buffer(unsigned bid)
+{
+  if (!ring_ready)
+    return;
+  io_uring_buf_ring_add(buf_ring, get_buffer(bid), buf_size, bid,
+			io_uring_buf_ring_mask(buf_count), 0);
+  io_uring_buf_ring_advance(buf_ring, 1);
+  ceph_assert(bufs_out > 0);
+  --bufs_out;
+  if (!starved.empty()) {
+    auto s = std::move(starved);
+    starved.clear();
+    for (auto& i : s)
+      i->arm_recv();
+  }
+}
+
+void IOUringWorker::reap()
+{
+  eventfd_t v;
+  eventfd_read(ring_efd, &v);
+
+  reaping = true;
+  while (true) {
+    struct io_uring_cqe *cqe;
+    unsigned head;
+    unsigned n = 0;
+    io_uring_for_each_cqe(&ring, head, cqe) {
+      ++n;
+      auto op = static_cast<IOUringOp*>(io_uring_cqe_get_data(cqe));
+      if (!op)
+	continue;
+      // hold on to the socket, put_op() may drop the last reference
+      auto s = op->s->shared_from_this();
+      s->handle(op, cqe);
+      if (!(cqe->flags & IORING_CQE_F_MORE))
+	put_op(s.get());
+    }
+    if (!n)
+      break;
+    io_uring_cq_advance(&ring, n);
+  }
+  reaping = false;
+  submit();
+}
+
+int IOUringWorker::listen(entity_addr_t &sa,
+			  unsigned addr_slot,
+			  const SocketOptions &opt,
+			  ServerSocket *sock)
+{
+  int listen_sd = net.create_socket(sa.get_family(), true);
+  if (listen_sd < 0) {
+    return -ceph_sock_errno();
+  }
+
+  int r = net.set_nonblock(listen_sd);
+  if (r < 0) {
+    ::close(listen_sd);
+    return -ceph_sock_errno();
+  }
+
+  r = net.set_socket_options(listen_sd, opt.nodelay, opt.rcbuf_size);
+  if (r < 0) {
+    ::close(listen_sd);
+    return -ceph_sock_errno();
+  }
+
+  r = ::bind(listen_sd, sa.get_sockaddr(), sa.get_sockaddr_len());
+  if (r < 0) {
+    r = -ceph_sock_errno();
+    ldout(cct, 10) << __func__ << " unable to bind to " << sa.get_sockaddr()
+                   << ": " << cpp_strerror(r) << dendl;
+    ::close(listen_sd);
+    return r;
+  }
+
+  r = ::listen(listen_sd, cct->_conf->ms_tcp_listen_backlog);
+  if (r < 0) {
+    r = -ceph_sock_errno();
+    lderr(cct) << __func__ << " unable to listen on " << sa << ": " << cpp_strerror(r) << dendl;
+    ::close(listen_sd);
+    return r;
+  }
+
+  auto s = std::make_shared<IOUringSocket>(this, listen_sd);
+  if (center.in_thread())
+    s->arm_accept();
+  else
+    center.submit_to(center.get_id(), [s]() { s->arm_accept(); }, true);
+  *sock = ServerSocket(
+    std::make_unique<IOUringServerSocketImpl>(net, std::move(s), sa, addr_slot));
+  return 0;
+}
+
+int IOUringWorker::connect(const entity_addr_t &addr, const SocketOptions &opts, ConnectedSocket *socket) {
+  int sd;
+
+  if (opts.nonblock) {
+    sd = net.nonblock_connect(addr, opts.connect_bind_addr);
+  } else {
+    sd = net.connect(addr, opts.connect_bind_addr);
+  }
+
+  if (sd < 0) {
+    return -ceph_sock_errno();
+  }
+
+  net.set_priority(sd, opts.priority, addr.get_family());
+  auto s = std::make_shared<IOUringSocket>(this, sd);
+  *socket = ConnectedSocket(
+    std::make_unique<IOUringConnectedSocketImpl>(net, addr, std::move(s), !opts.nonblock));
+  return 0;
+}
+
+IOUringNetworkStack::IOUringNetworkStack(CephContext *c)
+  : NetworkStack(c)
+{
+}
+
+bool IOUringNetworkStack::is_supported(CephContext *cct)
+{
+  struct io_uring ring;
+  int r = io_uring_queue_init(8, &ring, 0);
+  if (r < 0) {
+    lderr(cct) << __func__ << " io_uring_queue_init failed: "
+	       << cpp_strerror(r) << dendl;
+    return false;
+  }
+
+  bool supported = true;
+  struct io_uring_probe *probe = io_uring_get_probe_ring(&ring);
+  if (!probe) {
+    lderr(cct) << __func__ << " kernel does not support IORING_REGISTER_PROBE"
+	       << dendl;
+    supported = false;
+  } else {
+    for (int opcode : {IORING_OP_RECV, IORING_OP_SENDMSG, IORING_OP_ACCEPT,
+		       IORING_OP_POLL_ADD, IORING_OP_ASYNC_CANCEL}) {
+      if (!io_uring_opcode_supported(probe, opcode)) {
+	lderr(cct) << __func__ << " kernel does not support io_uring opcode "
+		   << opcode << dendl;
+	supported = false;
+      }
+    }
+    io_uring_free_probe(probe);
+  }
+  if (supported)
+    supported = probe_recv_multishot(cct, &ring);
+  io_uring_queue_exit(&ring);
+  return supported;
+}
+
+// The opcode probe cannot tell whether IORING_OP_RECV understands
+// IORING_RECV_MULTISHOT and provided buffer rings (both 6.0+), so try one
+// on a socketpair.
+bool IOUringNetworkStack::probe_recv_multishot(CephContext *cct,
+					       struct io_uring *ring)
+{
+  int sv[2];
+  if (::socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0, sv) < 0) {
+    int r = -errno;
+    lderr(cct) << __func__ << " socketpair failed: " << cpp_strerror(r)
+	       << dendl;
+    return false;
+  }
+
+  bool supported = false;
+  char buf[64];
+  int r;
+  struct io_uring_buf_ring *br = io_uring_setup_buf_ring(ring, 1, BUF_PROBE_GROUP,
+							 0, &r);
+  if (!br) {
+    lderr(cct) << __func__ << " provided buffer rings are not supported: "
+	       << cpp_strerror(r) << dendl;
+  } else {
+    io_uring_buf_ring_add(br, buf, sizeof(buf), 0, io_uring_buf_ring_mask(1), 0);
+    io_uring_buf_ring_advance(br, 1);
+
+    auto sqe = io_uring_get_sqe(ring);
+    io_uring_prep_recv_multishot(sqe, sv[0], nullptr, 0, 0);
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUF_PROBE_GROUP;
+    io_uring_submit(ring);
+    ceph_assert_always(::write(sv[1], "x", 1) == 1);
+
+    struct io_uring_cqe *cqe;
+    struct __kernel_timespec ts;
+    ts.tv_sec = 1;
+    ts.tv_nsec = 0;
+    r = io_uring_wait_cqe_timeout(ring, &cqe, &ts);
+    if (r < 0) {
+      lderr(cct) << __func__ << " no completion for multishot recv: "
+		 << cpp_strerror(r) << dendl;
+    } else {
+      supported = cqe->res > 0 && (cqe->flags & IORING_CQE_F_MORE);
+      if (!supported)
+	lderr(cct) << __func__ << " multishot recv is not supported: "
+		   << (cqe->res < 0 ? cpp_strerror(cqe->res) : "single shot")
+		   << dendl;
+      io_uring_cqe_seen(ring, cqe);
+    }
+    // end the recv and reap whatever it still posts before the buffer ring
+    // goes away
+    ::shutdown(sv[0], SHUT_RDWR);
+    while (io_uring_wait_cqe_timeout(ring, &cqe, &ts) == 0) {
+      bool more = cqe->flags & IORING_CQE_F_MORE;
+      io_uring_cqe_seen(ring, cqe);
+      if (!more)
+	break;
+    }
+    io_uring_free_buf_ring(ring, br, 1, BUF_PROBE_GROUP);
+  }
+  ::close(sv[0]);
+  ::close(sv[1]);
+  return supported;
+}
@@ -0,0 +1,153 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_MSG_ASYNC_IOURINGSTACK_H
+#define CEPH_MSG_ASYNC_IOURINGSTACK_H
+
+#include <liburing.h>
+
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "msg/msg_types.h"
+#include "msg/async/net_handler.h"
+
+#include "Stack.h"
+
+class IOUringSocket;
+struct IOUringOp;
+
+/*
+ * io_uring transport (ms_type = async+io_uring)
+ *
+ * Every worker owns a ring and a provided buffer ring.  Connected sockets
+ * keep a multishot recv armed on the worker's ring, so incoming data lands
+ * in the provided buffers without a syscall per read, and writes are
+ * handed to the ring as sendmsg requests.  Listening sockets use multishot
+ * accept.
+ *
+ * The ring signals completions through an eventfd which is registered with
+ * the worker's EventCenter; completions are reaped in one go and turned
+ * into events on a per socket eventfd, which is what fd() returns to
+ * AsyncConnection.  Everything touching the ring runs on the worker thread.
+ */
+class IOUringWorker : public Worker {
+  class C_handle_reap : public EventCallback {
+    IOUringWorker *worker;
+   public:
+    explicit C_handle_reap(IOUringWorker *w) : worker(w) {}
+    void do_request(uint64_t fd) override {
+      worker->reap();
+    }
+  };
+
+  ceph::NetHandler net;
+  struct io_uring ring;
+  bool ring_ready = false;
+  bool reaping = false;
+  unsigned unsubmitted = 0;
+  int ring_efd = -1;
+  EventCallbackRef reap_handler;
+
+  // provided buffers for multishot recv
+  struct io_uring_buf_ring *buf_ring = nullptr;
+  char *buf_base = nullptr;
+  unsigned buf_size = 0;
+  unsigned buf_count = 0;
+  unsigned bufs_out = 0;
+  uint64_t rx_queue_max = 0;
+  // sockets whose recv stopped because the buffer ring ran dry
+  std::vector<std::shared_ptr<IOUringSocket>> starved;
+  // sockets with requests in flight, kept alive until they complete
+  std::unordered_map<IOUringSocket*, std::shared_ptr<IOUringSocket>> busy;
+
+  void initialize() override;
+  void reap();
+
+ public:
+  static constexpr int BUF_GROUP = 0;
+
+  IOUringWorker(CephContext *c, unsigned i);
+  ~IOUringWorker() override;
+
+  int listen(entity_addr_t &sa,
+	     unsigned addr_slot,
+	     const SocketOptions &opt,
+	     ServerSocket *socks) override;
+  int connect(const entity_addr_t &addr, const SocketOptions &opts,
+	      ConnectedSocket *socket) override;
+  void destroy() override;
+
+  bool is_ready() const {
+    return ring_ready;
+  }
+  /// get an sqe whose completion is routed to op, nullptr for none
+  struct io_uring_sqe *get_sqe(IOUringOp *op);
+  /// submit queued sqes, deferred to the end of reap() while reaping
+  void submit(bool now = false);
+  /// drop the in-flight reference taken by get_sqe()
+  void put_op(IOUringSocket *s);
+
+  char *get_buffer(unsigned bid) {
+    return buf_base + (size_t)bid * buf_size;
+  }
+  void take_buffer() {
+    ++bufs_out;
+  }
+  void put_buffer(unsigned bid);
+  bool buffers_low() const {
+    return buf_count - bufs_out < buf_count / 8;
+  }
+  bool buffers_empty() const {
+    return bufs_out == buf_count;
+  }
+  void wait_for_buffers(std::shared_ptr<IOUringSocket> s) {
+    starved.push_back(std::move(s));
+  }
+  /// bytes a socket may hold in its receive queue before recv is paused
+  uint64_t get_rx_queue_max() const {
+    return rx_queue_max;
+  }
+};
+
+class IOUringNetworkStack : public NetworkStack {
+  static constexpr int BUF_PROBE_GROUP = 0;
+
+  std::vector<std::thread> threads;
+
+  static bool probe_recv_multishot(CephContext *cct, struct io_uring *ring);
+
+  virtual Worker* create_worker(CephContext *c, unsigned worker_id) override {
+    return new IOUringWorker(c, worker_id);
+  }
+
+ public:
+  explicit IOUringNetworkStack(CephContext *c);
+
+  /// whether the running kernel has everything this stack relies on
+  static bool is_supported(CephContext *cct);
+
+  // connect completion is signalled through the socket's eventfd
+  bool nonblock_connect_need_writable_event() const override { return false; }
+
+  void spawn_worker(std::function<void ()> &&func) override {
+    threads.emplace_back(std::move(func));
+  }
+  void join_worker(unsigned i) override {
+    ceph_assert(threads.size() > i && threads[i].joinable());
+    threads[i].join();
+  }
+};
+
+#endif //CEPH_MSG_ASYNC_IOURINGSTACK_H
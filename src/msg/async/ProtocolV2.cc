@@ -556,14 +556,17 @@ ssize_t ProtocolV2::write_message(Message *m, bool more) {
                  << " src=" << entity_name_t(messenger->get_myname())
                  << " off=" << header2.data_off
                  << dendl;
-  ssize_t total_send_size = connection->outgoing_bl.length();
-  ssize_t rc = connection->_try_send(more);
-  if (rc < 0) {
+  // let the messages queued behind this one share the syscall, up to a
+  // bound so that the first of them isn't held back for long
+  ++tx_batch_messages;
+  ssize_t rc = 0;
+  if (more && !tx_batch_full()) {
+    ldout(cct, 10) << __func__ << " batching " << m << ", "
+                   << tx_batch_messages << " messages pending" << dendl;
+  } else if (rc = flush_tx_batch(more); rc < 0) {
     ldout(cct, 1) << __func__ << " error sending " << m << ", "
                   << cpp_strerror(rc) << dendl;
   } else {
-    connection->logger->inc(
-        l_msgr_send_bytes, total_send_size - connection->outgoing_bl.length());
     ldout(cct, 10) << __func__ << " sending " << m
                    << (rc ? " continuely." : " done.") << dendl;
   }
@@ -579,6 +582,27 @@ ssize_t ProtocolV2::write_message(Message *m, bool more) {
   return rc;
 }
 
+bool ProtocolV2::tx_batch_full() const {
+  // a batch has to fit a single sendmsg()
+  return tx_batch_messages >= cct->_conf->ms_async_send_batch_messages ||
+    connection->outgoing_bl.length() >= cct->_conf->ms_async_send_batch_bytes ||
+    connection->outgoing_bl.get_num_buffers() >= IOV_MAX / 2;
+}
+
+ssize_t ProtocolV2::flush_tx_batch(bool more) {
+  ssize_t total_send_size = connection->outgoing_bl.length();
+  ssize_t rc = connection->_try_send(more);
+  if (rc >= 0) {
+    connection->logger->inc(
+        l_msgr_send_bytes, total_send_size - connection->outgoing_bl.length());
+    if (tx_batch_messages) {
+      connection->logger->inc(l_msgr_send_batch_messages, tx_batch_messages);
+    }
+  }
+  tx_batch_messages = 0;
+  return rc;
+}
+
 template <class F>
 bool ProtocolV2::append_frame(F& frame) {
   ceph::bufferlist bl;
@@ -652,8 +676,10 @@ void ProtocolV2::write_event() {
 
     auto start = ceph::mono_clock::now();
     bool more;
+    tx_batch_messages = 0;
     do {
-      if (connection->is_queued()) {
+      // leftovers of an earlier write_event(), not a batch being built
+      if (connection->is_queued() && !tx_batch_messages) {
 	if (r = connection->_try_send(); r!= 0) {
 	  // either fails to send or not all queued buffer is sent
 	  break;
@@ -710,12 +736,12 @@ void ProtocolV2::write_event() {
         if (append_frame(ack_frame)) {
           ack_left -= left;
           left = ack_left;
-          r = connection->_try_send(left);
+          r = flush_tx_batch(left);
         } else {
           r = -EILSEQ;
         }
       } else if (is_queued()) {
-        r = connection->_try_send();
+        r = flush_tx_batch();
       }
     }
     connection->write_lock.unlock();
@@ -1185,9 +1211,39 @@ CtPtr ProtocolV2::read_frame_segment() {
 
   rx_buffer_t rx_buffer;
   uint16_t align = rx_frame_asm.get_segment_align(seg_idx);
+  unsigned in_page_off = 0;
+  if (next_tag == Tag::MESSAGE && seg_idx == SegmentIndex::Msg::DATA &&
+      align == segment_t::PAGE_SIZE_ALIGNMENT) {
+    // Lay the data out like ProtocolV1 does: payload destined for object
+    // offset data_off starts at the same offset within a page, so that
+    // its full pages are page aligned in memory and can go to the device
+    // with direct IO as they are, instead of being rebuilt (copied).
+    auto& hdrbl = rx_segments_data[SegmentIndex::Msg::HEADER];
+    try {
+      if (rx_frame_asm.disassemble_first_segment_early(rx_preamble, hdrbl) &&
+          hdrbl.length() == sizeof(ceph_msg_header2)) {
+        auto header = reinterpret_cast<const ceph_msg_header2*>(hdrbl.c_str());
+        in_page_off = header->data_off & ~CEPH_PAGE_MASK;
+      }
+    } catch (FrameError& e) {
+      ldout(cct, 1) << __func__ << " " << e.what() << dendl;
+      return _fault();
+    } catch (ceph::crypto::onwire::MsgAuthError&) {
+      ldout(cct, 1) << __func__ << " bad auth tag" << dendl;
+      return _fault();
+    }
+  }
   try {
-    rx_buffer = ceph::buffer::ptr_node::create(ceph::buffer::create_aligned(
-        onwire_len, align));
+    if (in_page_off) {
+      ceph::buffer::ptr bp(ceph::buffer::create_page_aligned(
+          in_page_off + onwire_len));
+      bp.set_offset(in_page_off);
+      bp.set_length(onwire_len);
+      rx_buffer = ceph::buffer::ptr_node::create(std::move(bp));
+    } else {
+      rx_buffer = ceph::buffer::ptr_node::create(ceph::buffer::create_aligned(
+          onwire_len, align));
+    }
   } catch (const ceph::buffer::bad_alloc&) {
     // Catching because of potential issues with satisfying alignment.
     ldout(cct, 1) << __func__ << " can't allocate aligned rx_buffer"
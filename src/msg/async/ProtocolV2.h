@@ -98,6 +98,8 @@ private:
   std::atomic<uint64_t> out_seq{0};
   std::atomic<uint64_t> in_seq{0};
   std::atomic<uint64_t> ack_left{0};
+  // messages appended to outgoing_bl by write_event() since the last flush
+  unsigned tx_batch_messages = 0;
 
   using ProtFuncPtr = void (ProtocolV2::*)();
   Ct<ProtocolV2> *bannerExchangeCallback;
@@ -151,6 +153,8 @@ private:
   void prepare_send_message(uint64_t features, Message *m);
   out_queue_entry_t _get_next_outgoing();
   ssize_t write_message(Message *m, bool more);
+  bool tx_batch_full() const;
+  ssize_t flush_tx_batch(bool more = false);
   void handle_message_ack(uint64_t seq);
   void reset_compression();
 
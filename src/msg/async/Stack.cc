@@ -26,6 +26,9 @@
 #ifdef HAVE_DPDK
 #include "dpdk/DPDKStack.h"
 #endif
+#ifdef HAVE_ASYNC_URING
+#include "IOUringStack.h"
+#endif
 
 #include "common/dout.h"
 #include "include/ceph_assert.h"
@@ -75,6 +78,17 @@ std::shared_ptr<NetworkStack> NetworkStack::create(CephContext *c,
   else if (t == "dpdk")
     stack.reset(new DPDKStack(c));
 #endif
+#ifdef HAVE_ASYNC_URING
+  else if (t == "io_uring") {
+    if (IOUringNetworkStack::is_supported(c)) {
+      stack.reset(new IOUringNetworkStack(c));
+    } else {
+      lderr(c) << __func__ << " io_uring is not usable on this kernel,"
+	       << " falling back to posix" << dendl;
+      stack.reset(new PosixNetworkStack(c));
+    }
+  }
+#endif
 
   if (stack == nullptr) {
     lderr(c) << __func__ << " ms_async_transport_type " << t <<
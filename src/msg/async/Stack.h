@@ -202,6 +202,7 @@ enum {
 
   l_msgr_send_messages_queue_lat,
   l_msgr_handle_ack_lat,
+  l_msgr_send_batch_messages,
 
   l_msgr_last,
 };
@@ -245,6 +246,7 @@ class Worker {
 
     plb.add_time_avg(l_msgr_send_messages_queue_lat, "msgr_send_messages_queue_lat", "Network sent messages lat");
     plb.add_time_avg(l_msgr_handle_ack_lat, "msgr_handle_ack_lat", "Connection handle ack lat");
+    plb.add_u64_avg(l_msgr_send_batch_messages, "msgr_send_batch_messages", "Messages sent per flush of the outgoing buffer");
 
     perf_logger = plb.create_perf_counters();
     cct->get_perfcounters_collection()->add(perf_logger);
@@ -320,6 +320,7 @@ Tag FrameAssembler::disassemble_preamble(bufferlist& preamble_bl) {
     throw FrameError("last segment empty");
   }
 
+  m_first_segment_done = false;
   m_descs.resize(preamble->num_segments);
   for (size_t i = 0; i < m_descs.size(); i++) {
     m_descs[i].logical_len = preamble->segments[i].length;
@@ -445,7 +446,9 @@ bool FrameAssembler::disasm_remaining_secure_rev1(
 
 bool FrameAssembler::disassemble_segments(bufferlist& preamble_bl, 
   bufferlist segments_bls[], bufferlist& epilogue_bl) const {
-  disassemble_first_segment(preamble_bl, segments_bls[0]);
+  if (!m_first_segment_done) {
+    disassemble_first_segment(preamble_bl, segments_bls[0]);
+  }
   if (disassemble_remaining_segments(segments_bls, epilogue_bl)) {
     if (is_compressed()) {
       disassemble_decompress(segments_bls);
@@ -456,6 +459,18 @@ bool FrameAssembler::disassemble_segments(bufferlist& preamble_bl,
   return false;
 }
 
+bool FrameAssembler::disassemble_first_segment_early(bufferlist& preamble_bl,
+                                                     bufferlist& segment_bl) {
+  if (!m_is_rev1 || is_compressed()) {
+    return false;
+  }
+  if (!m_first_segment_done) {
+    disassemble_first_segment(preamble_bl, segment_bl);
+    m_first_segment_done = true;
+  }
+  return true;
+}
+
 void FrameAssembler::disassemble_first_segment(bufferlist& preamble_bl,
                                                bufferlist& segment_bl) const {
   ceph_assert(!m_descs.empty());
@@ -317,6 +317,14 @@ public:
                             bufferlist segments_bls[], 
                             bufferlist& epilogue_bl) const;
 
+  // In msgr2.1 the first segment is covered by its own crc or auth tag,
+  // so it can be checked (and decrypted) as soon as it is read, e.g. to
+  // look at the message header before reading the rest of the frame.
+  // disassemble_segments() then skips it.  Returns false if that is not
+  // possible for this frame (msgr2.0, compressed frames).
+  bool disassemble_first_segment_early(bufferlist& preamble_bl,
+                                       bufferlist& segment_bl);
+
 private:
   struct segment_desc_t {
     uint32_t logical_len;
@@ -400,6 +408,7 @@ private:
 
   boost::container::static_vector<segment_desc_t, MAX_NUM_SEGMENTS> m_descs;
   __u8 m_flags;
+  bool m_first_segment_done = false;
   const ceph::crypto::onwire::rxtx_t* m_crypto;
   bool m_is_rev1;  // msgr2.1?
   bool m_with_data_crc;
@@ -47,6 +47,13 @@ public:
     return allocate(want_size, block_size, want_size, hint, extents);
   }
 
+  /*
+   * Let a non-zero hint passed to allocate() steer placement. Off by
+   * default, so hints are ignored unless the owner opts in; allocators
+   * that can't place by hint ignore this.
+   */
+  virtual void set_use_hint(bool use) {}
+
   /* Bulk release. Implementations may override this method to handle the whole
    * set at once. This could save e.g. unnecessary mutex dance. */
   virtual void release(const interval_set<uint64_t>& release_set) = 0;
@@ -89,6 +89,31 @@ uint64_t AvlAllocator::_pick_block_fits(uint64_t size,
   return -1ULL;
 }
 
+uint64_t AvlAllocator::_pick_block_from(uint64_t hint,
+					uint64_t size,
+					uint64_t align)
+{
+  // the caller asked for a specific area (e.g. to extend a BlueFS file in
+  // place); don't wrap around, the regular cursor search does that anyway
+  const auto compare = range_tree.key_comp();
+  uint32_t search_count = 0;
+  auto rs_start = range_tree.lower_bound(range_t{hint, hint + size}, compare);
+  for (auto rs = rs_start; rs != range_tree.end(); ++rs) {
+    uint64_t offset = p2roundup(std::max(rs->start, hint), align);
+    if (offset + size <= rs->end) {
+      return offset;
+    }
+    if (max_search_count > 0 && ++search_count > max_search_count) {
+      return -1ULL;
+    }
+    if (max_search_bytes > 0 &&
+	rs->start - rs_start->start > max_search_bytes) {
+      return -1ULL;
+    }
+  }
+  return -1ULL;
+}
+
 void AvlAllocator::_add_to_tree(uint64_t start, uint64_t size)
 {
   ceph_assert(size != 0);
@@ -215,20 +240,25 @@ int64_t AvlAllocator::_allocate(
   uint64_t want,
   uint64_t unit,
   uint64_t max_alloc_size,
-  int64_t  hint, // unused, for now!
+  int64_t  hint,
   PExtentVector* extents)
 {
   uint64_t allocated = 0;
+  uint64_t next = use_hint && hint > 0 ? hint : 0;
   while (allocated < want) {
     uint64_t offset, length;
     int r = _allocate(std::min(max_alloc_size, want - allocated),
-      unit, &offset, &length);
+      unit, next, &offset, &length);
     if (r < 0) {
       // Allocation failed.
       break;
     }
     extents->emplace_back(offset, length);
     allocated += length;
+    if (next) {
+      // keep the rest of the request adjacent to what we just got
+      next = offset + length;
+    }
   }
   return allocated ? allocated : -ENOSPC;
 }
@@ -236,6 +266,7 @@ int64_t AvlAllocator::_allocate(
 int AvlAllocator::_allocate(
   uint64_t size,
   uint64_t unit,
+  uint64_t hint,
   uint64_t *offset,
   uint64_t *length)
 {
@@ -263,18 +294,28 @@ int AvlAllocator::_allocate(
       free_pct < range_size_alloc_free_pct) {
     start = -1ULL;
   } else {
-    /*
-     * Find the largest power of 2 block size that evenly divides the
-     * requested size. This is used to try to allocate blocks with similar
-     * alignment from the same area (i.e. same cursor bucket) but it does
-     * not guarantee that other allocations sizes may exist in the same
-     * region.
-     */
-    uint64_t align = size & -size;
-    ceph_assert(align != 0);
-    uint64_t* cursor = &lbas[cbits(align) - 1];
-    start = _pick_block_after(cursor, size, unit);
-    dout(20) << __func__ << " first fit=" << start << " size=" << size << dendl;
+    start = -1ULL;
+    if (hint) {
+      // the caller wants the range near hint; honour it when it is cheap
+      // and fall back to the cursor search otherwise
+      start = _pick_block_from(hint, size, unit);
+      dout(20) << __func__ << " hinted fit=" << start << " size=" << size
+	       << " hint=" << hint << dendl;
+    }
+    if (start == -1ULL) {
+      /*
+       * Find the largest power of 2 block size that evenly divides the
+       * requested size. This is used to try to allocate blocks with similar
+       * alignment from the same area (i.e. same cursor bucket) but it does
+       * not guarantee that other allocations sizes may exist in the same
+       * region.
+       */
+      uint64_t align = size & -size;
+      ceph_assert(align != 0);
+      uint64_t* cursor = &lbas[cbits(align) - 1];
+      start = _pick_block_after(cursor, size, unit);
+      dout(20) << __func__ << " first fit=" << start << " size=" << size << dendl;
+    }
   }
   if (start == -1ULL) {
     do {
@@ -363,7 +404,7 @@ int64_t AvlAllocator::allocate(
   uint64_t want,
   uint64_t unit,
   uint64_t max_alloc_size,
-  int64_t  hint, // unused, for now!
+  int64_t  hint,
   PExtentVector* extents)
 {
   ldout(cct, 10) << __func__ << std::hex
@@ -91,6 +91,9 @@ public:
   void init_add_free(uint64_t offset, uint64_t length) override;
   void init_rm_free(uint64_t offset, uint64_t length) override;
   void shutdown() override;
+  void set_use_hint(bool use) override {
+    use_hint = use;
+  }
 
 private:
   // pick a range by search from cursor forward
@@ -102,9 +105,15 @@ private:
   uint64_t _pick_block_fits(
     uint64_t size,
     uint64_t align);
+  // pick the first block at or after hint, leaving the cursors untouched
+  uint64_t _pick_block_from(
+    uint64_t hint,
+    uint64_t size,
+    uint64_t align);
   int _allocate(
     uint64_t size,
     uint64_t unit,
+    uint64_t hint,
     uint64_t *offset,
     uint64_t *length);
 
@@ -135,6 +144,7 @@ private:
   range_size_tree_t range_size_tree;
 
   uint64_t num_free = 0;     ///< total bytes in freelist
+  bool use_hint = false;     ///< place near a non-zero allocate() hint
 
   /*
    * This value defines the number of elements in the ms_lbas array.
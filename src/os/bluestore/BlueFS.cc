@@ -372,6 +372,31 @@ void BlueFS::_init_logger()
 	    "How many times bluefs read found page with all 0s");
   b.add_u64(l_bluefs_read_zeros_errors, "read_zeros_errors",
 	    "How many times bluefs read found transient page with all 0s");
+  b.add_time_avg(l_bluefs_log_flush_lat, "log_flush_lat",
+		 "Average latency of metadata log flush and sync",
+		 NULL,
+		 PerfCountersBuilder::PRIO_USEFUL);
+  PerfHistogramCommon::axis_config_d lat_x_axis_config{
+    "Latency (usec)",
+    PerfHistogramCommon::SCALE_LOG2,
+    0,
+    1000,                            ///< Quantization unit is 1usec
+    24,
+  };
+  PerfHistogramCommon::axis_config_d bytes_y_axis_config{
+    "Log bytes written",
+    PerfHistogramCommon::SCALE_LOG2,
+    0,
+    4096,
+    16,
+  };
+  b.add_u64_counter_histogram(l_bluefs_log_flush_lat_hist, "log_flush_lat_histogram",
+			      lat_x_axis_config, bytes_y_axis_config,
+			      "Histogram of metadata log flush latency vs bytes written");
+  b.add_time_avg(l_bluefs_compaction_lock_lat, "compaction_lock_lat",
+		 "Average time the metadata log is locked by async compaction",
+		 NULL,
+		 PerfCountersBuilder::PRIO_USEFUL);
 
   logger = b.create_perf_counters();
   cct->get_perfcounters_collection()->add(logger);
@@ -668,6 +693,8 @@ void BlueFS::_init_alloc()
 				    alloc_size[id],
 				    0, 0,
 				    name);
+      // the shared allocator above is left as BlueStore set it up
+      alloc[id]->set_use_hint(cct->_conf->bluefs_lifetime_placement);
       alloc[id]->init_add_free(
         block_reserved[id],
         _get_total(id));
@@ -2380,37 +2407,64 @@ void BlueFS::_compact_log_dump_metadata_NF(bluefs_transaction_t *t,
     }
   }
 }
-/* Streams to t files modified before *capture_before_seq* and all dirs */
-void BlueFS::_compact_log_async_dump_metadata_NF(bluefs_transaction_t *t,
-						 uint64_t capture_before_seq)
+/* Copies files modified before *capture_before_seq* and all dirs to snap */
+void BlueFS::_compact_log_async_capture_metadata_NF(log_snapshot_t *snap,
+						    uint64_t capture_before_seq)
 {
   std::lock_guard nl(nodes.lock);
 
-  t->seq = 1;
-  t->uuid = super.uuid;
-  dout(20) << __func__ << " op_init" << dendl;
-
-  t->op_init();
+  snap->files.reserve(nodes.file_map.size());
   for (auto& [ino, file_ref] : nodes.file_map) {
     if (ino == 1)
       continue;
     ceph_assert(ino > 1);
     std::lock_guard fl(file_ref->lock);
     if (file_ref->dirty_seq < capture_before_seq) {
-      dout(20) << __func__ << " op_file_update " << file_ref->fnode << dendl;
+      dout(20) << __func__ << " file " << file_ref->fnode << dendl;
     } else {
-      dout(20) << __func__ << " op_file_update just modified, dirty_seq="
+      dout(20) << __func__ << " file just modified, dirty_seq="
 	       << file_ref->dirty_seq << " " << file_ref->fnode << dendl;
     }
-    t->op_file_update(file_ref->fnode);
-  }
+    auto& fnode = snap->files.emplace_back();
+    fnode.ino = file_ref->fnode.ino;
+    fnode.size = file_ref->fnode.size;
+    fnode.mtime = file_ref->fnode.mtime;
+    fnode.extents = file_ref->fnode.extents;
+    // the snapshot carries the full extent list, later incremental
+    // updates in the log must start from here
+    file_ref->fnode.reset_delta();
+  }
+  snap->dirs.reserve(nodes.dir_map.size());
   for (auto& [path, dir_ref] : nodes.dir_map) {
+    auto& [dir, links] = snap->dirs.emplace_back();
+    dir = path;
+    links.reserve(dir_ref->file_map.size());
+    for (auto& [fname, file_ref] : dir_ref->file_map) {
+      links.emplace_back(fname, file_ref->fnode.ino);
+    }
+  }
+}
+
+/* Streams snap to t; needs no locks */
+void BlueFS::_compact_log_async_dump_metadata(bluefs_transaction_t *t,
+					      log_snapshot_t& snap)
+{
+  t->seq = 1;
+  t->uuid = super.uuid;
+  dout(20) << __func__ << " op_init" << dendl;
+
+  t->op_init();
+  for (auto& fnode : snap.files) {
+    dout(20) << __func__ << " op_file_update " << fnode << dendl;
+    t->op_file_update(fnode);
+  }
+  for (auto& [path, links] : snap.dirs) {
     dout(20) << __func__ << " op_dir_create " << path << dendl;
     t->op_dir_create(path);
-    for (auto& [fname, file_ref] : dir_ref->file_map) {
+    for (auto& [fname, ino] : links) {
       dout(20) << __func__ << " op_dir_link " << path << "/" << fname
-	       << " to " << file_ref->fnode.ino << dendl;
-      t->op_dir_link(path, fname, file_ref->fnode.ino);
+	       << " to " << ino << dendl;
+      t->op_dir_link(path, fname, ino);
     }
   }
 }
@@ -2568,6 +2622,7 @@ void BlueFS::_compact_log_async_LD_LNF_D() //also locks FW for new_writer
   }
 
   log.lock.lock();
+  auto lock_start = ceph::mono_clock::now();
   File *log_file = log.writer->file.get();
   FileWriter *new_log_writer = nullptr;
   FileRef new_log = nullptr;
@@ -2619,13 +2674,20 @@ void BlueFS::_compact_log_async_LD_LNF_D() //also locks FW for new_writer
   // out of jump section
 
   // 2. prepare compacted log
-  bluefs_transaction_t t;
-  _compact_log_async_dump_metadata_NF(&t, seq_now);
+  // Only copy the metadata while the log is locked; encoding it is left
+  // for after the unlock so writers are not held up for that part.
+  log_snapshot_t snap;
+  _compact_log_async_capture_metadata_NF(&snap, seq_now);
 
-  // now state is captured to bufferlist
+  // now state is captured to snap
   // log can be used to write to, ops in log will be continuation of captured state
+  logger->tinc(l_bluefs_compaction_lock_lat, ceph::mono_clock::now() - lock_start);
   log.lock.unlock();
 
+  bluefs_transaction_t t;
+  _compact_log_async_dump_metadata(&t, snap);
+  snap = log_snapshot_t();
+
   uint64_t max_alloc_size = std::max(alloc_size[BDEV_WAL],
 				     std::max(alloc_size[BDEV_DB],
 					      alloc_size[BDEV_SLOW]));
@@ -2841,7 +2903,7 @@ int64_t BlueFS::_maybe_extend_log()
   return runway;
 }
 
-void BlueFS::_flush_and_sync_log_core(int64_t runway)
+uint64_t BlueFS::_flush_and_sync_log_core(int64_t runway)
 {
   ceph_assert(ceph_mutex_is_locked(log.lock));
   dout(10) << __func__ << " " << log.t << dendl;
@@ -2869,6 +2931,7 @@ void BlueFS::_flush_and_sync_log_core(int64_t runway)
 
   uint64_t new_data = _flush_special(log.writer);
   vselector->add_usage(log.writer->file->vselector_hint, new_data);
+  return bl.length();
 }
 
 // Clears dirty.files up to (including) seq_stable.
@@ -2933,6 +2996,7 @@ void BlueFS::_release_pending_allocations(vector<interval_set<uint64_t>>& to_rel
 
 int BlueFS::_flush_and_sync_log_LD(uint64_t want_seq)
 {
+  auto start = ceph::mono_clock::now();
   int64_t available_runway;
   do {
     log.lock.lock();
@@ -2966,7 +3030,7 @@ int BlueFS::_flush_and_sync_log_LD(uint64_t want_seq)
   to_release.swap(dirty.pending_release);
   dirty.lock.unlock();
 
-  _flush_and_sync_log_core(available_runway);
+  uint64_t written = _flush_and_sync_log_core(available_runway);
   _flush_bdev(log.writer);
   logger->set(l_bluefs_log_bytes, log.writer->file->fnode.size);
   //now log.lock is no longer needed
@@ -2975,6 +3039,10 @@ int BlueFS::_flush_and_sync_log_LD(uint64_t want_seq)
   _clear_dirty_set_stable_D(seq);
   _release_pending_allocations(to_release);
 
+  auto lat = ceph::mono_clock::now() - start;
+  logger->tinc(l_bluefs_log_flush_lat, lat);
+  logger->hinc(l_bluefs_log_flush_lat_hist,
+	       std::chrono::nanoseconds(lat).count(), written);
   _update_logger_stats();
   return 0;
 }
@@ -3129,7 +3197,8 @@ int BlueFS::_flush_range_F(FileWriter *h, uint64_t offset, uint64_t length)
     // in _flush_and_sync_log.
     int r = _allocate(vselector->select_prefer_bdev(h->file->vselector_hint),
 		      offset + length - allocated,
-		      &h->file->fnode);
+		      &h->file->fnode,
+		      h->write_hint);
     if (r < 0) {
       derr << __func__ << " allocated: 0x" << std::hex << allocated
            << " offset: 0x" << offset << " length: 0x" << length << std::dec
@@ -3202,7 +3271,8 @@ int BlueFS::_flush_data(FileWriter *h, uint64_t offset, uint64_t length, bool bu
     uint64_t x_len = std::min(p->length - x_off, length);
     bufferlist t;
     t.substr_of(bl, bloff, x_len);
-    if (cct->_conf->bluefs_sync_write) {
+    if (cct->_conf->bluefs_sync_write ||
+	(h->writer_type == WRITER_WAL && cct->_conf->bluefs_wal_sync_write)) {
       bdev[p->bdev]->write(p->offset + x_off, t, buffered, h->write_hint);
     } else {
       bdev[p->bdev]->aio_write(p->offset + x_off, t, h->iocv[p->bdev], buffered, h->write_hint);
@@ -3522,8 +3592,27 @@ int BlueFS::_allocate_without_fallback(uint8_t id, uint64_t len,
   return 0;
 }
 
+uint64_t BlueFS::_get_placement_hint(uint8_t id, int write_hint)
+{
+  // the shared device is BlueStore's to lay out, and files without a
+  // long lifetime fill dedicated devices from the start
+  if (!cct->_conf->bluefs_lifetime_placement ||
+      is_shared_alloc(id) ||
+      write_hint < WRITE_LIFE_LONG) {
+    return 0;
+  }
+  uint64_t hint = p2align(
+    uint64_t(alloc[id]->get_capacity() *
+	     cct->_conf->bluefs_lifetime_placement_cold_ratio),
+    alloc_size[id]);
+  dout(20) << __func__ << " bdev " << (int)id << " write_hint " << write_hint
+	   << " hint 0x" << std::hex << hint << std::dec << dendl;
+  return hint;
+}
+
 int BlueFS::_allocate(uint8_t id, uint64_t len,
-		      bluefs_fnode_t* node)
+		      bluefs_fnode_t* node,
+		      int write_hint)
 {
   dout(10) << __func__ << " len 0x" << std::hex << len << std::dec
            << " from " << (int)id << dendl;
@@ -3536,7 +3625,9 @@ int BlueFS::_allocate(uint8_t id, uint64_t len,
     need = round_up_to(len, alloc_size[id]);
     if (!node->extents.empty() && node->extents.back().bdev == id) {
       hint = node->extents.back().end();
-    }   
+    } else {
+      hint = _get_placement_hint(id, write_hint);
+    }
     extents.reserve(4);  // 4 should be (more than) enough for most allocations
     alloc_len = alloc[id]->allocate(need, alloc_size[id], hint, &extents);
   }
@@ -3564,7 +3655,7 @@ int BlueFS::_allocate(uint8_t id, uint64_t len,
       dout(20) << __func__ << " fallback to bdev "
 	       << (int)id + 1
 	       << dendl;
-      return _allocate(id + 1, len, node);
+      return _allocate(id + 1, len, node, write_hint);
     } else {
       derr << __func__ << " allocation failed, needed 0x" << std::hex << need
            << dendl;
@@ -3588,7 +3679,8 @@ int BlueFS::_allocate(uint8_t id, uint64_t len,
   return 0;
 }
 
-int BlueFS::preallocate(FileRef f, uint64_t off, uint64_t len)/*_LF*/
+int BlueFS::preallocate(FileRef f, uint64_t off, uint64_t len,
+			int write_hint)/*_LF*/
 {
   std::lock_guard ll(log.lock);
   std::lock_guard fl(f->lock);
@@ -3606,7 +3698,8 @@ int BlueFS::preallocate(FileRef f, uint64_t off, uint64_t len)/*_LF*/
     vselector->sub_usage(f->vselector_hint, f->fnode);
     int r = _allocate(vselector->select_prefer_bdev(f->vselector_hint),
       want,
-      &f->fnode);
+      &f->fnode,
+      write_hint);
     vselector->add_usage(f->vselector_hint, f->fnode);
     if (r < 0)
       return r;
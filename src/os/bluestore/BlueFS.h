@@ -63,6 +63,9 @@ enum {
   l_bluefs_read_prefetch_bytes,
   l_bluefs_read_zeros_candidate,
   l_bluefs_read_zeros_errors,
+  l_bluefs_log_flush_lat,
+  l_bluefs_log_flush_lat_hist,
+  l_bluefs_compaction_lock_lat,
 
   l_bluefs_last,
 };
@@ -418,7 +421,9 @@ private:
   }
   const char* get_device_name(unsigned id);
   int _allocate(uint8_t bdev, uint64_t len,
-		bluefs_fnode_t* node);
+		bluefs_fnode_t* node,
+		int write_hint = WRITE_LIFE_NOT_SET);
+  uint64_t _get_placement_hint(uint8_t id, int write_hint);
   int _allocate_without_fallback(uint8_t id, uint64_t len,
 				 PExtentVector* extents);
 
@@ -442,7 +447,7 @@ private:
   void _clear_dirty_set_stable_D(uint64_t seq_stable);
   void _release_pending_allocations(std::vector<interval_set<uint64_t>>& to_release);
 
-  void _flush_and_sync_log_core(int64_t available_runway);
+  uint64_t _flush_and_sync_log_core(int64_t available_runway);
   int _flush_and_sync_log_jump_D(uint64_t jump_to,
 			       int64_t available_runway);
   int _flush_and_sync_log_LD(uint64_t want_seq = 0);
@@ -458,8 +463,17 @@ private:
   };
   void _compact_log_dump_metadata_NF(bluefs_transaction_t *t,
 				 int flags);
-  void _compact_log_async_dump_metadata_NF(bluefs_transaction_t *t,
-					   uint64_t capture_before_seq);
+  /// metadata captured by async compaction while log.lock is held;
+  /// encoded into the new log head after the lock is released
+  struct log_snapshot_t {
+    std::vector<bluefs_fnode_t> files;
+    std::vector<std::pair<std::string,
+      std::vector<std::pair<std::string, uint64_t>>>> dirs;
+  };
+  void _compact_log_async_capture_metadata_NF(log_snapshot_t *snap,
+					      uint64_t capture_before_seq);
+  void _compact_log_async_dump_metadata(bluefs_transaction_t *t,
+					log_snapshot_t& snap);
 
   void _compact_log_sync_LNF_LD();
   void _compact_log_async_LD_LNF_D();
@@ -642,7 +656,8 @@ public:
     return _read_random(h, offset, len, out);
   }
   void invalidate_cache(FileRef f, uint64_t offset, uint64_t len);
-  int preallocate(FileRef f, uint64_t offset, uint64_t len);
+  int preallocate(FileRef f, uint64_t offset, uint64_t len,
+		  int write_hint = WRITE_LIFE_NOT_SET);
   int truncate(FileWriter *h, uint64_t offset);
 
   size_t probe_alloc_avail(int dev, uint64_t alloc_size);
@@ -309,7 +309,7 @@ class BlueRocksWritableFile : public rocksdb::WritableFile {
    * Pre-allocate space for a file.
    */
   rocksdb::Status Allocate(off_t offset, off_t len) {
-    int r = fs->preallocate(h->file, offset, len);
+    int r = fs->preallocate(h->file, offset, len, h->write_hint);
     return err_to_status(r);
   }
 };
@@ -20,6 +20,7 @@
 #include <algorithm>
 
 #include <boost/container/flat_set.hpp>
+#include <boost/container/small_vector.hpp>
 #include <boost/algorithm/string.hpp>
 
 #include "include/cpp-btree/btree_set.h"
@@ -33,6 +34,7 @@
 #include "include/stringify.h"
 #include "include/str_map.h"
 #include "include/util.h"
+#include "common/admin_socket.h"
 #include "common/errno.h"
 #include "common/safe_io.h"
 #include "common/PriorityCache.h"
@@ -1389,6 +1391,9 @@ public:
         break;
       case BUFFER_WARM_OUT:
         b->cache_private = BUFFER_HOT;
+        if (logger) {
+          logger->inc(l_bluestore_buffer_ghost_hit_bytes, b->length);
+        }
         // move to hot.  fall-thru
       case BUFFER_HOT:
         dout(20) << __func__ << " move to front of hot " << *b << dendl;
@@ -1650,6 +1655,257 @@ public:
 #endif
 };
 
+// ArcBufferCacheShard
+//
+// Adaptive Replacement Cache (Megiddo & Modha).  Resident buffers live
+// either on the recency list (t1, seen once) or the frequency list (t2,
+// seen at least twice).  Evicted buffers keep their extent as empty
+// "ghosts" on b1/b2; a later read or write that lands on a ghost moves
+// the t1 target size p towards the list that would have kept it cached.
+// A scan only ever populates t1, so it cannot wash out t2.
+//
+// All sizes are in bytes and are derived from max, so the priority cache
+// growing or shrinking this shard resizes the ghost lists along with it.
+
+struct ArcBufferCacheShard : public BlueStore::BufferCacheShard {
+  typedef boost::intrusive::list<
+    BlueStore::Buffer,
+    boost::intrusive::member_hook<
+      BlueStore::Buffer,
+      boost::intrusive::list_member_hook<>,
+      &BlueStore::Buffer::lru_item> > list_t;
+
+  // ordered so that the highest value wins when _discard() merges hints
+  enum {
+    BUFFER_NEW = 0,
+    BUFFER_T1,        ///< in t1 (recent)
+    BUFFER_B1,        ///< in b1 (evicted from t1)
+    BUFFER_T2,        ///< in t2 (frequent)
+    BUFFER_B2,        ///< in b2 (evicted from t2)
+    BUFFER_TYPE_MAX
+  };
+
+  list_t lists[BUFFER_TYPE_MAX];
+  uint64_t list_bytes[BUFFER_TYPE_MAX] = {0}; ///< bytes per type
+  uint64_t target_t1 = 0;                     ///< "p"
+
+  static bool is_ghost(int type) {
+    return type == BUFFER_B1 || type == BUFFER_B2;
+  }
+
+public:
+  explicit ArcBufferCacheShard(CephContext *cct) : BufferCacheShard(cct) {}
+
+  void _account(BlueStore::Buffer *b, int64_t delta) {
+    ceph_assert((int64_t)list_bytes[b->cache_private] + delta >= 0);
+    list_bytes[b->cache_private] += delta;
+    if (!b->is_empty()) {
+      ceph_assert((int64_t)buffer_bytes + delta >= 0);
+      buffer_bytes += delta;
+      assert(*(b->cache_age_bin) + delta >= 0);
+      *(b->cache_age_bin) += delta;
+    }
+  }
+
+  void _ghost_hit(BlueStore::Buffer *b) {
+    // grow the list whose ghost was hit, proportionally to how much
+    // smaller its ghost list is than the other one
+    uint64_t b1 = std::max<uint64_t>(list_bytes[BUFFER_B1], 1);
+    uint64_t b2 = std::max<uint64_t>(list_bytes[BUFFER_B2], 1);
+    if (b->cache_private == BUFFER_B1) {
+      uint64_t delta = b->length * std::max<uint64_t>(b2 / b1, 1);
+      target_t1 = std::min<uint64_t>(target_t1 + delta, max);
+    } else {
+      uint64_t delta = b->length * std::max<uint64_t>(b1 / b2, 1);
+      target_t1 = target_t1 > delta ? target_t1 - delta : 0;
+    }
+    if (logger) {
+      logger->inc(l_bluestore_buffer_ghost_hit_bytes, b->length);
+    }
+    dout(20) << __func__ << " " << *b << " target_t1 " << target_t1 << dendl;
+  }
+
+  void _add(BlueStore::Buffer *b, int level, BlueStore::Buffer *near) override
+  {
+    dout(20) << __func__ << " level " << level << " near " << near
+             << " on " << *b
+             << " which has cache_private " << b->cache_private << dendl;
+    if (near) {
+      b->cache_private = near->cache_private;
+      ceph_assert(b->cache_private > BUFFER_NEW &&
+                  b->cache_private < BUFFER_TYPE_MAX);
+      ceph_assert(is_ghost(b->cache_private) == b->is_empty());
+      auto& l = lists[b->cache_private];
+      l.insert(l.iterator_to(*near), *b);
+    } else {
+      // new data, or a hint from discard of what the extent was before
+      switch (b->cache_private) {
+      case BUFFER_NEW:
+        b->cache_private = BUFFER_T1;
+        break;
+      case BUFFER_B1:
+      case BUFFER_B2:
+        _ghost_hit(b);
+        // fall-thru
+      case BUFFER_T1:
+      case BUFFER_T2:
+        b->cache_private = BUFFER_T2;
+        break;
+      default:
+        ceph_abort_msg("bad cache_private");
+      }
+      auto& l = lists[b->cache_private];
+      if (level > 0) {
+        l.push_front(*b);
+      } else {
+        l.push_back(*b);
+      }
+    }
+    b->cache_age_bin = age_bins.front();
+    _account(b, b->length);
+    num = lists[BUFFER_T1].size() + lists[BUFFER_T2].size();
+  }
+
+  void _rm(BlueStore::Buffer *b) override
+  {
+    dout(20) << __func__ << " " << *b << dendl;
+    ceph_assert(b->cache_private > BUFFER_NEW &&
+                b->cache_private < BUFFER_TYPE_MAX);
+    _account(b, -(int64_t)b->length);
+    auto& l = lists[b->cache_private];
+    l.erase(l.iterator_to(*b));
+    num = lists[BUFFER_T1].size() + lists[BUFFER_T2].size();
+  }
+
+  void _move(BlueStore::BufferCacheShard *srcc, BlueStore::Buffer *b) override
+  {
+    ArcBufferCacheShard *src = static_cast<ArcBufferCacheShard*>(srcc);
+    src->_rm(b);
+    // preserve which list we're on (even if we can't preserve the order!)
+    ceph_assert(is_ghost(b->cache_private) == b->is_empty());
+    lists[b->cache_private].push_back(*b);
+    b->cache_age_bin = age_bins.front();
+    _account(b, b->length);
+    num = lists[BUFFER_T1].size() + lists[BUFFER_T2].size();
+  }
+
+  void _adjust_size(BlueStore::Buffer *b, int64_t delta) override
+  {
+    dout(20) << __func__ << " delta " << delta << " on " << *b << dendl;
+    _account(b, delta);
+  }
+
+  void _touch(BlueStore::Buffer *b) override {
+    switch (b->cache_private) {
+    case BUFFER_T1:
+      // second reference, promote to the frequency list
+      list_bytes[BUFFER_T1] -= b->length;
+      lists[BUFFER_T1].erase(lists[BUFFER_T1].iterator_to(*b));
+      b->cache_private = BUFFER_T2;
+      list_bytes[BUFFER_T2] += b->length;
+      lists[BUFFER_T2].push_front(*b);
+      break;
+    case BUFFER_T2:
+      lists[BUFFER_T2].erase(lists[BUFFER_T2].iterator_to(*b));
+      lists[BUFFER_T2].push_front(*b);
+      break;
+    default:
+      ceph_abort_msg("touch on a ghost buffer");
+    }
+    *(b->cache_age_bin) -= b->length;
+    b->cache_age_bin = age_bins.front();
+    *(b->cache_age_bin) += b->length;
+    _audit("_touch_buffer end");
+  }
+
+  void _evict_to_ghost(int from, int to) {
+    BlueStore::Buffer *b = &*lists[from].rbegin();
+    ceph_assert(b->is_clean());
+    dout(20) << __func__ << " " << from << " -> " << to << " " << *b << dendl;
+    _account(b, -(int64_t)b->length);
+    lists[from].erase(lists[from].iterator_to(*b));
+    b->state = BlueStore::Buffer::STATE_EMPTY;
+    b->data.clear();
+    b->cache_private = to;
+    lists[to].push_front(*b);
+    list_bytes[to] += b->length;
+  }
+
+  void _trim_ghost(int type) {
+    BlueStore::Buffer *b = &*lists[type].rbegin();
+    ceph_assert(b->is_empty());
+    dout(20) << __func__ << " rm " << *b << dendl;
+    b->space->_rm_buffer(this, b);
+  }
+
+  void _trim_to(uint64_t max) override
+  {
+    target_t1 = std::min<uint64_t>(target_t1, max);
+    while (buffer_bytes > max) {
+      // REPLACE: evict from t1 while it is above its target, else from t2
+      bool t1_over = list_bytes[BUFFER_T1] > 0 &&
+        (list_bytes[BUFFER_T1] > target_t1 || lists[BUFFER_T2].empty());
+      if (t1_over) {
+        _evict_to_ghost(BUFFER_T1, BUFFER_B1);
+      } else if (!lists[BUFFER_T2].empty()) {
+        _evict_to_ghost(BUFFER_T2, BUFFER_B2);
+      } else {
+        break;
+      }
+    }
+    // |t1| + |b1| <= c and |t1| + |t2| + |b1| + |b2| <= 2c
+    while (!lists[BUFFER_B1].empty() &&
+           list_bytes[BUFFER_T1] + list_bytes[BUFFER_B1] > max) {
+      _trim_ghost(BUFFER_B1);
+    }
+    while (!lists[BUFFER_B2].empty() &&
+           buffer_bytes + list_bytes[BUFFER_B1] + list_bytes[BUFFER_B2] >
+             2 * max) {
+      _trim_ghost(BUFFER_B2);
+    }
+    num = lists[BUFFER_T1].size() + lists[BUFFER_T2].size();
+  }
+
+  void add_stats(uint64_t *extents,
+                 uint64_t *blobs,
+                 uint64_t *buffers,
+                 uint64_t *bytes) override {
+    *extents += num_extents;
+    *blobs += num_blobs;
+    *buffers += num;
+    *bytes += buffer_bytes;
+  }
+
+#ifdef DEBUG_CACHE
+  void _audit(const char *when) override
+  {
+    dout(10) << __func__ << " " << when << " start" << dendl;
+    uint64_t resident = 0;
+    for (int t = BUFFER_T1; t < BUFFER_TYPE_MAX; ++t) {
+      uint64_t s = 0;
+      for (auto& b : lists[t]) {
+        s += b.length;
+      }
+      if (s != list_bytes[t]) {
+        derr << __func__ << " list " << t << " bytes " << list_bytes[t]
+             << " != actual " << s << dendl;
+        ceph_assert(s == list_bytes[t]);
+      }
+      if (!is_ghost(t)) {
+        resident += s;
+      }
+    }
+    if (resident != buffer_bytes) {
+      derr << __func__ << " buffer_bytes " << buffer_bytes
+           << " actual " << resident << dendl;
+      ceph_assert(resident == buffer_bytes);
+    }
+    dout(20) << __func__ << " " << when << " buffer_bytes " << buffer_bytes
+             << " ok" << dendl;
+  }
+#endif
+};
+
 // BuferCacheShard
 
 BlueStore::BufferCacheShard *BlueStore::BufferCacheShard::create(
@@ -1662,6 +1918,8 @@ BlueStore::BufferCacheShard *BlueStore::BufferCacheShard::create(
     c = new LruBufferCacheShard(cct);
   else if (type == "2q")
     c = new TwoQBufferCacheShard(cct);
+  else if (type == "arc")
+    c = new ArcBufferCacheShard(cct);
   else
     ceph_abort_msg("unrecognized cache type");
   c->logger = logger;
@@ -1925,16 +2183,20 @@ BlueStore::OnodeRef BlueStore::OnodeSpace::add(const ghobject_t& oid,
   OnodeRef& o)
 {
   std::lock_guard l(cache->lock);
-  auto p = onode_map.find(oid);
-  if (p != onode_map.end()) {
-    ldout(cache->cct, 30) << __func__ << " " << oid << " " << o
-			  << " raced, returning existing " << p->second
-			  << dendl;
-    return p->second;
+  {
+    std::unique_lock ml(map_lock);
+    auto p = onode_map.find(oid);
+    if (p != onode_map.end()) {
+      ldout(cache->cct, 30) << __func__ << " " << oid << " " << o
+			    << " raced, returning existing " << p->second
+			    << dendl;
+      return p->second;
+    }
+    ldout(cache->cct, 20) << __func__ << " " << oid << " " << o << dendl;
+    onode_map[oid] = o;
   }
-  ldout(cache->cct, 20) << __func__ << " " << oid << " " << o << dendl;
-  onode_map[oid] = o;
   cache->_add(o.get(), 1);
+  // trim may call back into _remove(), hence map_lock must be released
   cache->_trim();
   return o;
 }
@@ -1942,51 +2204,73 @@ BlueStore::OnodeRef BlueStore::OnodeSpace::add(const ghobject_t& oid,
 void BlueStore::OnodeSpace::_remove(const ghobject_t& oid)
 {
   ldout(cache->cct, 20) << __func__ << " " << oid << " " << dendl;
-  onode_map.erase(oid);
+  // release the reference only after map_lock is dropped as put()
+  // might get back to us
+  OnodeRef o;
+  std::unique_lock ml(map_lock);
+  auto p = onode_map.find(oid);
+  if (p != onode_map.end()) {
+    o.swap(p->second);
+    onode_map.erase(p);
+  }
+  ml.unlock();
 }
 
 BlueStore::OnodeRef BlueStore::OnodeSpace::lookup(const ghobject_t& oid)
 {
   ldout(cache->cct, 30) << __func__ << dendl;
-  OnodeRef o;
-
-  {
-    std::lock_guard l(cache->lock);
-    ceph::unordered_map<ghobject_t,OnodeRef>::iterator p = onode_map.find(oid);
-    if (p == onode_map.end()) {
-      cache->logger->inc(l_bluestore_onode_misses);
-      ldout(cache->cct, 30) << __func__ << " " << oid << " miss" << dendl;
-    } else {
+  while (true) {
+    Onode* o = nullptr;
+    {
+      std::shared_lock ml(map_lock);
+      auto p = onode_map.find(oid);
+      if (p == onode_map.end()) {
+	cache->logger->inc(l_bluestore_onode_misses);
+	ldout(cache->cct, 30) << __func__ << " " << oid << " miss" << dendl;
+	return OnodeRef();
+      }
       ldout(cache->cct, 30) << __func__ << " " << oid << " hit " << p->second
-                            << " " << p->second->nref
-                            << " " << p->second->cached
-                            << " " << p->second->pinned
+			    << " " << p->second->nref
+			    << " " << p->second->cached
+			    << " " << p->second->pinned
 			    << dendl;
-      // This will pin onode and implicitly touch the cache when Onode
-      // eventually will become unpinned
-      o = p->second;
-      ceph_assert(!o->cached || o->pinned);
-
+      // Onode::get() would need cache->lock which must not be taken
+      // under map_lock, so just grab a reference here. The map still
+      // holds its own one hence the onode can't go away meanwhile.
+      o = p->second.get();
+      ++o->nref;
+    }
+    // This will pin onode and implicitly touch the cache when Onode
+    // eventually will become unpinned
+    if (o->get_cached()) {
       cache->logger->inc(l_bluestore_onode_hits);
+      return OnodeRef(o, false);
     }
+    // onode has been trimmed after we released map_lock, retry
+    ldout(cache->cct, 20) << __func__ << " " << oid << " raced with trim "
+			  << o << dendl;
+    cache->logger->inc(l_bluestore_onode_lookup_retries);
+    o->put();
   }
-
-  return o;
 }
 
 void BlueStore::OnodeSpace::clear()
 {
   std::lock_guard l(cache->lock);
   ldout(cache->cct, 10) << __func__ << " " << onode_map.size()<< dendl;
-  for (auto &p : onode_map) {
+  decltype(onode_map) removed;
+  {
+    std::unique_lock ml(map_lock);
+    removed.swap(onode_map);
+  }
+  for (auto &p : removed) {
     cache->_rm(p.second.get());
   }
-  onode_map.clear();
 }
 
 bool BlueStore::OnodeSpace::empty()
 {
-  std::lock_guard l(cache->lock);
+  std::shared_lock ml(map_lock);
   return onode_map.empty();
 }
 
@@ -1999,6 +2283,9 @@ void BlueStore::OnodeSpace::rename(
   std::lock_guard l(cache->lock);
   ldout(cache->cct, 30) << __func__ << " " << old_oid << " -> " << new_oid
 			<< dendl;
+  // references dropped from the map are released after map_lock
+  OnodeRef removed_target, o;
+  std::unique_lock ml(map_lock);
   ceph::unordered_map<ghobject_t,OnodeRef>::iterator po, pn;
   po = onode_map.find(old_oid);
   pn = onode_map.find(new_oid);
@@ -2009,28 +2296,36 @@ void BlueStore::OnodeSpace::rename(
     ldout(cache->cct, 30) << __func__ << "  removing target " << pn->second
 			  << dendl;
     cache->_rm(pn->second.get());
+    removed_target.swap(pn->second);
     onode_map.erase(pn);
   }
-  OnodeRef o = po->second;
+  o = po->second;
+  // insert might rehash and invalidate po
+  OnodeRef& old_slot = po->second;
 
-  // install a non-existent onode at old location
-  oldo.reset(new Onode(o->c, old_oid, o->key));
-  po->second = oldo;
-  cache->_add(oldo.get(), 1);
   // add at new position and fix oid, key.
   // This will pin 'o' and implicitly touch cache
-  // when it will eventually become unpinned
+  // when it will eventually become unpinned.
+  // Do that before dropping the old slot's reference so that 'o'
+  // never gets unpinned while map_lock is held.
   onode_map.insert(make_pair(new_oid, o));
   ceph_assert(o->pinned);
 
+  // install a non-existent onode at old location
+  oldo.reset(new Onode(o->c, old_oid, o->key));
+  old_slot = oldo;
+  cache->_add(oldo.get(), 1);
+
   o->oid = new_oid;
   o->key = new_okey;
+  ml.unlock();
   cache->_trim();
 }
 
 bool BlueStore::OnodeSpace::map_any(std::function<bool(Onode*)> f)
 {
   std::lock_guard l(cache->lock);
+  std::shared_lock ml(map_lock);
   ldout(cache->cct, 20) << __func__ << dendl;
   for (auto& i : onode_map) {
     if (f(i.second.get())) {
@@ -3145,10 +3440,17 @@ unsigned BlueStore::ExtentMap::decode_some(bufferlist& bl)
 
   uint32_t num;
   denc_varint(num, p);
-  vector<BlobRef> blobs(num);
+  // scratch table of the blobs defined in this shard; shards are small so
+  // it normally stays on the stack. Single-blob shards go through the same
+  // path: extent_map is walked as an intrusive set all over, so there is
+  // no cheaper flat form to decode them into.
+  boost::container::small_vector<BlobRef, 32> blobs(num);
   uint64_t pos = 0;
   uint64_t prev_len = 0;
   unsigned n = 0;
+  // extents are encoded in logical order, so each one goes right after
+  // the previous one and the insert is amortized O(1)
+  auto hint = extent_map.end();
 
   while (!p.end()) {
     Extent *le = new Extent();
@@ -3195,7 +3497,7 @@ unsigned BlueStore::ExtentMap::decode_some(bufferlist& bl)
     }
     pos += prev_len;
     ++n;
-    extent_map.insert(*le);
+    hint = std::next(extent_map.insert(hint, *le));
   }
 
   ceph_assert(n == num);
@@ -3283,39 +3585,131 @@ void BlueStore::ExtentMap::fault_range(
     return;
 
   ceph_assert(last >= start);
-  string key;
-  while (start <= last) {
-    ceph_assert((size_t)start < shards.size());
-    auto p = &shards[start];
+  _load_shards(db, start, last, 0, offset, length);
+}
+
+void BlueStore::ExtentMap::fault_range_for_read(
+  KeyValueDB *db,
+  uint32_t offset,
+  uint32_t length)
+{
+  dout(30) << __func__ << " 0x" << std::hex << offset << "~" << length
+	   << std::dec << dendl;
+  auto start = seek_shard(offset);
+  auto last = seek_shard(offset + length);
+
+  int ahead = 0;
+  if (offset > 0 && offset == last_read_end) {
+    ahead = onode->c->store->cct->_conf->bluestore_extent_map_readahead_shards;
+  }
+  last_read_end = offset + length;
+
+  if (start < 0)
+    return;
+
+  ceph_assert(last >= start);
+  _load_shards(db, start, last, ahead, offset, length);
+}
+
+void BlueStore::ExtentMap::_load_shards(
+  KeyValueDB *db,
+  int start,
+  int last,
+  int ahead,
+  uint32_t offset,
+  uint32_t length)
+{
+  auto logger = onode->c->store->logger;
+  int end = std::min<int>(last + ahead, shards.size() - 1);
+  vector<int> to_load;
+  for (int i = start; i <= end; ++i) {
+    ceph_assert((size_t)i < shards.size());
+    auto p = &shards[i];
     if (!p->loaded) {
-      dout(30) << __func__ << " opening shard 0x" << std::hex
-	       << p->shard_info->offset << std::dec << dendl;
-      bufferlist v;
-      generate_extent_shard_key_and_apply(
-	onode->key, p->shard_info->offset, &key,
-        [&](const string& final_key) {
-          int r = db->get(PREFIX_OBJ, final_key, &v);
-          if (r < 0) {
-	    derr << __func__ << " missing shard 0x" << std::hex
-		 << p->shard_info->offset << std::dec << " for " << onode->oid
-		 << dendl;
-	    ceph_assert(r >= 0);
-          }
-        }
-      );
-      p->extents = decode_some(v);
-      p->loaded = true;
-      dout(20) << __func__ << " open shard 0x" << std::hex
-	       << p->shard_info->offset
-	       << " for range 0x" << offset << "~" << length << std::dec
-	       << " (" << v.length() << " bytes)" << dendl;
-      ceph_assert(p->dirty == false);
-      ceph_assert(v.length() == p->shard_info->bytes);
-      onode->c->store->logger->inc(l_bluestore_onode_shard_misses);
+      to_load.push_back(i);
+    } else if (i <= last) {
+      logger->inc(l_bluestore_onode_shard_hits);
+      if (p->prefetched) {
+	logger->inc(l_bluestore_onode_shard_prefetch_hits);
+	p->prefetched = false;
+      }
+    }
+  }
+  if (to_load.empty()) {
+    return;
+  }
+
+  auto load = [&](int i, bufferlist& v) {
+    auto p = &shards[i];
+    p->extents = decode_some(v);
+    p->loaded = true;
+    dout(20) << __func__ << " open shard 0x" << std::hex
+	     << p->shard_info->offset
+	     << " for range 0x" << offset << "~" << length << std::dec
+	     << " (" << v.length() << " bytes)" << dendl;
+    ceph_assert(p->dirty == false);
+    ceph_assert(v.length() == p->shard_info->bytes);
+    if (i <= last) {
+      logger->inc(l_bluestore_onode_shard_misses);
     } else {
-      onode->c->store->logger->inc(l_bluestore_onode_shard_hits);
+      p->prefetched = true;
+      logger->inc(l_bluestore_onode_shard_prefetched);
     }
-    ++start;
+  };
+  auto missing = [&](int i, int r) {
+    derr << __func__ << " missing shard 0x" << std::hex
+	 << shards[i].shard_info->offset << std::dec << " for " << onode->oid
+	 << dendl;
+    ceph_assert(r >= 0);
+  };
+
+  string key;
+  if (to_load.size() == 1) {
+    auto i = to_load.front();
+    dout(30) << __func__ << " opening shard 0x" << std::hex
+	     << shards[i].shard_info->offset << std::dec << dendl;
+    bufferlist v;
+    generate_extent_shard_key_and_apply(
+      onode->key, shards[i].shard_info->offset, &key,
+      [&](const string& final_key) {
+	int r = db->get(PREFIX_OBJ, final_key, &v);
+	if (r < 0) {
+	  missing(i, r);
+	}
+      }
+    );
+    load(i, v);
+    return;
+  }
+
+  // shard keys of an onode are adjacent in the key space, so fetch
+  // them with a single seek instead of a point lookup per shard
+  dout(30) << __func__ << " opening " << to_load.size() << " shards from 0x"
+	   << std::hex << shards[to_load.front()].shard_info->offset
+	   << std::dec << dendl;
+  auto it = db->get_iterator(PREFIX_OBJ);
+  for (auto i : to_load) {
+    generate_extent_shard_key_and_apply(
+      onode->key, shards[i].shard_info->offset, &key,
+      [&](const string& final_key) {
+	if (i == to_load.front()) {
+	  it->lower_bound(final_key);
+	}
+	while (it->valid() && it->key() < final_key) {
+	  it->next();
+	}
+	bufferlist v;
+	if (it->valid() && it->key() == final_key) {
+	  v = it->value();
+	} else {
+	  int r = db->get(PREFIX_OBJ, final_key, &v);
+	  if (r < 0) {
+	    missing(i, r);
+	  }
+	}
+	load(i, v);
+      }
+    );
   }
 }
 
@@ -3657,16 +4051,23 @@ void BlueStore::Onode::calc_omap_tail(
   out->push_back('~');
 }
 
+BlueStore::OnodeCacheShard* BlueStore::Onode::lock_cache() {
+  OnodeCacheShard* ocs = c->get_onode_cache();
+  if (!ocs->lock.try_lock()) {
+    ocs->logger->inc(l_bluestore_onode_cache_lock_contended);
+    ocs->lock.lock();
+  }
+  // It is possible that during waiting split_cache moved us to different OnodeCacheShard.
+  while (ocs != c->get_onode_cache()) {
+    ocs->lock.unlock();
+    ocs = c->get_onode_cache();
+    ocs->lock.lock();
+  }
+  return ocs;
+}
 void BlueStore::Onode::get() {
   if (++nref >= 2 && !pinned) {
-    OnodeCacheShard* ocs = c->get_onode_cache();
-    ocs->lock.lock();
-    // It is possible that during waiting split_cache moved us to different OnodeCacheShard.
-    while (ocs != c->get_onode_cache()) {
-      ocs->lock.unlock();
-      ocs = c->get_onode_cache();
-      ocs->lock.lock();
-    }
+    OnodeCacheShard* ocs = lock_cache();
     bool was_pinned = pinned;
     pinned = nref >= 2;
     bool r = !was_pinned && pinned;
@@ -3676,18 +4077,31 @@ void BlueStore::Onode::get() {
     ocs->lock.unlock();
   }
 }
+// Complete the reference taken by OnodeSpace::lookup() under map_lock.
+// Returns false if the onode has been trimmed meanwhile, the caller
+// should put() it then.
+bool BlueStore::Onode::get_cached() {
+  if (pinned) {
+    // pinned onodes aren't subject to trim
+    return true;
+  }
+  OnodeCacheShard* ocs = lock_cache();
+  bool r = cached;
+  if (r) {
+    bool was_pinned = pinned;
+    pinned = nref >= 2;
+    if (!was_pinned && pinned) {
+      ocs->_pin(this);
+    }
+  }
+  ocs->lock.unlock();
+  return r;
+}
 void BlueStore::Onode::put() {
   ++put_nref;
   int n = --nref;
   if (n == 1) {
-    OnodeCacheShard* ocs = c->get_onode_cache();
-    ocs->lock.lock();
-    // It is possible that during waiting split_cache moved us to different OnodeCacheShard.
-    while (ocs != c->get_onode_cache()) {
-      ocs->lock.unlock();
-      ocs = c->get_onode_cache();
-      ocs->lock.lock();
-    }
+    OnodeCacheShard* ocs = lock_cache();
     bool need_unpin = pinned;
     pinned = pinned && nref >= 2;
     need_unpin = need_unpin && !pinned;
@@ -4120,8 +4534,12 @@ void BlueStore::Collection::split_cache(
       OnodeRef o_pin = o;
       ceph_assert(o->pinned);
 
-      p = onode_map.onode_map.erase(p);
-      dest->onode_map.onode_map[o->oid] = o;
+      {
+	std::unique_lock ml(onode_map.map_lock);
+	std::unique_lock dml(dest->onode_map.map_lock);
+	p = onode_map.onode_map.erase(p);
+	dest->onode_map.onode_map[o->oid] = o;
+      }
       if (o->cached) {
         get_onode_cache()->move_pinned(dest->get_onode_cache(), o.get());
       }
@@ -4976,6 +5394,9 @@ void BlueStore::_init_logger()
 {
   PerfCountersBuilder b(cct, "bluestore",
                         l_bluestore_first, l_bluestore_last);
+  // latencies and throughput counters are updated by every kv and
+  // op shard thread
+  b.set_sharded();
 
   // space utilization stats
   //****************************************
@@ -5037,6 +5458,10 @@ void BlueStore::_init_logger()
 
   // Update Transaction stats
   //****************************************
+  // transaction, read and kv_thread latencies keep a distribution too
+  b.set_latency_histogram(cct->_conf->perf_latency_histogram_precision,
+			 cct->_conf.get_val<std::chrono::seconds>(
+			   "perf_latency_histogram_window"));
   b.add_time_avg(l_bluestore_throttle_lat, "txc_throttle_lat",
 		 "Average submit throttle latency",
 		 "th_l", PerfCountersBuilder::PRIO_CRITICAL);
@@ -5084,6 +5509,7 @@ void BlueStore::_init_logger()
   b.add_time_avg(l_bluestore_kv_final_lat, "kv_final_lat",
 		 "Average kv_finalize thread latency",
 		 "kfll", PerfCountersBuilder::PRIO_INTERESTING);
+  b.set_latency_histogram(0);
   //****************************************
 
   // write op stats
@@ -5144,6 +5570,12 @@ void BlueStore::_init_logger()
 		    NULL,
 		    PerfCountersBuilder::PRIO_DEBUGONLY,
 		    unit_t(UNIT_BYTES));
+  b.add_u64_counter(l_bluestore_deferred_merged_submits,
+		    "deferred_merged_submits",
+		    "Deferred submissions merging ios of several sequencers");
+  b.add_u64_counter(l_bluestore_deferred_merged_batches,
+		    "deferred_merged_batches",
+		    "Sequencer deferred batches included in merged submissions");
 
   b.add_u64_counter(l_bluestore_write_big_skipped_blobs,
       "write_big_skipped_blobs",
@@ -5199,6 +5631,18 @@ void BlueStore::_init_logger()
   b.add_u64_counter(l_bluestore_onode_shard_misses,
 		    "onode_shard_misses",
 		    "Count of onode shard cache lookups misses");
+  b.add_u64_counter(l_bluestore_onode_shard_prefetched,
+		    "onode_shard_prefetched",
+		    "Count of onode shards loaded ahead on sequential reads");
+  b.add_u64_counter(l_bluestore_onode_shard_prefetch_hits,
+		    "onode_shard_prefetch_hits",
+		    "Count of onode shards loaded ahead and accessed later");
+  b.add_u64_counter(l_bluestore_onode_lookup_retries,
+		    "onode_lookup_retries",
+		    "Count of onode cache lookups raced with cache trimming");
+  b.add_u64_counter(l_bluestore_onode_cache_lock_contended,
+		    "onode_cache_lock_contended",
+		    "Count of onode pin/unpin operations waiting for cache shard lock");
   b.add_u64(l_bluestore_extents, "onode_extents",
 	    "Number of extents in cache");
   b.add_u64(l_bluestore_blobs, "onode_blobs",
@@ -5224,6 +5668,11 @@ void BlueStore::_init_logger()
 	    NULL,
 	    PerfCountersBuilder::PRIO_DEBUGONLY,
 	    unit_t(UNIT_BYTES));
+  b.add_u64_counter(l_bluestore_buffer_ghost_hit_bytes, "buffer_ghost_hit_bytes",
+	    "Sum for bytes re-cached shortly after being evicted",
+	    NULL,
+	    PerfCountersBuilder::PRIO_DEBUGONLY,
+	    unit_t(UNIT_BYTES));
   //****************************************
 
   // internal stats
@@ -8359,6 +8808,33 @@ BlueStore::OnodeRef BlueStore::fsck_check_objects_shallow(
   return o;
 }
 
+int64_t BlueStore::fsck_deep_read_object(CollectionRef& c, OnodeRef& o)
+{
+  // fsck runs on an unmounted store and the fsck loop is done with 'o'
+  // once it's queued, so nothing writes to the collection meanwhile; the
+  // lock just keeps _do_read()'s contract, as BlueStore::read() does
+  std::shared_lock l(c->lock);
+  bufferlist bl;
+  uint64_t max_read_block = cct->_conf->bluestore_fsck_read_bytes_cap;
+  uint64_t offset = 0;
+  do {
+    uint64_t l = std::min(uint64_t(o->onode.size - offset), max_read_block);
+    int r = _do_read(c.get(), o, offset, l, bl,
+      CEPH_OSD_OP_FLAG_FADVISE_NOCACHE);
+    if (r < 0) {
+      derr << "fsck error: " << o->oid << std::hex
+        << " error during read: "
+        << " " << offset << "~" << l
+        << " " << cpp_strerror(r) << std::dec
+        << dendl;
+      return 1;
+    }
+    fsck_progress.read_bytes += l;
+    offset += l;
+  } while (offset < o->onode.size);
+  return 0;
+}
+
 #include "common/WorkQueue.h"
 
 class ShallowFSCKThreadPool : public ThreadPool
@@ -8607,6 +9083,63 @@ public:
   };
 };
 
+/// Reads object data for deep fsck on a thread pool so the keyspace
+/// walk doesn't wait for the device on every object.  The number of
+/// objects queued but not yet read is capped to bound memory usage.
+class FSCKDeepReadWQ : public ThreadPool::WorkQueueVal<
+  std::pair<BlueStore::CollectionRef, BlueStore::OnodeRef>>
+{
+  typedef std::pair<BlueStore::CollectionRef, BlueStore::OnodeRef> item_t;
+
+  BlueStore* store;
+  std::deque<item_t> items;  // protected by the pool lock
+
+  ceph::mutex throttle_lock = ceph::make_mutex("FSCKDeepReadWQ::throttle_lock");
+  ceph::condition_variable throttle_cond;
+  size_t max_in_flight;
+  size_t in_flight = 0;
+
+  void _enqueue(item_t item) override {
+    items.push_back(std::move(item));
+  }
+  void _enqueue_front(item_t item) override {
+    items.push_front(std::move(item));
+  }
+  bool _empty() override {
+    return items.empty();
+  }
+  item_t _dequeue() override {
+    item_t item = std::move(items.front());
+    items.pop_front();
+    return item;
+  }
+  void _process(item_t item, ThreadPool::TPHandle&) override {
+    errors += store->fsck_deep_read_object(item.first, item.second);
+    std::lock_guard l(throttle_lock);
+    --in_flight;
+    throttle_cond.notify_one();
+  }
+
+public:
+  std::atomic<int64_t> errors = {0};
+
+  FSCKDeepReadWQ(BlueStore* _store, ThreadPool* tp, size_t _max_in_flight)
+    : ThreadPool::WorkQueueVal<item_t>(
+        "FSCKDeepReadWQ", ceph::timespan::zero(), ceph::timespan::zero(), tp),
+      store(_store),
+      max_in_flight(_max_in_flight) {
+  }
+
+  void queue_read(BlueStore::CollectionRef c, BlueStore::OnodeRef o) {
+    {
+      std::unique_lock l(throttle_lock);
+      throttle_cond.wait(l, [this] { return in_flight < max_in_flight; });
+      ++in_flight;
+    }
+    queue(std::make_pair(std::move(c), std::move(o)));
+  }
+};
+
 void BlueStore::_fsck_check_object_omap(FSCKDepth depth,
   OnodeRef& o,
   const BlueStore::FSCK_ObjectCtx& ctx)
@@ -8771,6 +9304,14 @@ void BlueStore::_fsck_check_objects(
   mempool::bluestore_fsck::list<string> expecting_shards;
   if (it) {
     const size_t thread_count = cct->_conf->bluestore_fsck_quick_fix_threads;
+    const size_t read_thread_count = depth == FSCK_DEEP ?
+      cct->_conf->bluestore_fsck_deep_read_threads : 0;
+    ThreadPool read_pool(cct, "FSCKDeepReadThreadPool", "FSCKDeepRead",
+      read_thread_count);
+    FSCKDeepReadWQ read_wq(this, &read_pool, read_thread_count * 4);
+    if (read_thread_count > 0) {
+      read_pool.start();
+    }
     typedef ShallowFSCKThreadPool::FSCKWorkQueue<256> WQ;
     std::unique_ptr<WQ> wq(
       new WQ(
@@ -8798,6 +9339,7 @@ void BlueStore::_fsck_check_objects(
     for (it->lower_bound(string()); it->valid(); it->next()) {
       dout(30) << __func__ << " key "
         << pretty_binary_string(it->key()) << dendl;
+      fsck_progress.walked_bytes += it->key().size() + it->value().length();
       if (is_extent_shard_key(it->key())) {
         if (depth == FSCK_SHALLOW) {
           continue;
@@ -8882,6 +9424,7 @@ void BlueStore::_fsck_check_objects(
         expecting_shards.clear();
       }
 
+      ++fsck_progress.objects;
       bool queued = false;
       if (depth == FSCK_SHALLOW && thread_count > 0) {
         queued = wq->queue(
@@ -8976,27 +9519,19 @@ void BlueStore::_fsck_check_objects(
           }
         } // if (o->onode.has_omap())
         if (depth == FSCK_DEEP) {
-          bufferlist bl;
-          uint64_t max_read_block = cct->_conf->bluestore_fsck_read_bytes_cap;
-          uint64_t offset = 0;
-          do {
-            uint64_t l = std::min(uint64_t(o->onode.size - offset), max_read_block);
-            int r = _do_read(c.get(), o, offset, l, bl,
-              CEPH_OSD_OP_FLAG_FADVISE_NOCACHE);
-            if (r < 0) {
-              ++errors;
-              derr << "fsck error: " << oid << std::hex
-                << " error during read: "
-                << " " << offset << "~" << l
-                << " " << cpp_strerror(r) << std::dec
-                << dendl;
-              break;
-            }
-            offset += l;
-          } while (offset < o->onode.size);
+          if (read_thread_count > 0) {
+            read_wq.queue_read(c, o);
+          } else {
+            errors += fsck_deep_read_object(c, o);
+          }
         } // deep
       } //if (depth != FSCK_SHALLOW)
     } // for (it->lower_bound(string()); it->valid(); it->next())
+    if (read_thread_count > 0) {
+      read_wq.drain();
+      read_pool.stop();
+      errors += read_wq.errors;
+    }
     if (depth == FSCK_SHALLOW && thread_count > 0) {
       wq->finalize(thread_pool, ctx);
       if (processed_myself) {
@@ -9096,6 +9631,67 @@ int BlueStore::_fsck(BlueStore::FSCKDepth depth, bool repair)
   return _fsck_on_open(depth, repair);
 }
 
+void BlueStore::fsck_progress_t::dump(Formatter *f) const
+{
+  auto elapsed = ceph::mono_clock::now() - start;
+  uint64_t walked = walked_bytes;
+  f->dump_string("depth",
+    depth == FSCK_DEEP ? "deep" :
+      depth == FSCK_SHALLOW ? "shallow" : "regular");
+  f->dump_float("elapsed", std::chrono::duration<double>(elapsed).count());
+  f->dump_unsigned("objects", objects);
+  f->dump_unsigned("keyspace_walked", walked);
+  f->dump_unsigned("keyspace_estimate", keyspace_bytes);
+  f->dump_unsigned("data_read", read_bytes);
+  // the walk may overrun a stale estimate; report no eta rather than a
+  // negative one in that case
+  if (walked && walked < keyspace_bytes) {
+    double done = double(walked) / keyspace_bytes;
+    f->dump_float("progress", done);
+    f->dump_float("eta",
+      std::chrono::duration<double>(elapsed).count() * (1 - done) / done);
+  }
+}
+
+class BlueStore::FsckSocketHook : public AdminSocketHook {
+  BlueStore* store;
+
+  FsckSocketHook(BlueStore* _store) : store(_store) {}
+
+public:
+  static FsckSocketHook* create(BlueStore* store) {
+    AdminSocket* admin_socket = store->cct->get_admin_socket();
+    if (!admin_socket) {
+      return nullptr;
+    }
+    auto hook = new FsckSocketHook(store);
+    int r = admin_socket->register_command(
+      "bluestore fsck progress",
+      hook,
+      "Show progress and estimated time left of the running fsck");
+    if (r != 0) {
+      // e.g. another store in this process is being checked; progress
+      // is reported for that one only
+      delete hook;
+      return nullptr;
+    }
+    return hook;
+  }
+  ~FsckSocketHook() {
+    store->cct->get_admin_socket()->unregister_commands(this);
+  }
+
+  int call(std::string_view command, const cmdmap_t& cmdmap,
+	   Formatter *f,
+	   std::ostream& errss,
+	   bufferlist& out) override {
+    f->open_object_section("fsck_progress");
+    store->fsck_progress.dump(f);
+    f->close_section();
+    return 0;
+  }
+};
+
 int BlueStore::_fsck_on_open(BlueStore::FSCKDepth depth, bool repair)
 {
   uint64_t sb_hash_size = uint64_t(
@@ -9114,6 +9710,9 @@ int BlueStore::_fsck_on_open(BlueStore::FSCKDepth depth, bool repair)
   int64_t warnings = 0;
   unsigned repaired = 0;
 
+  fsck_progress.reset(depth, db->estimate_prefix_size(PREFIX_OBJ, string()));
+  std::unique_ptr<FsckSocketHook> asok_hook(FsckSocketHook::create(this));
+
   uint64_t_btree_t used_omap_head;
   uint64_t_btree_t used_sbids;
 
@@ -10234,6 +10833,52 @@ void BlueStore::inject_zombie_spanning_blob(coll_t cid, ghobject_t oid,
   db->submit_transaction_sync(txn);
 }
 
+void BlueStore::inject_csum_error(coll_t cid, ghobject_t oid)
+{
+  OnodeRef o;
+  CollectionRef c = _get_collection(cid);
+  ceph_assert(c);
+  std::unique_lock l{ c->lock };
+  o = c->get_onode(oid, false);
+  ceph_assert(o);
+  o->extent_map.fault_range(db, 0, OBJECT_MAX_SIZE);
+  auto ep = o->extent_map.extent_map.begin();
+  ceph_assert(ep != o->extent_map.extent_map.end());
+  const bluestore_blob_t& blob = ep->blob->get_blob();
+  ceph_assert(blob.has_csum());
+  const bluestore_pextent_t& pext = blob.get_extents().front();
+  ceph_assert(pext.is_valid());
+
+  bufferlist bl;
+  bl.append(std::string(block_size, '\xff'));
+  int r = bdev->write(pext.offset, bl, false);
+  ceph_assert(r == 0);
+  bdev->flush();
+}
+
+void BlueStore::get_object_pextents(coll_t cid, ghobject_t oid,
+				    PExtentVector* out)
+{
+  OnodeRef o;
+  CollectionRef c = _get_collection(cid);
+  ceph_assert(c);
+  std::shared_lock l{ c->lock };
+  o = c->get_onode(oid, false);
+  ceph_assert(o);
+  o->extent_map.fault_range(db, 0, OBJECT_MAX_SIZE);
+  std::set<const Blob*> seen;
+  for (auto& e : o->extent_map.extent_map) {
+    if (!seen.insert(e.blob.get()).second) {
+      continue;
+    }
+    for (auto& p : e.blob->get_blob().get_extents()) {
+      if (p.is_valid()) {
+	out->push_back(p);
+      }
+    }
+  }
+}
+
 void BlueStore::inject_bluefs_file(std::string_view dir, std::string_view name, size_t new_size)
 {
   ceph_assert(bluefs);
@@ -10981,7 +11626,8 @@ int BlueStore::_generate_read_result_bl(
                                          req.r_off, req.bl);
         }
 
-        // prune and keep result
+        // prune and keep result; regions reference the (aligned) device
+        // read buffers, no data is copied here
         for (const auto& r : req.regs) {
           ready_regions[r.logical_offset].substr_of(req.bl, r.front, r.length);
         }
@@ -11061,7 +11707,7 @@ int BlueStore::_do_read(
   }
 
   auto start = mono_clock::now();
-  o->extent_map.fault_range(db, offset, length);
+  o->extent_map.fault_range_for_read(db, offset, length);
   log_latency(__func__,
     l_bluestore_read_onode_meta_lat,
     mono_clock::now() - start,
@@ -11426,7 +12072,8 @@ int BlueStore::_do_readv(
   ceph_assert(m.range_start() <= o->onode.size);
   ceph_assert(m.range_end() <= o->onode.size);
   auto start = mono_clock::now();
-  o->extent_map.fault_range(db, m.range_start(), m.range_end() - m.range_start());
+  o->extent_map.fault_range_for_read(db, m.range_start(),
+				     m.range_end() - m.range_start());
   log_latency(__func__,
     l_bluestore_read_onode_meta_lat,
     mono_clock::now() - start,
@@ -12015,15 +12662,20 @@ int BlueStore::omap_get_values(
     const string& prefix = o->get_omap_prefix();
     o->get_omap_key(string(), &final_key);
     size_t base_key_len = final_key.size();
-    for (set<string>::const_iterator p = keys.begin(); p != keys.end(); ++p) {
+    // all keys share the onode's omap prefix, so the full keys come out in
+    // the same order as the user keys and can be fetched with one batch
+    set<string> final_keys;
+    for (auto& k : keys) {
       final_key.resize(base_key_len); // keep prefix
-      final_key += *p;
-      bufferlist val;
-      if (db->get(prefix, final_key, &val) >= 0) {
-	dout(30) << __func__ << "  got " << pretty_binary_string(final_key)
-		 << " -> " << *p << dendl;
-	out->insert(make_pair(*p, val));
-      }
+      final_key += k;
+      final_keys.emplace_hint(final_keys.end(), final_key);
+    }
+    map<string, bufferlist> vals;
+    db->get(prefix, final_keys, &vals);
+    for (auto& [k, v] : vals) {
+      dout(30) << __func__ << "  got " << pretty_binary_string(k)
+	       << " -> " << k.substr(base_key_len) << dendl;
+      out->emplace(k.substr(base_key_len), std::move(v));
     }
   }
  out:
@@ -13770,19 +14422,23 @@ void BlueStore::deferred_try_submit()
     }
   }
 
-  for (auto& osr : osrs) {
-    osr->deferred_lock.lock();
-    if (osr->deferred_pending) {
-      if (!osr->deferred_running) {
-	_deferred_submit_unlock(osr.get());
+  if (cct->_conf->bluestore_deferred_merge_osrs && osrs.size() > 1) {
+    _deferred_submit_merged(osrs);
+  } else {
+    for (auto& osr : osrs) {
+      osr->deferred_lock.lock();
+      if (osr->deferred_pending) {
+	if (!osr->deferred_running) {
+	  _deferred_submit_unlock(osr.get());
+	} else {
+	  osr->deferred_lock.unlock();
+	  dout(20) << __func__ << "  osr " << osr << " already has running"
+		   << dendl;
+	}
       } else {
 	osr->deferred_lock.unlock();
-	dout(20) << __func__ << "  osr " << osr << " already has running"
-		 << dendl;
+	dout(20) << __func__ << "  osr " << osr << " has no pending" << dendl;
       }
-    } else {
-      osr->deferred_lock.unlock();
-      dout(20) << __func__ << "  osr " << osr << " has no pending" << dendl;
     }
   }
 
@@ -13812,11 +14468,91 @@ void BlueStore::_deferred_submit_unlock(OpSequencer *osr)
   for (auto& txc : b->txcs) {
     throttle.log_state_latency(txc, logger, l_bluestore_state_deferred_queued_lat);
   }
+  _deferred_aio_write(b->iomap, &b->ioc);
+  bdev->aio_submit(&b->ioc);
+}
+
+static bool _deferred_iomap_overlaps(
+  const map<uint64_t,BlueStore::DeferredBatch::deferred_io>& a,
+  const map<uint64_t,BlueStore::DeferredBatch::deferred_io>& b)
+{
+  for (auto& [offset, io] : b) {
+    auto p = a.lower_bound(offset);
+    if (p != a.end() && p->first < offset + io.bl.length()) {
+      return true;
+    }
+    if (p != a.begin()) {
+      --p;
+      if (p->first + p->second.bl.length() > offset) {
+	return true;
+      }
+    }
+  }
+  return false;
+}
+
+void BlueStore::_deferred_submit_merged(const vector<OpSequencerRef>& osrs)
+{
+  auto g = new DeferredBatchGroup(cct);
+  map<uint64_t,DeferredBatch::deferred_io> iomap;
+  for (auto& osr : osrs) {
+    osr->deferred_lock.lock();
+    if (!osr->deferred_pending) {
+      osr->deferred_lock.unlock();
+      dout(20) << __func__ << "  osr " << osr << " has no pending" << dendl;
+      continue;
+    }
+    if (osr->deferred_running) {
+      osr->deferred_lock.unlock();
+      dout(20) << __func__ << "  osr " << osr << " already has running"
+	       << dendl;
+      continue;
+    }
+    auto b = osr->deferred_pending;
+    if (_deferred_iomap_overlaps(iomap, b->iomap)) {
+      // the order of overlapping writes from different sequencers is
+      // undefined anyway, just don't let them end up in a single io
+      dout(20) << __func__ << "  osr " << osr << " overlaps, submitting alone"
+	       << dendl;
+      _deferred_submit_unlock(osr.get());
+      continue;
+    }
+    dout(10) << __func__ << "  osr " << osr
+	     << " " << b->iomap.size() << " ios pending" << dendl;
+    deferred_queue_size -= b->seq_bytes.size();
+    ceph_assert(deferred_queue_size >= 0);
+    osr->deferred_running = b;
+    osr->deferred_pending = nullptr;
+    osr->deferred_lock.unlock();
+
+    for (auto& txc : b->txcs) {
+      throttle.log_state_latency(txc, logger, l_bluestore_state_deferred_queued_lat);
+    }
+    iomap.merge(b->iomap);
+    ceph_assert(b->iomap.empty());
+    g->batches.push_back(b);
+  }
+  if (g->batches.empty()) {
+    delete g;
+    return;
+  }
+  dout(10) << __func__ << " " << g->batches.size() << " osrs, "
+	   << iomap.size() << " ios" << dendl;
+  logger->inc(l_bluestore_deferred_merged_submits);
+  logger->inc(l_bluestore_deferred_merged_batches, g->batches.size());
+  _deferred_aio_write(iomap, &g->ioc);
+  bdev->aio_submit(&g->ioc);
+}
+
+void BlueStore::_deferred_aio_write(
+  map<uint64_t,DeferredBatch::deferred_io>& iomap,
+  IOContext *ioc)
+{
   uint64_t start = 0, pos = 0;
   bufferlist bl;
-  auto i = b->iomap.begin();
+  auto i = iomap.begin();
   while (true) {
-    if (i == b->iomap.end() || i->first != pos) {
+    if (i == iomap.end() || i->first != pos) {
       if (bl.length()) {
 	dout(20) << __func__ << " write 0x" << std::hex
 		 << start << "~" << bl.length()
@@ -13824,11 +14560,11 @@ void BlueStore::_deferred_submit_unlock(OpSequencer *osr)
 	if (!g_conf()->bluestore_debug_omit_block_device_write) {
 	  logger->inc(l_bluestore_submitted_deferred_writes);
 	  logger->inc(l_bluestore_submitted_deferred_write_bytes, bl.length());
-	  int r = bdev->aio_write(start, bl, &b->ioc, false);
+	  int r = bdev->aio_write(start, bl, ioc, false);
 	  ceph_assert(r == 0);
 	}
       }
-      if (i == b->iomap.end()) {
+      if (i == iomap.end()) {
 	break;
       }
       start = 0;
@@ -13845,8 +14581,6 @@ void BlueStore::_deferred_submit_unlock(OpSequencer *osr)
     bl.claim_append(i->second.bl);
     ++i;
   }
-
-  bdev->aio_submit(&b->ioc);
 }
 
 struct C_DeferredTrySubmit : public Context {
@@ -13913,6 +14647,18 @@ void BlueStore::_deferred_aio_finish(OpSequencer *osr)
   }
 }
 
+void BlueStore::_deferred_group_aio_finish(DeferredBatchGroup *g)
+{
+  dout(10) << __func__ << " " << g << " " << g->batches.size() << " osrs"
+	   << dendl;
+  for (auto b : g->batches) {
+    // b may be gone once handed over to the kv thread
+    OpSequencer *osr = b->osr;
+    _deferred_aio_finish(osr);
+  }
+  delete g;
+}
+
 int BlueStore::_deferred_replay()
 {
   dout(10) << __func__ << " start" << dendl;
@@ -15453,10 +16199,35 @@ int BlueStore::_do_alloc_write(
   PExtentVector prealloc;
   prealloc.reserve(2 * wctx->writes.size());;
   int64_t prealloc_left = 0;
-  prealloc_left = alloc->allocate(
-    need, min_alloc_size, need,
-    0, &prealloc);
-  if (prealloc_left < 0 || prealloc_left < (int64_t)need) {
+  // the pool may hint a preferred (larger) allocation unit; grab as much
+  // as possible in such units so its objects stay coarsely fragmented and
+  // fall back to min_alloc_size for the tail or when the device is too
+  // fragmented to satisfy the hint.
+  uint64_t alloc_unit = min_alloc_size;
+  {
+    int64_t val;
+    if (coll->pool_opts.get(pool_opts_t::ALLOC_UNIT_HINT, &val) &&
+        val > (int64_t)min_alloc_size) {
+      alloc_unit = 1ull << (63 - clz(uint64_t(val)));
+    }
+  }
+  if (alloc_unit > min_alloc_size && need >= alloc_unit) {
+    prealloc_left = alloc->allocate(
+      p2align(need, alloc_unit), alloc_unit, need,
+      0, &prealloc);
+    if (prealloc_left < 0) {
+      prealloc_left = 0;
+    }
+  }
+  if (prealloc_left < (int64_t)need) {
+    int64_t r = alloc->allocate(
+      need - prealloc_left, min_alloc_size, need,
+      0, &prealloc);
+    if (r > 0) {
+      prealloc_left += r;
+    }
+  }
+  if (prealloc_left < (int64_t)need) {
     derr << __func__ << " failed to allocate 0x" << std::hex << need
          << " allocated 0x " << (prealloc_left < 0 ? 0 : prealloc_left)
          << " min_alloc_size 0x" << min_alloc_size
@@ -18686,10 +19457,41 @@ void BlueStore::set_allocation_in_simple_bmap(SimpleBitmap* sbmap, uint64_t offs
   sbmap->set(offset >> min_alloc_size_order, length >> min_alloc_size_order);
 }
 
+void BlueStore::set_allocation_in_simple_bmap(alloc_sink_t& sink, uint64_t offset, uint64_t length)
+{
+  ceph_assert((offset & min_alloc_size_mask) == 0);
+  ceph_assert((length & min_alloc_size_mask) == 0);
+  sink.set(offset >> min_alloc_size_order, length >> min_alloc_size_order);
+}
+
+void BlueStore::alloc_sink_t::set(uint64_t offset, uint64_t length)
+{
+  if (!sbmap_lock) {
+    sbmap->set(offset, length);
+    return;
+  }
+  pending.emplace_back(offset, length);
+  if (pending.size() >= MAX_PENDING) {
+    flush();
+  }
+}
+
+void BlueStore::alloc_sink_t::flush()
+{
+  if (pending.empty()) {
+    return;
+  }
+  std::lock_guard l(*sbmap_lock);
+  for (auto& [offset, length] : pending) {
+    sbmap->set(offset, length);
+  }
+  pending.clear();
+}
+
 //---------------------------------------------------------
 // Process all physical extents from a given Onode (including all its shards)
 void BlueStore::read_allocation_from_single_onode(
-  SimpleBitmap*        sbmap,
+  alloc_sink_t&        sink,
   BlueStore::OnodeRef& onode_ref,
   read_alloc_stats_t&  stats)
 {
@@ -18737,12 +19539,12 @@ void BlueStore::read_allocation_from_single_onode(
 	  stats.skipped_repeated_extent++;
 	} else {
 	  lcl_extnt_map[offset] = length;
-	  set_allocation_in_simple_bmap(sbmap, offset, length);
+	  set_allocation_in_simple_bmap(sink, offset, length);
 	  stats.extent_count++;
 	}
       } else {
 	// extents using shared blobs might have differnt length
-	set_allocation_in_simple_bmap(sbmap, offset, length);
+	set_allocation_in_simple_bmap(sink, offset, length);
 	stats.extent_count++;
       }
 
@@ -18759,7 +19561,81 @@ void BlueStore::read_allocation_from_single_onode(
 }
 
 //-------------------------------------------------------------------------
-int BlueStore::read_allocation_from_onodes(SimpleBitmap *sbmap, read_alloc_stats_t& stats)
+int BlueStore::read_allocation_from_onodes(SimpleBitmap *sbmap, read_alloc_stats_t& stats, unsigned threads)
+{
+  if (threads > 0) {
+    return read_allocation_from_onodes_parallel(sbmap, stats, threads);
+  }
+  alloc_sink_t sink(sbmap);
+  return read_allocation_from_onode_range(string(), string(), sink, stats);
+}
+
+//-------------------------------------------------------------------------
+int BlueStore::read_allocation_from_onodes_parallel(SimpleBitmap *sbmap, read_alloc_stats_t& stats, unsigned threads)
+{
+  // Split the object keyspace at the first key of every collection; there
+  // are typically many more collections than threads so the ranges are
+  // balanced well enough by handing them out to the threads one by one.
+  std::set<string> bounds;
+  for (auto& [cid, c] : coll_map) {
+    ghobject_t temp_start, temp_end, start, end;
+    get_coll_range(cid, c->cnode.bits, &temp_start, &temp_end, &start, &end,
+		   false);
+    string key;
+    get_object_key(cct, start, &key);
+    bounds.insert(key);
+    if (cid.is_pg()) {
+      get_object_key(cct, temp_start, &key);
+      bounds.insert(key);
+    }
+  }
+  std::vector<std::pair<string, string>> ranges;
+  string lower;
+  for (auto& b : bounds) {
+    ranges.emplace_back(lower, b);
+    lower = b;
+  }
+  ranges.emplace_back(lower, string());
+  dout(5) << __func__ << " " << ranges.size() << " key ranges, "
+	  << threads << " threads" << dendl;
+
+  ceph::mutex sbmap_lock = ceph::make_mutex("BlueStore::alloc_recovery::sbmap_lock");
+  ceph::mutex stats_lock = ceph::make_mutex("BlueStore::alloc_recovery::stats_lock");
+  int ret = 0;
+  ThreadPool tp(cct, "AllocRecoveryThreadPool", "alloc_recovery", threads);
+  GenContextWQ wq("AllocRecoveryWQ", ceph::timespan::zero(), &tp);
+  tp.start();
+  for (auto& range : ranges) {
+    wq.queue(make_gen_lambda_context<ThreadPool::TPHandle&>(
+      [&, range](ThreadPool::TPHandle&) {
+	read_alloc_stats_t range_stats = {};
+	alloc_sink_t sink(sbmap, &sbmap_lock);
+	int r = read_allocation_from_onode_range(range.first, range.second,
+						 sink, range_stats);
+	sink.flush();
+	std::lock_guard l(stats_lock);
+	stats += range_stats;
+	if (r < 0) {
+	  ret = r;
+	}
+      }).release());
+  }
+  wq.drain();
+  tp.stop();
+  dout(5) << "onode_count=" << stats.onode_count << " ,shard_count=" << stats.shard_count << dendl;
+  return ret;
+}
+
+//-------------------------------------------------------------------------
+// Walk the onodes with keys in [lower, upper), where an empty upper means
+// up to the end. Shard keys following the last onode in the range are
+// consumed even if they are past upper, and those at lower (belonging to
+// an onode before the range) are skipped.
+int BlueStore::read_allocation_from_onode_range(
+  const string& lower,
+  const string& upper,
+  alloc_sink_t& sink,
+  read_alloc_stats_t& stats)
 {
   // finally add all space take by user data
   auto it = db->get_iterator(PREFIX_OBJ, KeyValueDB::ITERATOR_NOCACHE);
@@ -18776,8 +19652,18 @@ int BlueStore::read_allocation_from_onodes(SimpleBitmap *sbmap, read_alloc_stats
   uint32_t            shard_id       = 0;
   uint64_t            kv_count       = 0;
   uint64_t            count_interval = 1'000'000;
+  it->lower_bound(lower);
+  if (!lower.empty()) {
+    while (it->valid() && is_extent_shard_key(it->key())) {
+      it->next();
+    }
+  }
   // iterate over all ONodes stored in RocksDB
-  for (it->lower_bound(string()); it->valid(); it->next(), kv_count++) {
+  for (; it->valid(); it->next(), kv_count++) {
+    if (!upper.empty() && it->key() >= upper &&
+	!is_extent_shard_key(it->key())) {
+      break;
+    }
     // trace an even after every million processed objects (typically every 5-10 seconds)
     if (kv_count && (kv_count % count_interval == 0) ) {
       dout(5) << "processed objects count = " << kv_count << dendl;
@@ -18816,7 +19702,7 @@ int BlueStore::read_allocation_from_onodes(SimpleBitmap *sbmap, read_alloc_stats
 	// make sure we got all shards of this object
 	if (shard_id == onode_ref->extent_map.shards.size()) {
 	  // We completed an Onode Object -> pass it to be processed
-	  read_allocation_from_single_onode(sbmap, onode_ref, stats);
+	  read_allocation_from_single_onode(sink, onode_ref, stats);
 	} else {
 	  derr << "Missing shards! shard_id=" << shard_id << ", shards.size()=" << onode_ref->extent_map.shards.size() << dendl;
 	  ceph_assert(shard_id == onode_ref->extent_map.shards.size());
@@ -18871,13 +19757,15 @@ int BlueStore::read_allocation_from_onodes(SimpleBitmap *sbmap, read_alloc_stats
     // make sure we got all shards of this object
     if (shard_id == onode_ref->extent_map.shards.size()) {
       // We completed an Onode Object -> pass it to be processed
-      read_allocation_from_single_onode(sbmap, onode_ref, stats);
+      read_allocation_from_single_onode(sink, onode_ref, stats);
     } else {
       derr << "Last Object is missing shards! shard_id=" << shard_id << ", shards.size()=" << onode_ref->extent_map.shards.size() << dendl;
       ceph_assert(shard_id == onode_ref->extent_map.shards.size());
     }
   }
-  dout(5) << "onode_count=" << stats.onode_count << " ,shard_count=" << stats.shard_count << dendl;
+  if (lower.empty() && upper.empty()) {
+    dout(5) << "onode_count=" << stats.onode_count << " ,shard_count=" << stats.shard_count << dendl;
+  }
 
   return 0;
 }
@@ -18891,7 +19779,8 @@ int BlueStore::reconstruct_allocations(SimpleBitmap *sbmap, read_alloc_stats_t &
   stats.extent_count++;
 
   // then set all space taken by Objects
-  int ret = read_allocation_from_onodes(sbmap, stats);
+  int ret = read_allocation_from_onodes(sbmap, stats,
+					cct->_conf->bluestore_allocation_recovery_threads);
   if (ret < 0) {
     derr << "failed read_allocation_from_onodes()" << dendl;
     return ret;
@@ -18913,11 +19802,38 @@ static void copy_simple_bitmap_to_allocator(SimpleBitmap* sbmap, Allocator* dest
   }
 }
 
+//---------------------------------------------------------
+int BlueStore::read_allocation_from_onodes_for_test(
+  unsigned threads,
+  interval_set<uint64_t>* used,
+  uint64_t* onode_count,
+  uint64_t* shared_blobs_count)
+{
+  read_alloc_stats_t stats = {};
+  SimpleBitmap sbmap(cct, (bdev->get_size()/ min_alloc_size));
+  int ret = read_allocation_from_onodes(&sbmap, stats, threads);
+  if (ret < 0) {
+    return ret;
+  }
+  int alloc_size_shift = ctz(min_alloc_size);
+  uint64_t offset = 0;
+  extent_t ext = sbmap.get_next_set_extent(offset);
+  while (ext.length != 0) {
+    used->insert(ext.offset << alloc_size_shift, ext.length << alloc_size_shift);
+    offset = ext.offset + ext.length;
+    ext = sbmap.get_next_set_extent(offset);
+  }
+  *onode_count = stats.onode_count;
+  *shared_blobs_count = stats.shared_blobs_count;
+  return 0;
+}
+
 //---------------------------------------------------------
 int BlueStore::read_allocation_from_drive_on_startup()
 {
   int ret = 0;
 
+  utime_t start = ceph_clock_now();
   ret = _open_collections();
   if (ret < 0) {
     return ret;
@@ -18926,7 +19842,7 @@ int BlueStore::read_allocation_from_drive_on_startup()
     _shutdown_cache();
   });
 
-  utime_t            start = ceph_clock_now();
+  utime_t            scan_start = ceph_clock_now();
   read_alloc_stats_t stats = {};
   SimpleBitmap sbmap(cct, (bdev->get_size()/ min_alloc_size));
   ret = reconstruct_allocations(&sbmap, stats);
@@ -18934,10 +19850,17 @@ int BlueStore::read_allocation_from_drive_on_startup()
     return ret;
   }
 
+  utime_t copy_start = ceph_clock_now();
   copy_simple_bitmap_to_allocator(&sbmap, alloc, min_alloc_size);
 
-  utime_t duration = ceph_clock_now() - start;
+  utime_t end = ceph_clock_now();
+  utime_t duration = end - start;
   dout(1) << "::Allocation Recovery was completed in " << duration << " seconds, extent_count=" << stats.extent_count << dendl;
+  dout(1) << "::Allocation Recovery open collections " << (scan_start - start)
+	  << " seconds, onode scan " << (copy_start - scan_start)
+	  << " seconds (" << stats.onode_count << " onodes, "
+	  << cct->_conf->bluestore_allocation_recovery_threads << " threads)"
+	  << ", allocator init " << (end - copy_start) << " seconds" << dendl;
   return ret;
 }
 
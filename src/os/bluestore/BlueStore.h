@@ -142,6 +142,8 @@ enum {
   l_bluestore_issued_deferred_write_bytes,
   l_bluestore_submitted_deferred_writes,
   l_bluestore_submitted_deferred_write_bytes,
+  l_bluestore_deferred_merged_submits,
+  l_bluestore_deferred_merged_batches,
 
   l_bluestore_write_big_skipped_blobs,
   l_bluestore_write_big_skipped_bytes,
@@ -168,6 +170,10 @@ enum {
   l_bluestore_onode_misses,
   l_bluestore_onode_shard_hits,
   l_bluestore_onode_shard_misses,
+  l_bluestore_onode_shard_prefetched,
+  l_bluestore_onode_shard_prefetch_hits,
+  l_bluestore_onode_lookup_retries,
+  l_bluestore_onode_cache_lock_contended,
   l_bluestore_extents,
   l_bluestore_blobs,
   //****************************************
@@ -178,6 +184,7 @@ enum {
   l_bluestore_buffer_bytes,
   l_bluestore_buffer_hit_bytes,
   l_bluestore_buffer_miss_bytes,
+  l_bluestore_buffer_ghost_hit_bytes,
   //****************************************
 
   // internal stats
@@ -863,6 +870,7 @@ public:
       unsigned extents = 0;  ///< count extents in this shard
       bool loaded = false;   ///< true if shard is loaded
       bool dirty = false;    ///< true if shard is dirty and needs reencoding
+      bool prefetched = false; ///< true if loaded ahead and not accessed yet
     };
     mempool::bluestore_cache_meta::vector<Shard> shards;    ///< shards
 
@@ -871,6 +879,8 @@ public:
     uint32_t needs_reshard_begin = 0;
     uint32_t needs_reshard_end = 0;
 
+    uint32_t last_read_end = 0;  ///< to detect sequential reads
+
     void dup(BlueStore* b, TransContext*, CollectionRef&, OnodeRef&, OnodeRef&,
       uint64_t&, uint64_t&, uint64_t&);
 
@@ -973,6 +983,13 @@ public:
     /// ensure that a range of the map is loaded
     void fault_range(KeyValueDB *db,
 		     uint32_t offset, uint32_t length);
+    /// fault_range() for reads; if the object is read sequentially,
+    /// also load up to bluestore_extent_map_readahead_shards shards
+    /// past the range
+    void fault_range_for_read(KeyValueDB *db,
+			      uint32_t offset, uint32_t length);
+    void _load_shards(KeyValueDB *db, int start, int last, int ahead,
+		      uint32_t offset, uint32_t length);
 
     /// ensure a range of the map is marked dirty
     void dirty_range(uint32_t offset, uint32_t length);
@@ -1124,6 +1141,7 @@ public:
   };
 
   struct OnodeSpace;
+  struct OnodeCacheShard;
   /// an in-memory object
   struct Onode {
     MEMPOOL_CLASS_HELPERS();
@@ -1201,6 +1219,8 @@ public:
     void flush();
     void get();
     void put();
+    bool get_cached();
+    OnodeCacheShard* lock_cache();
 
     inline bool put_cache() {
       ceph_assert(!cached);
@@ -1403,6 +1423,11 @@ public:
     OnodeCacheShard *cache;
 
   private:
+    /// protect onode_map; lookups take it shared and never touch
+    /// cache->lock while holding it, updates are made under cache->lock
+    ceph::shared_mutex map_lock =
+      ceph::make_shared_mutex("BlueStore::OnodeSpace::map_lock", true, false);
+
     /// forward lookups
     mempool::bluestore_cache_meta::unordered_map<ghobject_t,OnodeRef> onode_map;
 
@@ -1937,6 +1962,20 @@ public:
     }
   };
 
+  /// deferred batches of several sequencers submitted as a single
+  /// offset-sorted set of ios, see bluestore_deferred_merge_osrs
+  struct DeferredBatchGroup final : public AioContext {
+    std::vector<DeferredBatch*> batches;
+    IOContext ioc;                   ///< our aios
+
+    explicit DeferredBatchGroup(CephContext *cct)
+      : ioc(cct, this) {}
+
+    void aio_finish(BlueStore *store) override {
+      store->_deferred_group_aio_finish(this);
+    }
+  };
+
   class OpSequencer : public RefCountedObject {
   public:
     ceph::mutex qlock = ceph::make_mutex("BlueStore::OpSequencer::qlock");
@@ -2682,7 +2721,11 @@ public:
   void deferred_try_submit();
 private:
   void _deferred_submit_unlock(OpSequencer *osr);
+  void _deferred_submit_merged(const std::vector<OpSequencerRef>& osrs);
+  void _deferred_aio_write(std::map<uint64_t,DeferredBatch::deferred_io>& iomap,
+			   IOContext *ioc);
   void _deferred_aio_finish(OpSequencer *osr);
+  void _deferred_group_aio_finish(DeferredBatchGroup *g);
   int _deferred_replay();
 
 public:
@@ -2702,6 +2745,27 @@ public:
   };
 
 private:
+  /// progress of the running fsck, dumped by "bluestore fsck progress"
+  struct fsck_progress_t {
+    FSCKDepth depth = FSCK_REGULAR;
+    ceph::mono_clock::time_point start;
+    uint64_t keyspace_bytes = 0;   ///< estimated size of the object keyspace
+    std::atomic<uint64_t> walked_bytes = {0}; ///< object key/values walked
+    std::atomic<uint64_t> objects = {0};
+    std::atomic<uint64_t> read_bytes = {0};   ///< object data read (deep)
+
+    void reset(FSCKDepth d, uint64_t _keyspace_bytes) {
+      depth = d;
+      start = ceph::mono_clock::now();
+      keyspace_bytes = _keyspace_bytes;
+      walked_bytes = 0;
+      objects = 0;
+      read_bytes = 0;
+    }
+    void dump(ceph::Formatter *f) const;
+  } fsck_progress;
+  class FsckSocketHook;
+
   int _fsck_check_extents(
     std::string_view ctx_descr,
     const PExtentVector& extents,
@@ -3200,6 +3264,18 @@ public:
 			   coll_t cid2, ghobject_t oid2,
 			   uint64_t offset);
   void inject_zombie_spanning_blob(coll_t cid, ghobject_t oid, int16_t blob_id);
+  // overwrites the first block of the object's data on disk, leaving its
+  // checksum as it is
+  void inject_csum_error(coll_t cid, ghobject_t oid);
+  // physical extents backing the object's data, for tests
+  void get_object_pextents(coll_t cid, ghobject_t oid, PExtentVector* out);
+  // rebuilds the map of space used by objects from the onodes, the way
+  // startup does without an allocation file; threads == 0 walks the
+  // onodes serially
+  int read_allocation_from_onodes_for_test(unsigned threads,
+					   interval_set<uint64_t>* used,
+					   uint64_t* onode_count,
+					   uint64_t* shared_blobs_count);
   // resets global per_pool_omap in DB
   void inject_legacy_omap();
   // resets per_pool_omap | pgmeta_omap for onode
@@ -3654,6 +3730,7 @@ public:
     mempool::bluestore_fsck::list<std::string>* expecting_shards,
     std::map<BlobRef, bluestore_blob_t::unused_t>* referenced,
     const BlueStore::FSCK_ObjectCtx& ctx);
+  int64_t fsck_deep_read_object(CollectionRef& c, OnodeRef& o);
 #ifdef CEPH_BLUESTORE_TOOL_RESTORE_ALLOCATION
   int  push_allocation_to_rocksdb();
   int  read_allocation_from_drive_for_bluestore_tool();
@@ -3683,6 +3760,27 @@ private:
 
     std::array<uint32_t, MAX_BLOBS_IN_ONODE+1>blobs_in_onode = {};
     //uint32_t blobs_in_onode[MAX_BLOBS_IN_ONODE+1];
+
+    read_alloc_stats_t& operator+=(const read_alloc_stats_t& o) {
+      onode_count             += o.onode_count;
+      shard_count             += o.shard_count;
+      skipped_repeated_extent += o.skipped_repeated_extent;
+      skipped_illegal_extent  += o.skipped_illegal_extent;
+      collection_search       += o.collection_search;
+      pad_limit_count         += o.pad_limit_count;
+      shared_blobs_count      += o.shared_blobs_count;
+      compressed_blob_count   += o.compressed_blob_count;
+      spanning_blob_count     += o.spanning_blob_count;
+      insert_count            += o.insert_count;
+      extent_count            += o.extent_count;
+      saved_inplace_count     += o.saved_inplace_count;
+      merge_insert_count      += o.merge_insert_count;
+      merge_inplace_count     += o.merge_inplace_count;
+      for (unsigned i = 0; i <= MAX_BLOBS_IN_ONODE; i++) {
+	blobs_in_onode[i] += o.blobs_in_onode[i];
+      }
+      return *this;
+    }
   };
 
   friend std::ostream& operator<<(std::ostream& out, const read_alloc_stats_t& stats) {
@@ -3722,6 +3820,26 @@ private:
     return out;
   }
 
+  // Destination of the extents found while walking the onodes.  A serial
+  // walk sets them straight in the bitmap; threads of a parallel walk
+  // collect them locally and apply them under the shared lock in batches.
+  struct alloc_sink_t {
+    SimpleBitmap* sbmap;
+    ceph::mutex*  sbmap_lock = nullptr;
+    // <offset, length> in min_alloc_size units
+    std::vector<std::pair<uint64_t, uint64_t>> pending;
+
+    static constexpr size_t MAX_PENDING = 64 * 1024;
+
+    alloc_sink_t(SimpleBitmap* _sbmap, ceph::mutex* _sbmap_lock = nullptr)
+      : sbmap(_sbmap), sbmap_lock(_sbmap_lock) {}
+    ~alloc_sink_t() {
+      flush();
+    }
+    void set(uint64_t offset, uint64_t length);
+    void flush();
+  };
+
   int  compare_allocators(Allocator* alloc1, Allocator* alloc2, uint64_t req_extent_count, uint64_t memory_target);
   Allocator* create_bitmap_allocator(uint64_t bdev_size);
   int  add_existing_bluefs_allocation(Allocator* allocator, read_alloc_stats_t& stats);
@@ -3735,9 +3853,12 @@ private:
   int  restore_allocator(Allocator* allocator, uint64_t *num, uint64_t *bytes);
   int  read_allocation_from_drive_on_startup();
   int  reconstruct_allocations(SimpleBitmap *smbmp, read_alloc_stats_t &stats);
-  int  read_allocation_from_onodes(SimpleBitmap *smbmp, read_alloc_stats_t& stats);
-  void read_allocation_from_single_onode(SimpleBitmap *smbmp, BlueStore::OnodeRef& onode_ref, read_alloc_stats_t&  stats);
+  int  read_allocation_from_onodes(SimpleBitmap *smbmp, read_alloc_stats_t& stats, unsigned threads);
+  int  read_allocation_from_onodes_parallel(SimpleBitmap *smbmp, read_alloc_stats_t& stats, unsigned threads);
+  int  read_allocation_from_onode_range(const std::string& lower, const std::string& upper, alloc_sink_t& sink, read_alloc_stats_t& stats);
+  void read_allocation_from_single_onode(alloc_sink_t& sink, BlueStore::OnodeRef& onode_ref, read_alloc_stats_t&  stats);
   void set_allocation_in_simple_bmap(SimpleBitmap* sbmap, uint64_t offset, uint64_t length);
+  void set_allocation_in_simple_bmap(alloc_sink_t& sink, uint64_t offset, uint64_t length);
   int  commit_to_null_manager();
   int  commit_to_real_manager();
   int  db_cleanup(int ret);
@@ -7,6 +7,8 @@
 
 PerfCounters *build_osd_logger(CephContext *cct) {
   PerfCountersBuilder osd_plb(cct, "osd", l_osd_first, l_osd_last);
+  // op counters and latencies are updated by all op shards
+  osd_plb.set_sharded();
 
   // Latency axis configuration for op histograms, values are in nanoseconds
   PerfHistogramCommon::axis_config_d op_hist_x_axis_config{
@@ -29,6 +31,10 @@ PerfCounters *build_osd_logger(CephContext *cct) {
 
   // All the basic OSD operation stats are to be considered useful
   osd_plb.set_prio_default(PerfCountersBuilder::PRIO_USEFUL);
+  // and we want to see their tail latencies
+  osd_plb.set_latency_histogram(cct->_conf->perf_latency_histogram_precision,
+				cct->_conf.get_val<std::chrono::seconds>(
+				  "perf_latency_histogram_window"));
 
   osd_plb.add_u64(
     l_osd_op_wip, "op_wip",
@@ -120,6 +126,7 @@ PerfCounters *build_osd_logger(CephContext *cct) {
   // Now we move on to some more obscure stats, revert to assuming things
   // are low priority unless otherwise specified.
   osd_plb.set_prio_default(PerfCountersBuilder::PRIO_DEBUGONLY);
+  osd_plb.set_latency_histogram(0);
 
   osd_plb.add_time_avg(l_osd_op_before_queue_op_lat, "op_before_queue_op_lat",
     "Latency of IO before calling queue(before really queue into ShardedOpWq)"); // client io before queue op_wq latency
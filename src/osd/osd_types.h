@@ -1106,6 +1106,7 @@ public:
     DEDUP_CHUNK_ALGORITHM,
     DEDUP_CDC_CHUNK_SIZE,
     PG_NUM_MAX, // max pg_num
+    ALLOC_UNIT_HINT, // preferred allocation unit for the pool's data
   };
 
   enum type_t {
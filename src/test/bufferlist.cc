@@ -22,6 +22,7 @@
 #include <limits.h>
 #include <errno.h>
 #include <sys/uio.h>
+#include <thread>
 
 #include "include/buffer.h"
 #include "include/buffer_raw.h"
@@ -1463,6 +1464,53 @@ TEST(BufferList, append_bench2) {
   }
 }
 
+TEST(BufferList, append_small_bench) {
+  // the encode() pattern: many short appends into short lived lists, which
+  // is what the per-thread ptr_node and append buffer caches are for
+  constexpr size_t rounds = 1000000;
+  for (size_t step = 1; step <= 64; step *= 4) {
+    const char src[64] = { 0, };
+    const utime_t start = ceph_clock_now();
+    for (size_t r = 0; r < rounds; ++r) {
+      ceph::bufferlist bl;
+      for (size_t i = 0; i < 4; ++i) {
+	bl.append(src, step);
+      }
+      ceph::bufferlist other;
+      other.claim_append(bl);
+    }
+    cout << rounds << " lists of 4 " << step << " byte appends in "
+	 << (ceph_clock_now() - start) << std::endl;
+  }
+}
+
+TEST(BufferList, free_in_other_thread) {
+  // buffers handed to another thread end up in that thread's caches; make
+  // sure they are still usable and get released when it exits
+  constexpr int rounds = 1000;
+  for (int r = 0; r < 4; ++r) {
+    std::vector<ceph::bufferlist> bls(rounds);
+    for (int i = 0; i < rounds; ++i) {
+      bls[i].append((char)i);
+      bls[i].append("0123456789", 10);
+    }
+    std::thread consumer([&bls] {
+      for (auto& bl : bls) {
+	ceph::bufferlist mine;
+	mine.append('x');
+	mine.claim_append(bl);
+	EXPECT_EQ(12u, mine.length());
+      }
+    });
+    consumer.join();
+    for (int i = 0; i < rounds; ++i) {
+      EXPECT_EQ(0u, bls[i].length());
+      bls[i].append((char)i);
+      EXPECT_EQ((char)i, bls[i][0]);
+    }
+  }
+}
+
 TEST(BufferList, append_hole_bench) {
   constexpr size_t targeted_bl_size = 1048576;
 
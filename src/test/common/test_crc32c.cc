@@ -363,3 +363,61 @@ TEST(Crc32c, zeros_performance) {
 
 }
 
+
+TEST(Crc32c, Multi) {
+  constexpr unsigned max_count = 7;
+  std::vector<std::vector<unsigned char>> bufs(max_count);
+  unsigned char const *ptrs[max_count];
+  uint32_t out[max_count];
+  for (unsigned len : {0u, 1u, 7u, 8u, 9u, 63u, 512u, 4096u, 4099u}) {
+    for (unsigned i = 0; i < max_count; ++i) {
+      bufs[i].resize(len);
+      for (auto& c : bufs[i])
+	c = rand();
+      ptrs[i] = bufs[i].data();
+    }
+    for (unsigned count = 0; count <= max_count; ++count) {
+      for (uint32_t crc : {0u, 1234u, 0xffffffffu}) {
+	ceph_crc32c_multi(crc, ptrs, len, count, out);
+	for (unsigned i = 0; i < count; ++i) {
+	  ASSERT_EQ(ceph_crc32c(crc, ptrs[i], len), out[i])
+	    << "len " << len << " count " << count << " buffer " << i;
+	}
+      }
+    }
+  }
+}
+
+TEST(Crc32c, MultiPerformance) {
+  constexpr unsigned block = 4096;
+  constexpr unsigned count = 16;
+  constexpr size_t ITER = 20000;
+  std::vector<unsigned char> a(block * count);
+  for (size_t i = 0; i < a.size(); i++)
+    a[i] = i & 0xff;
+  unsigned char const *ptrs[count];
+  for (unsigned i = 0; i < count; ++i)
+    ptrs[i] = a.data() + i * block;
+  uint32_t single[count];
+  uint32_t multi[count];
+  float total = (float)block * count * ITER / (float)(1024*1024);
+
+  utime_t start = ceph_clock_now();
+  for (size_t n = 0; n < ITER; ++n) {
+    for (unsigned i = 0; i < count; ++i)
+      single[i] = ceph_crc32c(-1, ptrs[i], block);
+  }
+  utime_t end = ceph_clock_now();
+  std::cout << "per block = " << total / (float)(end - start)
+	    << " MB/sec" << std::endl;
+
+  start = ceph_clock_now();
+  for (size_t n = 0; n < ITER; ++n) {
+    ceph_crc32c_multi(-1, ptrs, block, count, multi);
+  }
+  end = ceph_clock_now();
+  std::cout << "multi = " << total / (float)(end - start)
+	    << " MB/sec" << std::endl;
+  for (unsigned i = 0; i < count; ++i)
+    ASSERT_EQ(single[i], multi[i]);
+}
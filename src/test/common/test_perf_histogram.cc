@@ -14,6 +14,8 @@
 
 #include "common/perf_histogram.h"
 
+#include <thread>
+
 #include "gtest/gtest.h"
 
 template <int DIM>
@@ -245,3 +247,112 @@ TEST(PerfHistogram, AxisAddressing) {
     }
   }
 }
+
+class PerfHdrHistogramAccessor : public PerfHdrHistogram {
+public:
+  using PerfHdrHistogram::PerfHdrHistogram;
+  using PerfHdrHistogram::get_bucket;
+  using PerfHdrHistogram::get_bucket_range;
+  using PerfHdrHistogram::m_buckets;
+};
+
+TEST(PerfHdrHistogram, BucketRanges) {
+  for (unsigned bits : {0u, 1u, 4u, 7u}) {
+    PerfHdrHistogramAccessor h{bits, 24};
+    uint64_t next = 0;
+    for (size_t i = 0; i < h.m_buckets; ++i) {
+      auto [min, max] = h.get_bucket_range(i);
+      // buckets are contiguous and map back to themselves
+      ASSERT_EQ(next, min);
+      ASSERT_EQ(i, h.get_bucket(min));
+      ASSERT_EQ(i, h.get_bucket(max));
+      // and never wider than the precision allows
+      ASSERT_LE((max - min) << bits, min);
+      next = max + 1;
+    }
+    ASSERT_EQ(uint64_t(1) << 24, next);
+    // larger values go to the last bucket
+    ASSERT_EQ(h.m_buckets - 1, h.get_bucket(uint64_t(1) << 30));
+    ASSERT_EQ(h.m_buckets - 1, h.get_bucket(UINT64_MAX));
+  }
+}
+
+TEST(PerfHdrHistogram, Quantiles) {
+  PerfHdrHistogram h{5};
+  ASSERT_EQ(0u, h.get_quantile(0.5));
+  for (uint64_t v = 1; v <= 100000; ++v) {
+    h.inc(v * 1000);
+  }
+  ASSERT_EQ(100000u, h.get_total());
+  for (double q : {0.0, 0.5, 0.9, 0.99, 0.999, 1.0}) {
+    double expected = std::max(1.0, q * 100000) * 1000;
+    double error = std::abs(double(h.get_quantile(q)) - expected) / expected;
+    ASSERT_LT(error, 1.0 / 32) << "q " << q;
+  }
+  h.reset();
+  ASSERT_EQ(0u, h.get_total());
+}
+
+TEST(PerfHdrHistogram, MergeAndEncode) {
+  PerfHdrHistogram a{3}, b{3};
+  for (uint64_t v = 0; v < 1000; ++v) {
+    a.inc(v);
+    b.inc(v * 1000000);
+  }
+  a.merge(b);
+  ASSERT_EQ(2000u, a.get_total());
+
+  ceph::buffer::list bl;
+  a.encode(bl);
+  PerfHdrHistogram c{1};
+  auto p = bl.cbegin();
+  c.decode(p);
+  ASSERT_EQ(3u, c.get_precision_bits());
+  ASSERT_EQ(a.get_total(), c.get_total());
+  for (double q : {0.1, 0.5, 0.99}) {
+    ASSERT_EQ(a.get_quantile(q), c.get_quantile(q));
+  }
+}
+
+TEST(PerfLatencyHistogram, Shards) {
+  PerfLatencyHistogram h{4, 6, std::chrono::minutes(1)};
+  std::vector<std::thread> threads;
+  for (unsigned t = 0; t < 16; ++t) {
+    threads.emplace_back([&h, t] {
+      for (uint64_t v = 1; v <= 10000; ++v) {
+	h.inc(t, v);
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  auto merged = h.get_merged();
+  ASSERT_EQ(160000u, merged.get_total());
+  double error = std::abs(double(merged.get_quantile(0.5)) - 5000) / 5000;
+  ASSERT_LT(error, 1.0 / 16);
+  h.reset();
+  ASSERT_EQ(0u, h.get_merged().get_total());
+}
+
+TEST(PerfLatencyHistogram, Window) {
+  const auto window = std::chrono::milliseconds(50);
+  PerfLatencyHistogram h{4, 1, window};
+  for (int i = 0; i < 1000; ++i) {
+    h.inc(0, 1000);
+  }
+  ASSERT_EQ(1000u, h.get_window_quantile(0.5));
+
+  // a window later the old values are still part of it
+  std::this_thread::sleep_for(window * 2);
+  for (int i = 0; i < 1000; ++i) {
+    h.inc(0, 1000000);
+  }
+  ASSERT_EQ(1000u, h.get_window_quantile(0.25));
+  ASSERT_NE(1000u, h.get_window_quantile(0.75));
+
+  // another window on they have aged out, the full distribution keeps them
+  std::this_thread::sleep_for(window * 2);
+  ASSERT_NE(1000u, h.get_window_quantile(0.01));
+  ASSERT_EQ(1000u, h.get_merged().get_quantile(0.25));
+}
@@ -1058,6 +1058,9 @@ INSTANTIATE_TEST_SUITE_P(
   ::testing::Values(
 #ifdef HAVE_DPDK
     "dpdk",
+#endif
+#ifdef HAVE_ASYNC_URING
+    "io_uring",
 #endif
     "posix"
   )
@@ -148,7 +148,8 @@ static bufferlist make_bufferlist(size_t len, char c) {
 }
 
 bool disassemble_frame(FrameAssembler& frame_asm, bufferlist& frame_bl,
-                       Tag& tag, segment_bls_t& segment_bls) {
+                       Tag& tag, segment_bls_t& segment_bls,
+                       bool first_segment_early = false) {
   bufferlist preamble_bl;
   frame_bl.splice(0, frame_asm.get_preamble_onwire_len(), &preamble_bl);
   tag = frame_asm.disassemble_preamble(preamble_bl);
@@ -161,6 +162,10 @@ bool disassemble_frame(FrameAssembler& frame_asm, bufferlist& frame_bl,
     if (onwire_len > 0) {
       frame_bl.splice(0, onwire_len, &segment_bls.back());
     }
+    if (seg_idx == 0 && first_segment_early) {
+      frame_asm.disassemble_first_segment_early(preamble_bl,
+                                                segment_bls.back());
+    }
   } while (segment_bls.size() < frame_asm.get_num_segments());
 
   bufferlist epilogue_bl;
@@ -232,7 +237,7 @@ protected:
                       frame_asm.get_frame_onwire_len());
   }
 
-  void test_round_trip() {
+  void test_round_trip(bool first_segment_early = false) {
     auto tx_frame = TestFrame::Encode(m_header, m_front, m_middle, m_data);
     auto onwire_bl = tx_frame.get_buffer(m_tx_frame_asm);
     check_frame_assembler(m_tx_frame_asm);
@@ -241,7 +246,7 @@ protected:
     Tag rx_tag;
     segment_bls_t rx_segment_bls;
     EXPECT_TRUE(disassemble_frame(m_rx_frame_asm, onwire_bl, rx_tag,
-                                  rx_segment_bls));
+                                  rx_segment_bls, first_segment_early));
     check_frame_assembler(m_rx_frame_asm);
     EXPECT_EQ(0, onwire_bl.length());
     EXPECT_EQ(TestFrame::tag, rx_tag);
@@ -279,6 +284,13 @@ TEST_P(RoundTripTest, Reuse) {
   }
 }
 
+TEST_P(RoundTripTest, FirstSegmentEarly) {
+  for (int i = 0; i < 3; i++) {
+    test_round_trip(true);
+    test_round_trip();
+  }
+}
+
 static const round_trip_instance_t round_trip_instances[] = {
   // first segment is empty
   { 0,   0,   0,   0, 1, {{32,  0,  17,   0,   0,  0},
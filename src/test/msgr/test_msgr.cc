@@ -32,6 +32,7 @@
 
 #include "common/ceph_argparse.h"
 #include "common/ceph_mutex.h"
+#include "common/perf_counters_collection.h"
 #include "global/global_init.h"
 #include "messages/MCommand.h"
 #include "messages/MPing.h"
@@ -1062,6 +1063,86 @@ TEST_P(MessengerTest, SimpleMsgr2Test) {
   server_msgr->wait();
 }
 
+// <messages, flushes> of all connections
+static std::pair<uint64_t, uint64_t> sum_send_batch_messages() {
+  uint64_t messages = 0, flushes = 0;
+  g_ceph_context->get_perfcounters_collection()->with_counters(
+    [&](const PerfCountersCollectionImpl::CounterMap& by_path) {
+      for (auto& [path, ref] : by_path) {
+	if (path.find(".msgr_send_batch_messages") != std::string::npos) {
+	  auto [sum, count] = ref.data->read_avg();
+	  messages += sum;
+	  flushes += count;
+	}
+      }
+    });
+  return {messages, flushes};
+}
+
+TEST_P(MessengerTest, SendBatchTest) {
+  FakeDispatcher cli_dispatcher(false), srv_dispatcher(true);
+  entity_addr_t bind_addr;
+  bind_addr.parse("v2:127.0.0.1");
+  server_msgr->bind(bind_addr);
+  server_msgr->add_dispatcher_head(&srv_dispatcher);
+  server_msgr->start();
+
+  client_msgr->add_dispatcher_head(&cli_dispatcher);
+  client_msgr->start();
+
+  ConnectionRef conn = client_msgr->connect_to(
+    server_msgr->get_mytype(),
+    server_msgr->get_myaddrs());
+  {
+    ASSERT_EQ(conn->send_message(new MPing()), 0);
+    std::unique_lock l{cli_dispatcher.lock};
+    cli_dispatcher.cond.wait(l, [&] { return cli_dispatcher.got_new; });
+    cli_dispatcher.got_new = false;
+  }
+  // a burst of small messages, which may leave in batches; all of them
+  // have to make it, and each is accounted for in exactly one batch
+  constexpr unsigned burst = 500;
+  auto session = static_cast<Session*>(conn->get_priv().get());
+  unsigned expected = 1;
+  auto send_burst = [&](const char* limit) -> std::pair<uint64_t, uint64_t> {
+    g_ceph_context->_conf.set_val("ms_async_send_batch_messages", limit);
+    g_ceph_context->_conf.apply_changes(nullptr);
+    auto [messages_before, flushes_before] = sum_send_batch_messages();
+    for (unsigned i = 0; i < burst; ++i) {
+      EXPECT_EQ(conn->send_message(new MPing()), 0);
+    }
+    expected += burst;
+    CHECK_AND_WAIT_TRUE(session->get_count() == expected);
+    EXPECT_EQ(expected, session->get_count());
+    // the pings and the server's replies
+    CHECK_AND_WAIT_TRUE(sum_send_batch_messages().first - messages_before ==
+			2 * burst);
+    auto [messages, flushes] = sum_send_batch_messages();
+    return {messages - messages_before, flushes - flushes_before};
+  };
+
+  // one message per flush: any batch above the limit would show up as
+  // fewer flushes than messages
+  auto [messages, flushes] = send_burst("1");
+  ASSERT_EQ(2 * burst, messages);
+  ASSERT_EQ(2 * burst, flushes);
+
+  // batches of up to 8 messages: the client side of the burst at least
+  // leaves in batches, and none of them is larger than the limit
+  constexpr unsigned limit = 8;
+  std::tie(messages, flushes) = send_burst("8");
+  ASSERT_EQ(2 * burst, messages);
+  ASSERT_LT(flushes, 2 * burst * 3 / 4);
+  ASSERT_GE(flushes, (2 * burst + limit - 1) / limit);
+
+  g_ceph_context->_conf.rm_val("ms_async_send_batch_messages");
+  g_ceph_context->_conf.apply_changes(nullptr);
+  client_msgr->shutdown();
+  client_msgr->wait();
+  server_msgr->shutdown();
+  server_msgr->wait();
+}
+
 TEST_P(MessengerTest, FeatureTest) {
   FakeDispatcher cli_dispatcher(false), srv_dispatcher(true);
   entity_addr_t bind_addr;
@@ -502,6 +502,78 @@ TEST_P(AllocTest, test_alloc_contiguous)
   alloc->shutdown();
 }
 
+TEST_P(AllocTest, test_alloc_hint)
+{
+  if (GetParam() != string("avl") && GetParam() != string("hybrid")) {
+    GTEST_SKIP() << "skipping for " << GetParam();
+  }
+  int64_t block_size = 0x1000;
+  int64_t capacity = block_size * 1024 * 1024;
+
+  init_alloc(capacity, block_size);
+  alloc->set_use_hint(true);
+  alloc->init_add_free(0, capacity);
+
+  PExtentVector extents;
+  uint64_t need = 16 * block_size;
+  int64_t hint = capacity / 2;
+  EXPECT_EQ(need, alloc->allocate(need, block_size, 0, hint, &extents));
+  EXPECT_EQ(1u, extents.size());
+  EXPECT_EQ(hint, extents[0].offset);
+
+  // an unhinted allocation keeps using the cursor from the start
+  extents.clear();
+  EXPECT_EQ(need, alloc->allocate(need, block_size, 0, (int64_t)0, &extents));
+  EXPECT_EQ(1u, extents.size());
+  EXPECT_EQ(0u, extents[0].offset);
+
+  // hinting at a used area picks the next free block after it
+  extents.clear();
+  EXPECT_EQ(need, alloc->allocate(need, block_size, 0, hint, &extents));
+  EXPECT_EQ(1u, extents.size());
+  EXPECT_EQ(hint + need, extents[0].offset);
+
+  alloc->shutdown();
+}
+
+TEST_P(AllocTest, test_alloc_hint_off)
+{
+  if (GetParam() != string("avl") && GetParam() != string("hybrid")) {
+    GTEST_SKIP() << "skipping for " << GetParam();
+  }
+  // unless the owner opts in, hints leave placement as it always was
+  int64_t block_size = 0x1000;
+  int64_t capacity = block_size * 1024 * 1024;
+  boost::scoped_ptr<Allocator> unhinted;
+  init_alloc(capacity, block_size);
+  unhinted.reset(Allocator::create(g_ceph_context, GetParam(), capacity,
+				   block_size,
+				   256*1048576, 100*256*1048576ull));
+  for (auto a : {alloc.get(), unhinted.get()}) {
+    a->init_add_free(0, capacity);
+    // leave some holes for the cursors to skip
+    a->init_rm_free(capacity / 4, capacity / 8);
+    a->init_rm_free(capacity / 2 + block_size, 3 * block_size);
+  }
+
+  gen_type rng;
+  for (int i = 0; i < 256; ++i) {
+    uint64_t need = (rng() % 64 + 1) * block_size;
+    int64_t hint = (capacity / 256) * i;
+    PExtentVector hinted_extents, extents;
+    EXPECT_EQ(alloc->allocate(need, block_size, 0, hint, &hinted_extents),
+	      unhinted->allocate(need, block_size, 0, (int64_t)0, &extents));
+    ASSERT_EQ(extents, hinted_extents) << "allocation " << i;
+    if (i % 3 == 0) {
+      // free some so that later allocations reuse space
+      alloc->release(hinted_extents);
+      unhinted->release(extents);
+    }
+  }
+  alloc->shutdown();
+  unhinted->shutdown();
+}
+
 TEST_P(AllocTest, test_alloc_47883)
 {
   uint64_t block = 0x1000;
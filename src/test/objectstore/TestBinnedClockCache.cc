@@ -0,0 +1,141 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <gtest/gtest.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "global/global_context.h"
+#include "include/stringify.h"
+#include "kv/rocksdb_cache/BinnedClockCache.h"
+
+using namespace std;
+using rocksdb_cache::BinnedClockCache;
+
+namespace {
+
+std::atomic<uint64_t> deleted = 0;
+
+void delete_value(const rocksdb::Slice& key, void* value) {
+  delete static_cast<std::string*>(value);
+  ++deleted;
+}
+
+std::shared_ptr<BinnedClockCache> make_cache(size_t capacity, int shard_bits,
+                                             size_t entry_charge) {
+  return std::static_pointer_cast<BinnedClockCache>(
+    rocksdb_cache::NewBinnedClockCache(g_ceph_context, capacity, shard_bits,
+                                       false, 0.0, entry_charge));
+}
+
+bool insert(rocksdb::Cache* cache, const std::string& key, size_t charge) {
+  return cache->Insert(key, new std::string(key), charge, &delete_value,
+                       nullptr, rocksdb::Cache::Priority::LOW).ok();
+}
+
+// look key up and check the value belongs to it
+bool lookup(rocksdb::Cache* cache, const std::string& key) {
+  rocksdb::Cache::Handle* h = cache->Lookup(key, nullptr);
+  if (h == nullptr) {
+    return false;
+  }
+  EXPECT_EQ(key, *static_cast<std::string*>(cache->Value(h)));
+  cache->Release(h);
+  return true;
+}
+
+}
+
+TEST(BinnedClockCache, HitRate) {
+  const size_t charge = 1024;
+  auto cache = make_cache(1 << 20, 0, charge);
+  // a hot set of a quarter of the cache, accessed between scans of half
+  // the cache worth of keys that are never read again
+  const int hot = 256, cold = 512, rounds = 20;
+  uint64_t hits = 0, lookups = 0;
+  int next_cold = 0;
+  for (int round = 0; round < rounds; ++round) {
+    for (int i = 0; i < hot; ++i) {
+      std::string key = "hot" + stringify(i);
+      if (lookup(cache.get(), key)) {
+        if (round > 0) {
+          ++hits;
+        }
+      } else {
+        ASSERT_TRUE(insert(cache.get(), key, charge));
+      }
+      if (round > 0) {
+        ++lookups;
+      }
+    }
+    for (int i = 0; i < cold; ++i) {
+      ASSERT_TRUE(insert(cache.get(), "cold" + stringify(next_cold++), charge));
+    }
+    ASSERT_LE(cache->GetUsage(), cache->GetCapacity());
+  }
+  // the clock keeps the hot entries, the scans only evict each other
+  ASSERT_GE(double(hits) / lookups, 0.9) << hits << "/" << lookups;
+  ASSERT_EQ(0u, cache->get_perf_counters()->get(
+              l_binned_clock_occupancy_evictions));
+}
+
+TEST(BinnedClockCache, ConcurrentInsertEviction) {
+  const size_t charge = 1024, capacity = 1 << 20;
+  const int threads = 4, keys = 20000;
+  deleted = 0;
+  auto cache = make_cache(capacity, 2, charge);
+  std::atomic<uint64_t> found = 0;
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; ++t) {
+    workers.emplace_back([&, t] {
+      for (int i = 0; i < keys; ++i) {
+        std::string key = stringify(t) + "." + stringify(i);
+        EXPECT_TRUE(insert(cache.get(), key, charge));
+        // read back a recent key of some other thread
+        std::string other = stringify((t + 1) % threads) + "." +
+          stringify(std::max(0, i - 16));
+        if (lookup(cache.get(), other)) {
+          ++found;
+        }
+      }
+    });
+  }
+  for (auto& w : workers) {
+    w.join();
+  }
+  ASSERT_LE(cache->GetUsage(), capacity);
+  ASSERT_GT(found.load(), 0u);
+  // everything evicted so far was freed exactly once, and the rest goes
+  // with the cache
+  ASSERT_LT(deleted.load(), uint64_t(threads * keys));
+  cache.reset();
+  ASSERT_EQ(uint64_t(threads * keys), deleted.load());
+}
+
+TEST(BinnedClockCache, SetCapacityPastTable) {
+  const size_t charge = 4096, capacity = 256 << 10;
+  auto cache = make_cache(capacity, 0, charge);
+  auto logger = cache->get_perf_counters();
+  const uint64_t slots = logger->get(l_binned_clock_table_slots);
+  // fill the cache it was sized for: evictions are by capacity only
+  int next = 0;
+  for (; next < 4 * int(capacity / charge); ++next) {
+    ASSERT_TRUE(insert(cache.get(), stringify(next), charge));
+  }
+  ASSERT_EQ(0u, logger->get(l_binned_clock_occupancy_evictions));
+
+  // grow the cache well past what the table can hold
+  cache->SetCapacity(capacity * 64);
+  ASSERT_LT(slots * charge, cache->GetCapacity());
+  for (int i = 0; i < int(2 * slots); ++i, ++next) {
+    ASSERT_TRUE(insert(cache.get(), stringify(next), charge));
+    ASSERT_TRUE(lookup(cache.get(), stringify(next)));
+  }
+  // the table, not the capacity, limits the cache now, and says so
+  ASSERT_LE(cache->GetUsage(), slots * charge);
+  ASSERT_LT(cache->GetUsage(), cache->GetCapacity());
+  ASSERT_GT(logger->get(l_binned_clock_occupancy_evictions), 0u);
+  ASSERT_TRUE(lookup(cache.get(), stringify(next - 1)));
+}
@@ -17,6 +17,7 @@
 #include <string.h>
 #include <iostream>
 #include <memory>
+#include <thread>
 #include <time.h>
 #include <sys/mount.h>
 #include <boost/random/mersenne_twister.hpp>
@@ -6968,6 +6969,175 @@ TEST_P(StoreTestSpecificAUSize, TooManyBlobsTest) {
 }
 
 #if defined(WITH_BLUESTORE)
+// how much of the extents, once sorted and adjacent ones merged, lies
+// in whole, aligned units of the given size
+static uint64_t bytes_in_whole_units(PExtentVector exts, uint64_t unit)
+{
+  std::sort(exts.begin(), exts.end(),
+	    [](const bluestore_pextent_t& a, const bluestore_pextent_t& b) {
+	      return a.offset < b.offset;
+	    });
+  uint64_t covered = 0;
+  for (auto p = exts.begin(); p != exts.end(); ) {
+    uint64_t start = p->offset;
+    uint64_t end = p->end();
+    for (++p; p != exts.end() && p->offset == end; ++p) {
+      end = p->end();
+    }
+    uint64_t b = p2roundup(start, unit);
+    uint64_t e = p2align(end, unit);
+    if (e > b) {
+      covered += e - b;
+    }
+  }
+  return covered;
+}
+
+TEST_P(StoreTestSpecificAUSize, AllocUnitHint) {
+  if (string(GetParam()) != "bluestore")
+    return;
+  if (smr) {
+    cout << "SKIP: zoned allocations ignore the hint" << std::endl;
+    return;
+  }
+  // leave free space in pieces of at most 256K: a 64K hint can be
+  // satisfied, a 1M one cannot
+  SetVal(g_conf(), "bluestore_allocation_from_file", "false");
+  SetVal(g_conf(), "bluestore_debug_prefill", "0.1");
+  SetVal(g_conf(), "bluestore_debug_prefragment_max", "262144");
+  SetVal(g_conf(), "bluestore_compression_mode", "none");
+  StartDeferred(0x1000);
+  BlueStore* bstore = dynamic_cast<BlueStore*>(store.get());
+  ASSERT_TRUE(bstore);
+  const uint64_t min_alloc_size = 0x1000;
+
+  auto create = [&](coll_t cid, int64_t hint) {
+    auto ch = store->create_new_collection(cid);
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    EXPECT_EQ(queue_transaction(store, ch, std::move(t)), 0);
+    pool_opts_t opts;
+    opts.set(pool_opts_t::ALLOC_UNIT_HINT, hint);
+    EXPECT_EQ(store->set_collection_opts(ch, opts), 0);
+    return ch;
+  };
+  // writes the object and returns its physical extents, checking they
+  // hold exactly its data in min_alloc_size units
+  auto write = [&](ObjectStore::CollectionHandle& ch, const string& name,
+		   uint64_t len) {
+    ghobject_t hoid(hobject_t(sobject_t(name, CEPH_NOSNAP)));
+    bufferlist bl;
+    bl.append(std::string(len, name[0]));
+    ObjectStore::Transaction t;
+    t.write(ch->cid, hoid, 0, bl.length(), bl);
+    EXPECT_EQ(queue_transaction(store, ch, std::move(t)), 0);
+    bufferlist in;
+    EXPECT_EQ(store->read(ch, hoid, 0, len, in), (int)len);
+    EXPECT_TRUE(bl_eq(bl, in));
+    PExtentVector exts;
+    bstore->get_object_pextents(ch->cid, hoid, &exts);
+    uint64_t total = 0;
+    for (auto& p : exts) {
+      EXPECT_EQ(0u, p.offset % min_alloc_size);
+      EXPECT_EQ(0u, p.length % min_alloc_size);
+      total += p.length;
+    }
+    EXPECT_EQ(len, total);
+    return exts;
+  };
+
+  const uint64_t hint = 0x10000;
+  auto ch = create(coll_t(spg_t(pg_t(0, 1), shard_id_t::NO_SHARD)), hint);
+  {
+    // all but the short tail comes in whole, aligned hinted units
+    auto exts = write(ch, "a", 4 * hint + 0x4000);
+    ASSERT_GE(bytes_in_whole_units(exts, hint), 4 * hint);
+  }
+  {
+    // less than a hinted unit is allocated at min_alloc_size
+    write(ch, "b", 0x4000);
+  }
+
+  const uint64_t big_hint = 0x100000;
+  auto big_ch = create(coll_t(spg_t(pg_t(0, 2), shard_id_t::NO_SHARD)),
+		       big_hint);
+  {
+    // no free piece is large enough for the hint: the whole write falls
+    // back to min_alloc_size
+    auto exts = write(big_ch, "c", 2 * big_hint);
+    ASSERT_EQ(0u, bytes_in_whole_units(exts, big_hint));
+  }
+}
+
+TEST_P(StoreTestSpecificAUSize, ParallelAllocationRecovery) {
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  // small blobs and extent map shards so that onodes spill into shard
+  // keys, which the parallel walk has to keep with their onode
+  SetVal(g_conf(), "bluestore_max_blob_size", "4096");
+  SetVal(g_conf(), "bluestore_extent_map_shard_min_size", "60");
+  SetVal(g_conf(), "bluestore_extent_map_shard_max_size", "300");
+  SetVal(g_conf(), "bluestore_extent_map_shard_target_size", "150");
+  SetVal(g_conf(), "bluestore_compression_mode", "none");
+  StartDeferred(0x1000);
+
+  const unsigned num_colls = 8, num_objects = 16;
+  const uint64_t object_size = 0x10000;
+  int r;
+  for (unsigned c = 0; c < num_colls; ++c) {
+    coll_t cid(spg_t(pg_t(c, 1), shard_id_t::NO_SHARD));
+    auto ch = store->create_new_collection(cid);
+    {
+      ObjectStore::Transaction t;
+      t.create_collection(cid, 0);
+      r = queue_transaction(store, ch, std::move(t));
+      ASSERT_EQ(r, 0);
+    }
+    for (unsigned i = 0; i < num_objects; ++i) {
+      ghobject_t hoid(hobject_t(sobject_t("obj" + stringify(i), CEPH_NOSNAP)));
+      bufferlist bl;
+      bl.append(std::string(object_size, 'a' + (c + i) % 26));
+      ObjectStore::Transaction t;
+      t.write(cid, hoid, 0, bl.length(), bl);
+      if (i % 2) {
+	// the clone shares the blobs, then part of them is overwritten
+	ghobject_t clone(hobject_t(sobject_t("obj" + stringify(i), 1)));
+	t.clone(cid, hoid, clone);
+	bufferlist bl2;
+	bl2.append(std::string(object_size / 4, 'z'));
+	t.write(cid, hoid, object_size / 2, bl2.length(), bl2);
+      }
+      r = queue_transaction(store, ch, std::move(t));
+      ASSERT_EQ(r, 0);
+    }
+  }
+  // get everything into the DB
+  CloseAndReopen();
+
+  BlueStore* bstore = dynamic_cast<BlueStore*>(store.get());
+  ASSERT_TRUE(bstore);
+  interval_set<uint64_t> serial;
+  uint64_t serial_onodes = 0, serial_shared = 0;
+  r = bstore->read_allocation_from_onodes_for_test(
+    0, &serial, &serial_onodes, &serial_shared);
+  ASSERT_EQ(r, 0);
+  ASSERT_EQ(num_colls * num_objects * 3 / 2, serial_onodes);
+  ASSERT_GT(serial_shared, 0u);
+  ASSERT_GE(serial.size(), num_colls * num_objects * object_size);
+
+  for (unsigned threads : {1, 4, 16}) {
+    interval_set<uint64_t> parallel;
+    uint64_t onodes = 0, shared = 0;
+    r = bstore->read_allocation_from_onodes_for_test(
+      threads, &parallel, &onodes, &shared);
+    ASSERT_EQ(r, 0);
+    ASSERT_EQ(serial_onodes, onodes) << threads << " threads";
+    ASSERT_EQ(serial_shared, shared) << threads << " threads";
+    ASSERT_EQ(serial, parallel) << threads << " threads";
+  }
+}
+
 void get_mempool_stats(uint64_t* total_bytes, uint64_t* total_items)
 {
   uint64_t meta_allocated = mempool::bluestore_cache_meta::allocated_bytes();
@@ -8310,6 +8480,198 @@ TEST_P(StoreTestSpecificAUSize, DeferredDifferentChunks) {
   }
 }
 
+TEST_P(StoreTestSpecificAUSize, DeferredMergeOsrs) {
+
+  if (string(GetParam()) != "bluestore")
+    return;
+  if (smr) {
+    cout << "SKIP: no deferred" << std::endl;
+    return;
+  }
+
+  size_t alloc_size = 4096;
+  size_t object_size = 65536;
+  const int num_colls = 4;
+  StartDeferred(alloc_size);
+  SetVal(g_conf(), "bluestore_prefer_deferred_size", "65536");
+  SetVal(g_conf(), "bluestore_deferred_batch_ops", stringify(num_colls).c_str());
+  SetVal(g_conf(), "bluestore_deferred_merge_osrs", "true");
+  g_conf().apply_changes(nullptr);
+
+  int r;
+  int poolid = 4373;
+  const PerfCounters* logger = store->get_perf_counters();
+  vector<coll_t> cids;
+  vector<ObjectStore::CollectionHandle> chs;
+  for (int i = 0; i < num_colls; ++i) {
+    coll_t cid(spg_t(pg_t(i, poolid), shard_id_t::NO_SHARD));
+    auto ch = store->create_new_collection(cid);
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+    cids.push_back(cid);
+    chs.push_back(ch);
+  }
+  ghobject_t hoid(hobject_t(sobject_t("Object 1", CEPH_NOSNAP),
+			    string(), 0, poolid, string()));
+  for (int i = 0; i < num_colls; ++i) {
+    ObjectStore::Transaction t;
+    bufferlist bl;
+    bl.append(std::string(object_size, 'a' + i));
+    t.write(cids[i], hoid, 0, bl.length(), bl);
+    r = queue_transaction(store, chs[i], std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  // small overwrites go deferred, one per sequencer
+  for (int i = 0; i < num_colls; ++i) {
+    ObjectStore::Transaction t;
+    bufferlist bl;
+    bl.append(std::string(alloc_size, 'z'));
+    t.write(cids[i], hoid, alloc_size * i, bl.length(), bl);
+    r = queue_transaction(store, chs[i], std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  for (int i = 0; i < 100 &&
+	 logger->get(l_bluestore_deferred_merged_submits) == 0; ++i) {
+    usleep(100000);
+  }
+  ASSERT_GT(logger->get(l_bluestore_deferred_merged_submits), 0u);
+  ASSERT_GT(logger->get(l_bluestore_deferred_merged_batches), 1u);
+
+  chs.clear();
+  CloseAndReopen();
+  for (int i = 0; i < num_colls; ++i) {
+    auto ch = store->open_collection(cids[i]);
+    bufferlist bl, expected;
+    r = store->read(ch, hoid, 0, object_size, bl);
+    ASSERT_EQ(r, (int)object_size);
+    expected.append(string(alloc_size * i, 'a' + i));
+    expected.append(string(alloc_size, 'z'));
+    expected.append(string(object_size - alloc_size * (i + 1), 'a' + i));
+    ASSERT_TRUE(bl_eq(expected, bl));
+
+    ObjectStore::Transaction t;
+    t.remove(cids[i], hoid);
+    t.remove_collection(cids[i]);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+}
+
+TEST_P(StoreTestSpecificAUSize, ExtentMapReadahead) {
+
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  size_t alloc_size = 4096;
+  size_t object_size = 256 * 1024;
+  SetVal(g_conf(), "bluestore_max_blob_size", stringify(alloc_size).c_str());
+  SetVal(g_conf(), "bluestore_extent_map_shard_min_size", "60");
+  SetVal(g_conf(), "bluestore_extent_map_shard_max_size", "300");
+  SetVal(g_conf(), "bluestore_extent_map_shard_target_size", "150");
+  SetVal(g_conf(), "bluestore_extent_map_readahead_shards", "4");
+  StartDeferred(alloc_size);
+
+  int r;
+  coll_t cid;
+  ghobject_t hoid(hobject_t("test_readahead", "", CEPH_NOSNAP, 0, -1, ""));
+  bufferlist data;
+  for (size_t i = 0; i < object_size / alloc_size; ++i) {
+    data.append(std::string(alloc_size, 'a' + i % 26));
+  }
+  {
+    auto ch = store->create_new_collection(cid);
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    t.write(cid, hoid, 0, data.length(), data);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  // drop the extent map from the cache
+  CloseAndReopen();
+  auto ch = store->open_collection(cid);
+  const PerfCounters* logger = store->get_perf_counters();
+  for (size_t offs = 0; offs < object_size; offs += alloc_size) {
+    bufferlist bl, expected;
+    r = store->read(ch, hoid, offs, alloc_size, bl);
+    ASSERT_EQ(r, (int)alloc_size);
+    expected.substr_of(data, offs, alloc_size);
+    ASSERT_TRUE(bl_eq(expected, bl));
+  }
+  ASSERT_GT(logger->get(l_bluestore_onode_shard_prefetched), 0u);
+  ASSERT_GT(logger->get(l_bluestore_onode_shard_prefetch_hits), 0u);
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, hoid);
+    t.remove_collection(cid);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+}
+
+TEST_P(StoreTestSpecificAUSize, ReadReferencesDeviceBuffers) {
+
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  size_t alloc_size = 4096;
+  size_t object_size = 1024 * 1024;
+  SetVal(g_conf(), "bluestore_csum_type", "crc32c");
+  SetVal(g_conf(), "bluestore_default_buffered_read", "false");
+  StartDeferred(alloc_size);
+
+  int r;
+  coll_t cid;
+  ghobject_t hoid(hobject_t("test_zero_copy", "", CEPH_NOSNAP, 0, -1, ""));
+  bufferlist data;
+  for (size_t i = 0; i < object_size / alloc_size; ++i) {
+    data.append(std::string(alloc_size, 'a' + i % 26));
+  }
+  auto ch = store->create_new_collection(cid);
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    t.write(cid, hoid, 0, data.length(), data,
+	    CEPH_OSD_OP_FLAG_FADVISE_DONTNEED);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  ch.reset();
+  // make sure nothing is served from the buffer cache
+  CloseAndReopen();
+  ch = store->open_collection(cid);
+  {
+    bufferlist bl;
+    r = store->read(ch, hoid, 0, object_size, bl,
+		    CEPH_OSD_OP_FLAG_FADVISE_DONTNEED);
+    ASSERT_EQ(r, (int)object_size);
+    ASSERT_TRUE(bl_eq(data, bl));
+    // the result must be made of the aligned buffers the device read
+    // into rather than of copies
+    for (auto& p : bl.buffers()) {
+      ASSERT_EQ(0u, (uintptr_t)p.c_str() % alloc_size);
+    }
+  }
+  {
+    // unaligned reads trim the device buffers instead of copying them
+    bufferlist bl, expected;
+    r = store->read(ch, hoid, alloc_size + 1, alloc_size * 2, bl,
+		    CEPH_OSD_OP_FLAG_FADVISE_DONTNEED);
+    ASSERT_EQ(r, (int)alloc_size * 2);
+    expected.substr_of(data, alloc_size + 1, alloc_size * 2);
+    ASSERT_TRUE(bl_eq(expected, bl));
+    ASSERT_EQ(1u, (uintptr_t)bl.front().c_str() % alloc_size);
+  }
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, hoid);
+    t.remove_collection(cid);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+}
+
 TEST_P(StoreTestSpecificAUSize, BlobReuseOnOverwriteReverse) {
 
   if (string(GetParam()) != "bluestore")
@@ -9844,6 +10206,199 @@ TEST_P(StoreTest, SpuriousReadErrorTest) {
   }
 }
 
+TEST_P(StoreTest, DeepFsckParallelReads) {
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  const unsigned num_objects = 64;
+  int r;
+  coll_t cid;
+  auto ch = store->create_new_collection(cid);
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  bufferlist bl;
+  bl.append(std::string(0x3000, 'a'));
+  for (unsigned i = 0; i < num_objects; ++i) {
+    ghobject_t hoid(hobject_t(sobject_t("obj" + stringify(i), CEPH_NOSNAP)));
+    ObjectStore::Transaction t;
+    t.write(cid, hoid, 0, bl.length(), bl);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  ch.reset();
+  ASSERT_EQ(store->umount(), 0);
+
+  SetVal(g_conf(), "bluestore_fsck_deep_read_threads", "4");
+  g_ceph_context->_conf.apply_changes(nullptr);
+  ASSERT_EQ(store->fsck(true), 0);
+
+  // every object read fails, each must be accounted exactly once
+  SetVal(g_conf(), "bluestore_retry_disk_reads", "0");
+  SetVal(g_conf(), "bluestore_debug_inject_csum_err_probability", "1");
+  g_ceph_context->_conf.apply_changes(nullptr);
+  ASSERT_EQ(store->fsck(true), (int)num_objects);
+
+  SetVal(g_conf(), "bluestore_debug_inject_csum_err_probability", "0");
+  g_ceph_context->_conf.apply_changes(nullptr);
+  ASSERT_EQ(store->mount(), 0);
+}
+
+TEST_P(StoreTest, DeepFsckParallelReadsCorruptData) {
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  const unsigned num_objects = 32;
+  int r;
+  coll_t cid;
+  auto ch = store->create_new_collection(cid);
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  bufferlist bl;
+  bl.append(std::string(0x3000, 'a'));
+  for (unsigned i = 0; i < num_objects; ++i) {
+    ghobject_t hoid(hobject_t(sobject_t("obj" + stringify(i), CEPH_NOSNAP)));
+    ObjectStore::Transaction t;
+    t.write(cid, hoid, 0, bl.length(), bl);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  // remount so that deferred writes have landed before we corrupt the data
+  ch.reset();
+  ASSERT_EQ(store->umount(), 0);
+  ASSERT_EQ(store->mount(), 0);
+  BlueStore* bstore = dynamic_cast<BlueStore*>(store.get());
+  ASSERT_TRUE(bstore);
+  bstore->inject_csum_error(
+    cid, ghobject_t(hobject_t(sobject_t("obj7", CEPH_NOSNAP))));
+  ASSERT_EQ(store->umount(), 0);
+
+  SetVal(g_conf(), "bluestore_retry_disk_reads", "0");
+  SetVal(g_conf(), "bluestore_fsck_deep_read_threads", "4");
+  g_ceph_context->_conf.apply_changes(nullptr);
+  ASSERT_EQ(store->fsck(false), 0);
+  ASSERT_EQ(store->fsck(true), 1);
+
+  SetVal(g_conf(), "bluestore_fsck_deep_read_threads", "0");
+  g_ceph_context->_conf.apply_changes(nullptr);
+  ASSERT_EQ(store->fsck(true), 1);
+  ASSERT_EQ(store->mount(), 0);
+}
+
+TEST_P(StoreTest, OnodeLookupRacingTrimAndRename) {
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  // no onode cache: every onode that gets unpinned is trimmed right away
+  SetVal(g_conf(), "bluestore_cache_size_ssd", "0");
+  SetVal(g_conf(), "bluestore_cache_size_hdd", "0");
+  SetVal(g_conf(), "bluestore_cache_size", "0");
+  SetVal(g_conf(), "bluestore_cache_autotune", "false");
+  g_ceph_context->_conf.apply_changes(nullptr);
+  ASSERT_EQ(store->umount(), 0);
+  ASSERT_EQ(store->mount(), 0);
+
+  const unsigned num_objects = 64, rounds = 100, readers = 4;
+  int r;
+  // both collections share the store's only onode cache shard
+  coll_t cid(spg_t(pg_t(0, 1), shard_id_t::NO_SHARD));
+  coll_t other_cid(spg_t(pg_t(1, 1), shard_id_t::NO_SHARD));
+  auto ch = store->create_new_collection(cid);
+  auto other_ch = store->create_new_collection(other_cid);
+  auto name = [](const char* prefix, unsigned i) {
+    return ghobject_t(hobject_t(sobject_t(prefix + stringify(i), CEPH_NOSNAP)));
+  };
+  auto data = [](unsigned i) {
+    bufferlist bl;
+    bl.append(std::string(0x1000, 'a' + i % 26) + stringify(i));
+    return bl;
+  };
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    t.create_collection(other_cid, 0);
+    for (unsigned i = 0; i < num_objects; ++i) {
+      auto bl = data(i);
+      t.write(cid, name("a", i), 0, bl.length(), bl);
+    }
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+
+  // objects move between "a" and "b" names; a lookup either misses or
+  // finds the object with its own data
+  std::atomic<bool> stop = false;
+  std::atomic<uint64_t> hits = 0;
+  std::vector<std::thread> threads;
+  for (unsigned n = 0; n < readers; ++n) {
+    threads.emplace_back([&, n] {
+      for (unsigned j = n; !stop; ++j) {
+	unsigned i = (j * 7) % num_objects;
+	auto expected = data(i);
+	for (auto prefix : {"a", "b"}) {
+	  bufferlist bl;
+	  int ret = store->read(ch, name(prefix, i), 0, expected.length(), bl);
+	  if (ret == -ENOENT) {
+	    continue;
+	  }
+	  EXPECT_EQ((int)expected.length(), ret);
+	  EXPECT_TRUE(bl_eq(expected, bl));
+	  ++hits;
+	}
+      }
+    });
+  }
+  // onodes of another collection come and go, trimming ours meanwhile
+  threads.emplace_back([&] {
+    for (unsigned j = 0; !stop; ++j) {
+      ObjectStore::Transaction t;
+      auto bl = data(j);
+      t.write(other_cid, name("c", j % num_objects), 0, bl.length(), bl);
+      t.remove(other_cid, name("c", (j + num_objects / 2) % num_objects));
+      EXPECT_EQ(queue_transaction(store, other_ch, std::move(t)), 0);
+    }
+  });
+  for (unsigned round = 0; round < rounds; ++round) {
+    const char* from = round % 2 ? "b" : "a";
+    const char* to = round % 2 ? "a" : "b";
+    for (unsigned i = 0; i < num_objects; ++i) {
+      ObjectStore::Transaction t;
+      t.collection_move_rename(cid, name(from, i), cid, name(to, i));
+      EXPECT_EQ(queue_transaction(store, ch, std::move(t)), 0);
+    }
+  }
+  stop = true;
+  for (auto& t : threads) {
+    t.join();
+  }
+  ASSERT_GT(hits.load(), 0u);
+  cout << "onode lookup retries "
+       << store->get_perf_counters()->get(l_bluestore_onode_lookup_retries)
+       << std::endl;
+
+  // the last round moved everything back to "a"
+  for (unsigned i = 0; i < num_objects; ++i) {
+    bufferlist bl, expected = data(i);
+    struct stat st;
+    ASSERT_EQ(store->stat(ch, name("b", i), &st), -ENOENT);
+    r = store->read(ch, name("a", i), 0, expected.length(), bl);
+    ASSERT_EQ((int)expected.length(), r);
+    ASSERT_TRUE(bl_eq(expected, bl));
+  }
+  ch.reset();
+  other_ch.reset();
+  ASSERT_EQ(store->umount(), 0);
+  ASSERT_EQ(store->fsck(false), 0);
+  ASSERT_EQ(store->mount(), 0);
+}
+
 TEST_P(StoreTest, mergeRegionTest) {
   if (string(GetParam()) != "bluestore")
     return;
@@ -382,6 +382,59 @@ TEST(bluestore_blob_t, calc_csum)
   }
 }
 
+TEST(bluestore_blob_t, calc_csum_fragmented)
+{
+  // 40 blocks of 512 bytes; the fragmented copy is made of pieces whose
+  // sizes do not line up with the csum blocks so some blocks straddle
+  // segments while others are batched within one.
+  bufferptr bp(40 * 512);
+  for (unsigned i = 0; i < bp.length(); ++i)
+    bp.c_str()[i] = rand();
+  bufferlist whole;
+  whole.append(bp);
+  bufferlist frag;
+  unsigned off = 0;
+  for (unsigned len : {100u, 2048u, 3000u, 1u, 511u, 4096u, 6000u}) {
+    frag.append(bp.c_str() + off, len);
+    off += len;
+  }
+  frag.append(bp.c_str() + off, bp.length() - off);
+  ASSERT_TRUE(whole.contents_equal(frag));
+
+  for (unsigned csum_type = Checksummer::CSUM_NONE + 1;
+       csum_type < Checksummer::CSUM_MAX;
+       ++csum_type) {
+    cout << "csum_type " << Checksummer::get_csum_type_string(csum_type)
+	 << std::endl;
+    bluestore_blob_t a, b;
+    a.init_csum(csum_type, 9, whole.length());
+    b.init_csum(csum_type, 9, whole.length());
+    a.calc_csum(0, whole);
+    b.calc_csum(0, frag);
+    ASSERT_EQ(0, a.csum_data.cmp(b.csum_data));
+
+    int bad_off;
+    uint64_t bad_csum;
+    ASSERT_EQ(0, a.verify_csum(0, frag, &bad_off, &bad_csum));
+    ASSERT_EQ(-1, bad_off);
+
+    // corrupt a block in the middle of a segment and one straddling two
+    for (unsigned pos : {3u * 512 + 7, 5u * 512 + 500}) {
+      bufferlist bad;
+      bad.append(frag);
+      bad.rebuild();
+      bad.c_str()[pos] ^= 0xff;
+      bufferlist bad_frag;
+      bad_frag.substr_of(bad, 0, 3000);
+      bufferlist rest;
+      rest.substr_of(bad, 3000, bad.length() - 3000);
+      bad_frag.append(rest);
+      ASSERT_EQ(-1, a.verify_csum(0, bad_frag, &bad_off, &bad_csum));
+      ASSERT_EQ((int)(pos / 512 * 512), bad_off);
+    }
+  }
+}
+
 TEST(bluestore_blob_t, csum_bench)
 {
   bufferlist bl;
@@ -908,6 +961,70 @@ TEST(Blob, put_ref)
   }
 }
 
+TEST(BufferCacheShard, arc_scan_resistance)
+{
+  BlueStore::BufferCacheShard *bc = BlueStore::BufferCacheShard::create(
+    g_ceph_context, "arc", NULL);
+  const uint32_t bsize = 0x1000;
+  bc->set_max(16 * bsize);
+
+  BlueStore::BufferSpace bs;
+  auto make_bl = [&](char c) {
+    bufferlist bl;
+    bl.append(std::string(bsize, c));
+    return bl;
+  };
+  // a small working set, read twice
+  for (uint32_t i = 0; i < 4; ++i) {
+    bufferlist bl = make_bl('h');
+    bs.did_read(bc, i * bsize, bl);
+  }
+  {
+    std::lock_guard l(bc->lock);
+    for (uint32_t i = 0; i < 4; ++i) {
+      bc->_touch(bs.buffer_map[i * bsize].get());
+    }
+  }
+  // followed by a scan several times the cache size
+  for (uint32_t i = 0; i < 64; ++i) {
+    bufferlist bl = make_bl('s');
+    bs.did_read(bc, 0x100000 + i * bsize, bl);
+  }
+  ASSERT_LE(bc->_get_bytes(), 16 * bsize);
+  for (uint32_t i = 0; i < 4; ++i) {
+    auto p = bs.buffer_map.find(i * bsize);
+    ASSERT_NE(p, bs.buffer_map.end());
+    ASSERT_TRUE(p->second->is_clean());
+  }
+  // the oldest scanned buffers are gone, the newest are still cached
+  auto p = bs.buffer_map.find(0x100000);
+  ASSERT_TRUE(p == bs.buffer_map.end() || p->second->is_empty());
+  p = bs.buffer_map.find(0x100000 + 63 * bsize);
+  ASSERT_NE(p, bs.buffer_map.end());
+  ASSERT_TRUE(p->second->is_clean());
+
+  // re-reading a recently evicted block counts as a second reference and
+  // keeps it through the next scan
+  const uint32_t again = 0x100000 + 50 * bsize;
+  {
+    bufferlist bl = make_bl('s');
+    bs.did_read(bc, again, bl);
+  }
+  for (uint32_t i = 0; i < 64; ++i) {
+    bufferlist bl = make_bl('t');
+    bs.did_read(bc, 0x200000 + i * bsize, bl);
+  }
+  p = bs.buffer_map.find(again);
+  ASSERT_NE(p, bs.buffer_map.end());
+  ASSERT_TRUE(p->second->is_clean());
+  {
+    std::lock_guard l(bc->lock);
+    bs._clear(bc);
+  }
+  ASSERT_EQ(0u, bc->_get_bytes());
+  delete bc;
+}
+
 TEST(bluestore_blob_t, can_split)
 {
   bluestore_blob_t a;
@@ -1277,6 +1394,50 @@ void clear_and_dispose(BlueStore::old_extent_map_t& old_em)
   }
 }
 
+TEST(ExtentMap, decode_bench)
+{
+  BlueStore store(g_ceph_context, "", 4096);
+  BlueStore::OnodeCacheShard *oc = BlueStore::OnodeCacheShard::create(
+    g_ceph_context, "lru", NULL);
+  BlueStore::BufferCacheShard *bc = BlueStore::BufferCacheShard::create(
+    g_ceph_context, "lru", NULL);
+  auto coll = ceph::make_ref<BlueStore::Collection>(&store, oc, bc, coll_t());
+  BlueStore::Onode onode(coll.get(), ghobject_t(), "");
+
+  for (unsigned num : {1, 8, 64}) {
+    bufferlist bl;
+    {
+      BlueStore::ExtentMap em(&onode);
+      for (unsigned i = 0; i < num; ++i) {
+        BlueStore::BlobRef b(new BlueStore::Blob);
+        b->shared_blob = new BlueStore::SharedBlob(coll.get());
+        b->dirty_blob().allocated_test(
+          bluestore_pextent_t(0x100000 + i * 0x10000, 0x10000));
+        b->dirty_blob().init_csum(Checksummer::CSUM_CRC32C, 12, 0x10000);
+        em.extent_map.insert(*new BlueStore::Extent(i * 0x10000, 0, 0x10000, b));
+      }
+      unsigned n = 0;
+      ASSERT_FALSE(em.encode_some(0, num * 0x10000, bl, &n));
+      ASSERT_EQ(num, n);
+      em.clear();
+    }
+    bl.rebuild();
+
+    int count = 100000 / num;
+    ceph::mono_clock::time_point start = ceph::mono_clock::now();
+    for (int i = 0; i < count; ++i) {
+      BlueStore::ExtentMap em(&onode);
+      ASSERT_EQ(num, em.decode_some(bl));
+      ASSERT_EQ(num, em.extent_map.size());
+      em.clear();
+    }
+    ceph::mono_clock::time_point end = ceph::mono_clock::now();
+    auto dur = std::chrono::duration_cast<ceph::timespan>(end - start);
+    cout << num << " extents/shard, " << count << " decodes, "
+         << (double)dur.count() / count / num << " ns/extent" << std::endl;
+  }
+}
+
 TEST(GarbageCollector, BasicTest)
 {
   BlueStore::OnodeCacheShard *oc = BlueStore::OnodeCacheShard::create(
@@ -17,12 +17,15 @@
 #include <iostream>
 #include <time.h>
 #include <sys/mount.h>
+#include <thread>
 #include "kv/KeyValueDB.h"
 #include "kv/RocksDBStore.h"
 #include "include/Context.h"
 #include "common/ceph_argparse.h"
 #include "global/global_init.h"
 #include "common/Cond.h"
+#include "common/admin_socket.h"
+#include "common/perf_counters.h"
 #include "common/errno.h"
 #include "include/stringify.h"
 #include <gtest/gtest.h>
@@ -219,6 +222,121 @@ string tostr(bufferlist& b) {
   return string(b.c_str(),b.length());
 }
 
+TEST_P(KVTest, GetConcurrentWrites) {
+  ASSERT_EQ(0, db->create_and_open(cout));
+  const int num_keys = 1000;
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    for (int i = 0; i < num_keys; ++i) {
+      bufferlist v;
+      v.append("a");
+      t->set("P", stringify(1000000 + i), v);
+    }
+    db->submit_transaction_sync(t);
+  }
+
+  // no iterator is open, so nothing holds back pruning of old versions
+  std::atomic<bool> stop = false;
+  std::atomic<int> bad_reads = 0;
+  std::atomic<int> missing = 0;
+  std::vector<std::thread> readers;
+  for (int r = 0; r < 4; ++r) {
+    readers.emplace_back([&] {
+      while (!stop) {
+	for (int i = 0; i < num_keys; i += 7) {
+	  bufferlist out;
+	  int ret = db->get("P", stringify(1000000 + i), &out);
+	  if (ret == -ENOENT && i % 2) {
+	    // deleted below
+	    continue;
+	  }
+	  if (ret != 0) {
+	    ++missing;
+	    continue;
+	  }
+	  auto v = _bl_to_str(out);
+	  if (v != "a" && v != "b") {
+	    ++bad_reads;
+	  }
+	}
+      }
+    });
+  }
+  // rewrite every other key and delete the rest, a batch at a time
+  for (int i = 0; i < num_keys; i += 10) {
+    KeyValueDB::Transaction t = db->get_transaction();
+    for (int j = i; j < i + 10; ++j) {
+      if (j % 2) {
+	t->rmkey("P", stringify(1000000 + j));
+      } else {
+	bufferlist v;
+	v.append("b");
+	t->set("P", stringify(1000000 + j), v);
+      }
+    }
+    db->submit_transaction_sync(t);
+  }
+  stop = true;
+  for (auto& t : readers) {
+    t.join();
+  }
+  ASSERT_EQ(0, missing);
+  ASSERT_EQ(0, bad_reads);
+
+  {
+    KeyValueDB::Iterator it = db->get_iterator("P");
+    int n = 0;
+    for (it->seek_to_last(); it->valid(); it->prev()) {
+      ASSERT_EQ("b", _bl_to_str(it->value()));
+      ++n;
+    }
+    ASSERT_EQ(num_keys / 2, n);
+  }
+  fini();
+}
+
+TEST_P(KVTest, SnapshotIterator) {
+  ASSERT_EQ(0, db->create_and_open(cout));
+  const int num_keys = 100;
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    for (int i = 0; i < num_keys; ++i) {
+      bufferlist v;
+      v.append("a");
+      t->set("P", stringify(1000000 + i), v);
+    }
+    db->submit_transaction_sync(t);
+  }
+  {
+    KeyValueDB::Iterator snap = db->get_iterator("P");
+    // several transactions, so that the versions the iterator reads at would
+    // be pruned if it did not pin them
+    for (int i = 0; i < num_keys; i += 10) {
+      KeyValueDB::Transaction t = db->get_transaction();
+      for (int j = i; j < i + 10; ++j) {
+	if (j % 2) {
+	  t->rmkey("P", stringify(1000000 + j));
+	} else {
+	  bufferlist v;
+	  v.append("b");
+	  t->set("P", stringify(1000000 + j), v);
+	}
+      }
+      db->submit_transaction_sync(t);
+    }
+
+    // the iterator still sees the data as it was when it was created
+    int n = 0;
+    for (snap->seek_to_first(); snap->valid(); snap->next()) {
+      ASSERT_EQ(stringify(1000000 + n), snap->key());
+      ASSERT_EQ("a", _bl_to_str(snap->value()));
+      ++n;
+    }
+    ASSERT_EQ(num_keys, n);
+  }
+  fini();
+}
+
 TEST_P(KVTest, Merge) {
   shared_ptr<KeyValueDB::MergeOperator> p(new AppendMOP);
   int r = db->set_merge_operator("A",p);
@@ -350,6 +468,44 @@ TEST_P(KVTest, ShardingRMRange) {
   fini();
 }
 
+TEST_P(KVTest, MultiGet) {
+  std::string cfs;
+  if (string(GetParam()) == "rocksdb") {
+    cfs = "O(7)=";
+  }
+  ASSERT_EQ(0, db->create_and_open(cout, cfs));
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    for (size_t i = 0; i < 100; i += 2) {
+      char* a;
+      ASSERT_EQ(asprintf(&a, "key%3.3ld", i), 6);
+      bufferlist value;
+      value.append(a);
+      t->set("O", a, value);
+      t->set("P", a, value);
+      free(a);
+    }
+    db->submit_transaction_sync(t);
+  }
+
+  for (auto prefix : {"O", "P"}) {
+    std::set<std::string> keys;
+    for (size_t i = 0; i < 100; i++) {
+      char* a;
+      ASSERT_EQ(asprintf(&a, "key%3.3ld", i), 6);
+      keys.insert(a);
+      free(a);
+    }
+    std::map<std::string, bufferlist> out;
+    ASSERT_EQ(0, db->get(prefix, keys, &out));
+    ASSERT_EQ(50u, out.size());
+    for (auto& [k, v] : out) {
+      ASSERT_EQ(k, _bl_to_str(v));
+      ASSERT_EQ(0, atoi(k.c_str() + 3) % 2);
+    }
+  }
+  fini();
+}
 
 TEST_P(KVTest, RocksDBColumnFamilyTest) {
   if(string(GetParam()) != "rocksdb")
@@ -495,6 +651,152 @@ TEST_P(KVTest, RocksDBShardingIteratorTest) {
   fini();
 }
 
+TEST_P(KVTest, RocksDBShardingPrefixBloom) {
+  if(string(GetParam()) != "rocksdb")
+    return;
+
+  std::string cfs("O(5)=bloom_bits=10;prefix_extractor=rocksdb.FixedPrefix.4");
+  ASSERT_EQ(0, db->init(g_conf()->bluestore_rocksdb_options));
+  ASSERT_EQ(0, db->create_and_open(cout, cfs));
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    for (size_t i = 0; i < 26 * 10; i++) {
+      std::string key(4, 'a' + i / 10);
+      key += "." + stringify(i % 10);
+      bufferlist value;
+      value.append(key);
+      t->set("O", key, value);
+    }
+    ASSERT_EQ(0, db->submit_transaction_sync(t));
+  }
+  db->compact();
+  {
+    // bounded listing of one prefix, as done for omap
+    KeyValueDB::Iterator iter = db->get_iterator(
+      "O", 0, KeyValueDB::IteratorBounds{"cccc", "cccd"});
+    size_t n = 0;
+    for (iter->lower_bound("cccc"); iter->valid(); iter->next()) {
+      ASSERT_EQ("cccc." + stringify(n), iter->key());
+      ++n;
+    }
+    ASSERT_EQ(10u, n);
+  }
+  {
+    // unbounded walk over all shards comes back in key order
+    KeyValueDB::Iterator iter = db->get_iterator("O");
+    std::string last;
+    size_t n = 0;
+    for (iter->seek_to_first(); iter->valid(); iter->next()) {
+      ASSERT_LT(last, iter->key());
+      last = iter->key();
+      ++n;
+    }
+    ASSERT_EQ(260u, n);
+    iter->seek_to_last();
+    ASSERT_TRUE(iter->valid());
+    ASSERT_EQ("zzzz.9", iter->key());
+    ASSERT_EQ(0, iter->prev());
+    ASSERT_EQ("zzzz.8", iter->key());
+  }
+  fini();
+}
+
+TEST_P(KVTest, RocksDBBinnedClockCache) {
+  if (string(GetParam()) != "rocksdb")
+    GTEST_SKIP();
+
+  g_conf().set_val_or_die("rocksdb_cache_type", "binned_clock");
+  // small enough for the reads below to keep evicting
+  g_conf().set_val_or_die("rocksdb_cache_size", "1048576");
+  fini();
+  init();
+  ASSERT_EQ(0, db->create_and_open(cout));
+  const int num_keys = 4096;
+  bufferlist value;
+  value.append(string(1024, 'v'));
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    for (int i = 0; i < num_keys; ++i) {
+      t->set("P", stringify(i), value);
+    }
+    ASSERT_EQ(0, db->submit_transaction_sync(t));
+  }
+  db->compact();
+  std::atomic<int> misses = 0;
+  std::vector<std::thread> readers;
+  for (int r = 0; r < 4; ++r) {
+    readers.emplace_back([&, r] {
+      for (int pass = 0; pass < 4; ++pass) {
+	for (int i = r; i < num_keys; i += 3) {
+	  bufferlist out;
+	  if (db->get("P", stringify(i), &out) < 0 ||
+	      !out.contents_equal(value)) {
+	    ++misses;
+	  }
+	}
+      }
+    });
+  }
+  for (auto& t : readers) {
+    t.join();
+  }
+  ASSERT_EQ(0, misses);
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    t->rmkey("P", "0");
+    ASSERT_EQ(0, db->submit_transaction_sync(t));
+    bufferlist out;
+    ASSERT_EQ(-ENOENT, db->get("P", "0", &out));
+  }
+  g_conf().rm_val("rocksdb_cache_type");
+  g_conf().rm_val("rocksdb_cache_size");
+  fini();
+}
+
+TEST_P(KVTest, RocksDBHeatMap) {
+  if (string(GetParam()) != "rocksdb")
+    GTEST_SKIP();
+
+  g_conf().set_val_or_die("rocksdb_heat_map_sample_every", "1");
+  g_conf().set_val_or_die("rocksdb_heat_map_key_bytes", "4");
+  fini();
+  init();
+  ASSERT_EQ(0, db->create_and_open(cout));
+  bufferlist value;
+  value.append("v");
+  for (int i = 0; i < 100; ++i) {
+    KeyValueDB::Transaction t = db->get_transaction();
+    t->set("P", "hot." + stringify(i % 10), value);
+    if (i % 50 == 0) {
+      t->set("P", "cold" + stringify(i), value);
+    }
+    db->submit_transaction_sync(t);
+  }
+  bufferlist out;
+  ASSERT_EQ(0, db->get("P", "hot.1", &out));
+  auto logger = db->get_perf_counters();
+  ASSERT_EQ(102u, logger->get(l_rocksdb_heat_map_writes));
+  ASSERT_EQ(1u, logger->get(l_rocksdb_heat_map_reads));
+  ASSERT_EQ(2u, logger->get(l_rocksdb_heat_map_ranges));
+
+  AdminSocket* admin_socket = g_ceph_context->get_admin_socket();
+  ASSERT_TRUE(admin_socket);
+  bufferlist in;
+  ostringstream err;
+  out.clear();
+  ASSERT_EQ(0, admin_socket->execute_command(
+    { "{\"prefix\": \"rocksdb heat map\", \"key_prefix\": \"P\"}" },
+    in, err, &out));
+  string dump(out.c_str(), out.length());
+  // hottest range first
+  ASSERT_NE(string::npos, dump.find("hot."));
+  ASSERT_LT(dump.find("hot."), dump.find("cold"));
+
+  g_conf().rm_val("rocksdb_heat_map_sample_every");
+  g_conf().rm_val("rocksdb_heat_map_key_bytes");
+  fini();
+}
+
 TEST_P(KVTest, RocksDBCFMerge) {
   if(string(GetParam()) != "rocksdb")
     return;
@@ -255,3 +255,168 @@ TEST(PerfCounters, read_avg) {
   t2.join();
   t1.join();
 }
+
+enum {
+  TEST_PERFCOUNTERS4_ELEMENT_FIRST = 500,
+  TEST_PERFCOUNTERS4_ELEMENT_OPS,
+  TEST_PERFCOUNTERS4_ELEMENT_LAT,
+  TEST_PERFCOUNTERS4_ELEMENT_LAST,
+};
+
+static std::shared_ptr<PerfCounters> setup_test_perfcounter4(
+  CephContext* cct, bool sharded) {
+  PerfCountersBuilder bld(cct, "test_perfcounter_4",
+      TEST_PERFCOUNTERS4_ELEMENT_FIRST, TEST_PERFCOUNTERS4_ELEMENT_LAST);
+  bld.set_sharded(sharded);
+  bld.add_u64_counter(TEST_PERFCOUNTERS4_ELEMENT_OPS, "ops");
+  bld.add_time_avg(TEST_PERFCOUNTERS4_ELEMENT_LAT, "lat");
+  return std::shared_ptr<PerfCounters>(bld.create_perf_counters());
+}
+
+TEST(PerfCounters, sharded) {
+  auto pf = setup_test_perfcounter4(g_ceph_context, true);
+  constexpr int threads = 8;
+  constexpr int ops = 10000;
+  std::vector<std::thread> workers;
+  for (int i = 0; i < threads; ++i) {
+    workers.emplace_back([pf] {
+      for (int j = 0; j < ops; ++j) {
+	pf->inc(TEST_PERFCOUNTERS4_ELEMENT_OPS);
+	pf->tinc(TEST_PERFCOUNTERS4_ELEMENT_LAT, std::chrono::microseconds(1));
+      }
+    });
+  }
+  for (auto& t : workers) {
+    t.join();
+  }
+  ASSERT_EQ((uint64_t)threads * ops, pf->get(TEST_PERFCOUNTERS4_ELEMENT_OPS));
+  auto avg = pf->get_tavg_ns(TEST_PERFCOUNTERS4_ELEMENT_LAT);
+  ASSERT_EQ((uint64_t)threads * ops, avg.first);
+  ASSERT_EQ((uint64_t)threads * ops * 1000, avg.second);
+
+  // set() overrides whatever the shards hold
+  pf->set(TEST_PERFCOUNTERS4_ELEMENT_OPS, 5);
+  ASSERT_EQ(5u, pf->get(TEST_PERFCOUNTERS4_ELEMENT_OPS));
+  pf->inc(TEST_PERFCOUNTERS4_ELEMENT_OPS);
+  ASSERT_EQ(6u, pf->get(TEST_PERFCOUNTERS4_ELEMENT_OPS));
+
+  pf->reset();
+  ASSERT_EQ(0u, pf->get(TEST_PERFCOUNTERS4_ELEMENT_OPS));
+  avg = pf->get_tavg_ns(TEST_PERFCOUNTERS4_ELEMENT_LAT);
+  ASSERT_EQ(0u, avg.first);
+  ASSERT_EQ(0u, avg.second);
+}
+
+TEST(PerfCounters, sharded_bench) {
+  constexpr uint64_t ops = 1000000;
+  for (bool sharded : {false, true}) {
+    for (int threads = 1; threads <= 64; threads *= 2) {
+      auto pf = setup_test_perfcounter4(g_ceph_context, sharded);
+      std::vector<std::thread> workers;
+      const auto start = ceph::mono_clock::now();
+      for (int i = 0; i < threads; ++i) {
+	workers.emplace_back([pf] {
+	  for (uint64_t j = 0; j < ops / 64; ++j) {
+	    pf->inc(TEST_PERFCOUNTERS4_ELEMENT_OPS);
+	    pf->tinc(TEST_PERFCOUNTERS4_ELEMENT_LAT, ceph::timespan(1));
+	  }
+	});
+      }
+      for (auto& t : workers) {
+	t.join();
+      }
+      const auto elapsed = ceph::mono_clock::now() - start;
+      ASSERT_EQ(threads * (ops / 64), pf->get(TEST_PERFCOUNTERS4_ELEMENT_OPS));
+      std::cout << (sharded ? "sharded" : "unsharded") << " " << threads
+		<< " threads: " << threads * (ops / 64) << " inc+tinc in "
+		<< elapsed << std::endl;
+    }
+  }
+}
+
+enum {
+  TEST_PERFCOUNTERS5_ELEMENT_FIRST = 600,
+  TEST_PERFCOUNTERS5_ELEMENT_LAT,
+  TEST_PERFCOUNTERS5_ELEMENT_LAST,
+};
+
+TEST(PerfCounters, latency_histogram) {
+  PerfCountersBuilder bld(g_ceph_context, "test_perfcounter_5",
+      TEST_PERFCOUNTERS5_ELEMENT_FIRST, TEST_PERFCOUNTERS5_ELEMENT_LAST);
+  bld.set_latency_histogram(4);
+  bld.add_time_avg(TEST_PERFCOUNTERS5_ELEMENT_LAT, "lat");
+  PerfCounters* pf = bld.create_perf_counters();
+  PerfCountersCollection *coll = g_ceph_context->get_perfcounters_collection();
+  coll->add(pf);
+
+  // 1 slow op in 1000
+  for (int i = 0; i < 999; ++i) {
+    pf->tinc(TEST_PERFCOUNTERS5_ELEMENT_LAT, utime_t(0, 1000));
+  }
+  pf->tinc(TEST_PERFCOUNTERS5_ELEMENT_LAT, utime_t(1, 0));
+
+  AdminSocketClient client(get_rand_socket_path());
+  std::string msg;
+  ASSERT_EQ("", client.do_request("{ \"prefix\": \"perf dump\", \"logger\": \"test_perfcounter_5\", \"format\": \"json\" }", &msg));
+  // the percentiles are within 1/32 of the real values
+  EXPECT_NE(std::string::npos, msg.find("\"lat_p50\":0.000001"));
+  EXPECT_NE(std::string::npos, msg.find("\"lat_p99\":0.000001"));
+  EXPECT_NE(std::string::npos, msg.find("\"lat_p999\":0.000001"));
+  pf->tinc(TEST_PERFCOUNTERS5_ELEMENT_LAT, utime_t(1, 0));
+  ASSERT_EQ("", client.do_request("{ \"prefix\": \"perf dump\", \"logger\": \"test_perfcounter_5\", \"format\": \"json\" }", &msg));
+  EXPECT_NE(std::string::npos, msg.find("\"lat_p999\":0.98")) << msg;
+
+  ASSERT_EQ("", client.do_request("{ \"prefix\": \"perf latency histogram dump\", \"logger\": \"test_perfcounter_5\", \"format\": \"json\" }", &msg));
+  EXPECT_NE(std::string::npos, msg.find("\"lat\":{\"precision_bits\":4,")) << msg;
+  EXPECT_NE(std::string::npos, msg.find("\"count\":1001,")) << msg;
+
+  coll->remove(pf);
+  delete pf;
+}
+
+enum {
+  TEST_PERFCOUNTERS6_ELEMENT_FIRST = 700,
+  TEST_PERFCOUNTERS6_ELEMENT_LAT,
+  TEST_PERFCOUNTERS6_ELEMENT_HIST,
+  TEST_PERFCOUNTERS6_ELEMENT_LAST,
+};
+
+// perf histogram dump/schema only ever hold 2D histograms, whatever else
+// the logger tracks
+TEST(PerfCounters, histogram_dump_schema) {
+  PerfHistogramCommon::axis_config_d x_axis{
+    "Latency (usec)", PerfHistogramCommon::SCALE_LOG2, 0, 100000, 32};
+  PerfHistogramCommon::axis_config_d y_axis{
+    "Request size (bytes)", PerfHistogramCommon::SCALE_LOG2, 0, 512, 32};
+  PerfCountersBuilder bld(g_ceph_context, "test_perfcounter_6",
+      TEST_PERFCOUNTERS6_ELEMENT_FIRST, TEST_PERFCOUNTERS6_ELEMENT_LAST);
+  bld.set_latency_histogram(4);
+  bld.add_time_avg(TEST_PERFCOUNTERS6_ELEMENT_LAT, "lat");
+  bld.add_u64_counter_histogram(TEST_PERFCOUNTERS6_ELEMENT_HIST, "hist",
+				x_axis, y_axis);
+  PerfCounters* pf = bld.create_perf_counters();
+  PerfCountersCollection *coll = g_ceph_context->get_perfcounters_collection();
+  coll->add(pf);
+  pf->tinc(TEST_PERFCOUNTERS6_ELEMENT_LAT, utime_t(0, 1000));
+  pf->hinc(TEST_PERFCOUNTERS6_ELEMENT_HIST, 1000, 4096);
+
+  AdminSocketClient client(get_rand_socket_path());
+  std::string msg;
+  ASSERT_EQ("", client.do_request("{ \"prefix\": \"perf histogram dump\", \"logger\": \"test_perfcounter_6\", \"format\": \"json\" }", &msg));
+  EXPECT_NE(std::string::npos, msg.find("{\"test_perfcounter_6\":{\"hist\":{\"axes\":[")) << msg;
+  EXPECT_NE(std::string::npos, msg.find("\"values\":[[")) << msg;
+  EXPECT_EQ(std::string::npos, msg.find("\"lat")) << msg;
+  EXPECT_EQ(std::string::npos, msg.find("precision_bits")) << msg;
+
+  ASSERT_EQ("", client.do_request("{ \"prefix\": \"perf histogram schema\", \"format\": \"json\" }", &msg));
+  EXPECT_NE(std::string::npos, msg.find("\"test_perfcounter_6\":{\"hist\":{")) << msg;
+  EXPECT_NE(std::string::npos, msg.find("\"value_type\":\"integer-2d-histogram\"")) << msg;
+  EXPECT_EQ(std::string::npos, msg.find("hdr-histogram")) << msg;
+
+  ASSERT_EQ("", client.do_request("{ \"prefix\": \"perf latency histogram dump\", \"logger\": \"test_perfcounter_6\", \"format\": \"json\" }", &msg));
+  EXPECT_EQ(std::string::npos, msg.find("\"hist\"")) << msg;
+  EXPECT_NE(std::string::npos, msg.find("\"lat\":{\"precision_bits\":4,")) << msg;
+
+  coll->remove(pf);
+  delete pf;
+}